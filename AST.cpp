@@ -1,16 +1,146 @@
 #include "AST.hpp"
+#include "ParseEvents.hpp"
+#include "TreeWalk.hpp"
 
-AST::AST(const std::string &path, Error &e) : Scanner(path, e), root(std::make_shared<Node>(Node(TokenType::TRANSLATION_UNIT)))
+Node::~Node()
 {
-    root->t.lexeme = path;
-    root = parsingFile(root);
+    releaseChildren<Node>(children);
 }
-std::shared_ptr<Node> AST::parsingFile(std::shared_ptr<Node> root)
+
+AST::AST(const std::string &path, Error &e, const ParseOptions &options) : Scanner(path, e), root(std::make_shared<Node>(Node(TokenType::TRANSLATION_UNIT)))
+{
+    parseFile(options);
+}
+AST::AST(std::string_view text, const std::string &name, Error &e, const ParseOptions &options)
+    : Scanner(text, name, e), root(std::make_shared<Node>(Node(TokenType::TRANSLATION_UNIT)))
+{
+    parseFile(options);
+}
+AST::AST(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options)
+    : Scanner(text, name, context.error(), context.store())
+{
+    arena = context.nodes();
+    root = makeNode(TokenType::TRANSLATION_UNIT);
+    parseFile(options);
+}
+AST::AST(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options, ParseListener &listener)
+    : Scanner(text, name, context.error(), context.store()), root(std::make_shared<Node>(TokenType::TRANSLATION_UNIT)), listener(&listener)
+{
+    // the root holds nothing from the arena, so that it is idle again after
+    // each declaration
+    arena = context.nodes();
+    lexAhead = false;
+    parseFile(options);
+}
+AST::AST(ParserContext &context, std::shared_ptr<TokenStore> tokens, const std::map<std::string, Macro> &macros, const std::string &name,
+         const ParseOptions &options)
+    : Scanner(tokens, 0, tokens->size(), context.error())
+{
+    pathToFile = name;
+    definedMacro = macros;
+    arena = context.nodes();
+    root = makeNode(TokenType::TRANSLATION_UNIT);
+    // the parallel parse lays the tokens out again, which would change them
+    // under the other parses
+    ParseOptions sequential = options;
+    sequential.threads = 1;
+    parseFile(sequential);
+}
+void AST::countNode()
+{
+    nodeCount++;
+    if (budget.nodes && nodeCount > budget.nodes)
+        exceed(Budget::Nodes, true);
+    else if ((nodeCount & 1023) == 0 && pastDeadline())
+        exceed(Budget::Time, true);
+}
+void AST::parseFile(const ParseOptions &options)
 {
-    TokenToString t;
+    lazyBodies = options.lazyBodies;
+    setBudget(options.budget);
+    if (listener)
+    {
+        listener->onEnter(TokenType::TRANSLATION_UNIT, SourceRange{});
+        root = parse(root, options.engine);
+        releaseDelivered();
+        listener->onExit(TokenType::TRANSLATION_UNIT);
+    }
+    else if (options.threads > 1 && !lazyBodies && !budgeted)
+        root = parsingParallel(root, options);
+    else
+        root = parse(root, options.engine);
+}
+AST::AST(std::shared_ptr<TokenStore> tokens, uint32_t first, uint32_t last, Error &e, ParserEngine engine, const TypeNameIndex *outer, std::size_t index)
+    : Scanner(std::move(tokens), first, last, e), root(std::make_shared<Node>(Node(TokenType::TRANSLATION_UNIT))), outerTypeNames(outer), declarationIndex(index)
+{
+    root = parse(root, engine);
+}
+std::shared_ptr<Node> AST::parse(std::shared_ptr<Node> root, ParserEngine engine)
+{
+    return engine == ParserEngine::LALR ? parsingTable(root) : parsingFile(root);
+}
 
+// Synchronization sets for panic-mode recovery. After an error inside a
+// top-level declaration the parser skips to the next declaration start; inside
+// a block or a struct body, to the next member, declaration or statement
+// keyword, or to the closing '}'.
+static constexpr TokenSet externalSync = firstSet(TokenType::EXTERNAL_DECLARATION);
+static constexpr TokenSet blockSync = firstSet(TokenType::DECLARATION) | TokenSet{
+    TokenType::IF, TokenType::SWITCH, TokenType::WHILE, TokenType::DO, TokenType::FOR,
+    TokenType::GOTO, TokenType::CONT, TokenType::BRK, TokenType::RETURN, TokenType::R_CUR};
+static constexpr TokenSet structSync = firstSet(TokenType::STRUCT_DECLARATION) | TokenSet{TokenType::R_CUR};
+
+// tokens that begin a new declaration rather than continue a declarator
+static constexpr TokenSet specifierStarts = firstSet(TokenType::STORAGE_CLASS_SPECIFIER) | firstSet(TokenType::TYPE_SPECIFIER);
+
+void AST::synchronize(const TokenSet &stopBefore)
+{
+    // A ';' ends the skip only outside braces, and a token of stopBefore only
+    // outside any bracket; a '}' closing a brace group opened while skipping
+    // ends it too, as does a stray '}' that stopBefore does not claim. Every
+    // token is looked at once, so recovery never costs more than the input.
+    int brackets = 0;
+    int braces = 0;
     while (true)
     {
+        auto next = peekNextToken();
+        TokenType type = next->type;
+        if (type == TokenType::END)
+            return;
+        if (braces == 0)
+        {
+            if (type == TokenType::SEMI_COLON)
+            {
+                getNextToken();
+                return;
+            }
+            if (type == TokenType::R_CUR)
+            {
+                if (!stopBefore.contains(type))
+                    getNextToken();
+                return;
+            }
+            if (brackets == 0 && stopBefore.contains(type))
+                return;
+        }
+        getNextToken();
+        if (type == TokenType::L_BR || type == TokenType::L_SQR)
+            brackets++;
+        else if ((type == TokenType::R_BR || type == TokenType::R_SQR) && brackets > 0)
+            brackets--;
+        else if (type == TokenType::L_CUR)
+            braces++;
+        else if (type == TokenType::R_CUR && --braces == 0)
+            return;
+    }
+}
+
+std::shared_ptr<Node> AST::parsingFile(std::shared_ptr<Node> root)
+{
+    while (true)
+    {
+        if (listener)
+            releaseDelivered();
         auto itr = peekNextToken();
 
         if (itr->type == TokenType::END)
@@ -19,16 +149,28 @@ std::shared_ptr<Node> AST::parsingFile(std::shared_ptr<Node> root)
         if (itr->type == TokenType::INCLUDE)
         {
             getNextToken(); // consume INCLUDE token
-            root->children.push_back(includeStmt());
+            auto include = includeStmt();
+            if (listener)
+                deliver(include);
+            else
+                root->children.push_back(include);
         }
         else
         {
             // Parse external declaration (function definition or declaration)
+            std::size_t reported = loggedError.reported;
             auto extDecl = externalDeclaration();
-            if (!extDecl)
-                break; // End of file or unrecoverable error
             if (extDecl && !extDecl->children.empty())
-                root->children.push_back(extDecl);
+            {
+                if (listener)
+                    deliver(extDecl);
+                else
+                    root->children.push_back(extDecl);
+            }
+            // externalDeclaration reads at least one token, so this always
+            // moves forward
+            if (loggedError.reported != reported && !atConstructEnd())
+                synchronize(externalSync);
         }
     }
 
@@ -39,11 +181,11 @@ std::shared_ptr<Node> AST::includeStmt()
     auto itr = getNextToken();
     Node stmt(TokenType::INCLUDE_STMT);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
 
     auto tempType = itr->type;
     if (itr->type == TokenType::DOUBLE_QUOTE || itr->type == TokenType::LT)
-        ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+        ret->children.push_back(leaf(itr));
 
     else
     {
@@ -53,7 +195,7 @@ std::shared_ptr<Node> AST::includeStmt()
     itr = getNextToken();
 
     if (itr->type == TokenType::INCLUDE_PATH)
-        ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+        ret->children.push_back(leaf(itr));
     else
     {
         loggedError.addError(lineNo, INCLUD_ERROR);
@@ -62,7 +204,7 @@ std::shared_ptr<Node> AST::includeStmt()
     itr = getNextToken();
 
     if ((itr->type == TokenType::DOUBLE_QUOTE && tempType == TokenType::DOUBLE_QUOTE) || (itr->type == TokenType::GT && tempType == TokenType::LT))
-        ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+        ret->children.push_back(leaf(itr));
     else
     {
         loggedError.addError(lineNo, INCLUD_ERROR);
@@ -71,25 +213,26 @@ std::shared_ptr<Node> AST::includeStmt()
     return ret;
 }
 
-std::shared_ptr<Node> AST::structUnionSpecifier(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::structUnionSpecifier(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::STRUCT_UNION_SPECIFIER);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
     
-    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+    ret->children.push_back(leaf(begin));
     auto itr = getNextToken();
     if (itr->type == TokenType::ID)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+        ret->children.push_back(leaf(itr));
         itr = peekNextToken();
         if (itr->type == TokenType::L_CUR)
         {
             itr = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+            ret->children.push_back(leaf(itr));
             itr = getNextToken();
             ret->children.push_back(structDeclarationList(itr));
             itr = getNextToken();
@@ -99,12 +242,12 @@ std::shared_ptr<Node> AST::structUnionSpecifier(std::list<Token>::iterator begin
                 ungetToken();
             }
             else
-                ret->children.push_back(std::make_shared<Node>(std::move(*(itr))));
+                ret->children.push_back(leaf(itr));
         }
     }
     else if (itr->type == TokenType::L_CUR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*itr)));
+        ret->children.push_back(leaf(itr));
 
         itr = getNextToken();
         ret->children.push_back(structDeclarationList(itr));
@@ -115,37 +258,42 @@ std::shared_ptr<Node> AST::structUnionSpecifier(std::list<Token>::iterator begin
             ungetToken();
         }
         else
-            ret->children.push_back(std::make_shared<Node>(std::move(*(itr))));
+            ret->children.push_back(leaf(itr));
     }
     else
         loggedError.addGrammarError(begin->lineNo, STRUCT_UNION_ERROR);
     return ret;
 }
-std::shared_ptr<Node> AST::structDeclarationList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::structDeclarationList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::STRUCT_DECLARATION_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator  
     currentToken = begin;
     
-    // Parse first struct declaration (begin already points to it)
-    ret->children.push_back(structDeclaration(begin));
-    
-    // Parse remaining struct declarations
-    while (peekNextToken()->type != TokenType::R_CUR && peekNextToken()->type != TokenType::END)
+    // begin already points to the first struct declaration; after an error
+    // the rest of the member is skipped
+    while (true)
     {
-        begin = getNextToken();
+        std::size_t reported = loggedError.reported;
         ret->children.push_back(structDeclaration(begin));
+        if (loggedError.reported != reported && !atConstructEnd())
+            synchronize(structSync);
+
+        auto next = peekNextToken();
+        if (next->type == TokenType::R_CUR || next->type == TokenType::END)
+            break;
+        begin = getNextToken();
     }
     return ret;
 }
-std::shared_ptr<Node> AST::structDeclaration(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::structDeclaration(TokenStore::iterator begin)
 {
     Node stmt(TokenType::STRUCT_DECLARATION);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
@@ -173,33 +321,33 @@ std::shared_ptr<Node> AST::structDeclaration(std::list<Token>::iterator begin)
     }
     
     if (begin->type == TokenType::SEMI_COLON)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     else
         loggedError.addGrammarError(begin->lineNo, "Expected ';' after struct declaration");
     return ret;
 }
-std::shared_ptr<Node> AST::structDeclaratorList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::structDeclaratorList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::STRUCT_DECLARATOR_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
 
     ret->children.push_back(structDeclarator(begin));
 
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(structDeclarator(begin));
     }
     return ret;
 }
-std::shared_ptr<Node> AST::structDeclarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::structDeclarator(TokenStore::iterator begin)
 {
     Node stmt(TokenType::STRUCT_DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
@@ -211,11 +359,11 @@ std::shared_ptr<Node> AST::structDeclarator(std::list<Token>::iterator begin)
         if (begin->type == TokenType::COLON)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             if (peekNextToken()->type == TokenType::CONSTANT)
             {
                 begin = getNextToken();
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             }
         }
     }
@@ -223,22 +371,23 @@ std::shared_ptr<Node> AST::structDeclarator(std::list<Token>::iterator begin)
     {
         if (begin->type == TokenType::COLON)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = peekNextToken();
             if (begin->type == TokenType::CONSTANT)
             {
                 begin = getNextToken();
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             }
         }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::declarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::declarator(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
@@ -251,25 +400,25 @@ std::shared_ptr<Node> AST::declarator(std::list<Token>::iterator begin)
     ret->children.push_back(directDeclarator(begin));
     return ret;
 }
-std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::directDeclarator(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DIRECT_DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
     
     if (begin->type == TokenType::ID || begin->type == TokenType::MAIN)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     else if (begin->type == TokenType::L_BR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(declarator(begin));
         begin = getNextToken();
         if (begin->type == TokenType::R_BR)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
     }
     else
     {
@@ -280,25 +429,25 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
     while (peekNextToken()->type == TokenType::L_SQR || peekNextToken()->type == TokenType::L_BR)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         auto next = getNextToken();
         if (begin->type == TokenType::L_SQR)
         {
             // Handle C11 array syntax: [ ], [ * ], [ STATIC ... ], [ type-qualifiers ... ]
             if (next->type == TokenType::R_SQR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                ret->children.push_back(leaf(next));
             }
             else if (next->type == TokenType::MUL)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                ret->children.push_back(leaf(next));
                 next = getNextToken();
                 if (next->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
             else if (next->type == TokenType::STATIC)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                ret->children.push_back(leaf(next));
                 next = getNextToken();
                 
                 // Check for optional type qualifier list after STATIC
@@ -312,7 +461,7 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
                 ret->children.push_back(assignmentExpression(next));
                 next = getNextToken();
                 if (next->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
             else if (typeQualifier(next))
             {
@@ -322,12 +471,12 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
                 // After type qualifiers, can be: *, STATIC expr, expr, or ]
                 if (next->type == TokenType::MUL)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
                     next = getNextToken();
                 }
                 else if (next->type == TokenType::STATIC)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
                     next = getNextToken();
                     ret->children.push_back(assignmentExpression(next));
                     next = getNextToken();
@@ -339,7 +488,7 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
                 }
                 
                 if (next->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
             else
             {
@@ -347,7 +496,7 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
                 ret->children.push_back(assignmentExpression(next));
                 next = getNextToken();
                 if (next->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
         }
         else if (begin->type == TokenType::L_BR)
@@ -355,89 +504,89 @@ std::shared_ptr<Node> AST::directDeclarator(std::list<Token>::iterator begin)
             if (next->type == TokenType::R_BR)
             {
                 // Empty parameter list ()
-                ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                ret->children.push_back(leaf(next));
             }
             else if (next->type == TokenType::ID)
             {
                 ret->children.push_back(identifierList(next));
                 next = getNextToken();
                 if (next->type == TokenType::R_BR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
             else
             {
                 ret->children.push_back(parameterTypeList(next));
                 next = getNextToken();
                 if (next->type == TokenType::R_BR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*next)));
+                    ret->children.push_back(leaf(next));
             }
         }
     }
 
     return ret;
 }
-std::shared_ptr<Node> AST::identifierList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::identifierList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::IDENTIFIER_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::ID)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         while (peekNextToken()->type == TokenType::COMMA)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = peekNextToken();
             if (begin->type == TokenType::ID)
             {
                 begin = getNextToken();
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             }
         }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::parameterTypeList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::parameterTypeList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::PARAMETER_TYPE_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     ret->children.push_back(parameterList(begin));
     if (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         if (peekNextToken()->type == TokenType::ELLIPSIS)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::parameterList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::parameterList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::PARAMETER_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     ret->children.push_back(parameterDeclaration(begin));
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(parameterDeclaration(begin));
     }
     return ret;
 }
 // Debugging
-std::shared_ptr<Node> AST::parameterDeclaration(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::parameterDeclaration(TokenStore::iterator begin)
 {
     Node stmt(TokenType::PARAMETER_DECLARATION);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     ret->children.push_back(declarationSpecifier(begin));
     begin = peekNextToken();
     if (begin->type == TokenType::MUL || begin->type == TokenType::ID || begin->type == TokenType::L_BR || begin->type == TokenType::L_SQR)
@@ -474,8 +623,17 @@ std::shared_ptr<Node> AST::parameterDeclaration(std::list<Token>::iterator begin
 
             int bracketCount = 1;
             bool isDeclarator = false;
-            for (; bracketCount != 0 && itr != symbolTable.end(); itr = std::next(itr))
+            uint32_t scanned = 0;
+            for (; bracketCount != 0 && itr != tokenEnd(); itr = std::next(itr))
             {
+                // the scan reads ahead without getNextToken, which would check
+                // the time budget; a deep nest of parameters is scanned once
+                // per level
+                if (budgeted && (++scanned & 255) == 0 && pastDeadline())
+                {
+                    exceed(Budget::Time, true);
+                    return ret;
+                }
                 appendList(symbolTable);
                 if (itr->type == TokenType::L_BR)
                 {
@@ -488,7 +646,7 @@ std::shared_ptr<Node> AST::parameterDeclaration(std::list<Token>::iterator begin
                         isDeclarator = true;
                         break;
                     }
-                    if (std::next(itr)->type == TokenType::MUL && std::next(itr) != symbolTable.end())
+                    if (std::next(itr) != tokenEnd() && std::next(itr)->type == TokenType::MUL)
                     {
                         auto type = std::next(itr)->type;
                         itr = std::next(itr);
@@ -512,19 +670,16 @@ std::shared_ptr<Node> AST::parameterDeclaration(std::list<Token>::iterator begin
     }
     return ret;
 }
-std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::declarationSpecifier(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DECLARATION_SPECIFIERS);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
-    auto start = begin;
+    ret = makeNode(std::move(stmt));
     
     // First token must be a declaration specifier
     bool hasCompleteTypeSpec = false; // Track if we've seen a complete type specifier (struct/union/enum with body)
     
-    if (storageClassSpecifier(begin) || typeSpecifier(begin) || typeQualifier(begin) || 
-        functionSpecifier(begin) || isAlignmentSpecifier(begin) ||
-        (!begin->lexeme.empty() && isTypeName(begin->lexeme)))
+    if (startsWith(TokenType::DECLARATION_SPECIFIERS, begin))
     {
         // Handle first specifier
         if (structUnion(begin))
@@ -537,7 +692,7 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
                 // Has at least: STRUCT/UNION, possibly ID, and L_CUR (indicating a body)
                 for (const auto& child : structNode->children)
                 {
-                    if (child && child->t.type == TokenType::L_CUR)
+                    if (child && child->type == TokenType::L_CUR)
                     {
                         hasCompleteTypeSpec = true;
                         break;
@@ -554,7 +709,7 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
             {
                 for (const auto& child : enumNode->children)
                 {
-                    if (child && child->t.type == TokenType::L_CUR)
+                    if (child && child->type == TokenType::L_CUR)
                     {
                         hasCompleteTypeSpec = true;
                         break;
@@ -567,15 +722,13 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
         else if (begin->type == TokenType::ATOMIC && peekNextToken()->type == TokenType::L_BR)
             ret->children.push_back(atomicTypeSpecifier(begin));
         else
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         
         // Parse additional specifiers ONLY if we haven't seen a complete type definition
         while (!hasCompleteTypeSpec)
         {
             begin = peekNextToken();
-            if (storageClassSpecifier(begin) || typeSpecifier(begin) || typeQualifier(begin) || 
-                functionSpecifier(begin) || isAlignmentSpecifier(begin) ||
-                (!begin->lexeme.empty() && isTypeName(begin->lexeme)))
+            if (startsWith(TokenType::DECLARATION_SPECIFIERS, begin))
             {
                 begin = getNextToken();
                 if (structUnion(begin))
@@ -585,7 +738,7 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
                     // Check for body
                     for (const auto& child : structNode->children)
                     {
-                        if (child && child->t.type == TokenType::L_CUR)
+                        if (child && child->type == TokenType::L_CUR)
                         {
                             hasCompleteTypeSpec = true;
                             break;
@@ -599,7 +752,7 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
                     // Check for body
                     for (const auto& child : enumNode->children)
                     {
-                        if (child && child->t.type == TokenType::L_CUR)
+                        if (child && child->type == TokenType::L_CUR)
                         {
                             hasCompleteTypeSpec = true;
                             break;
@@ -611,32 +764,20 @@ std::shared_ptr<Node> AST::declarationSpecifier(std::list<Token>::iterator begin
                 else if (begin->type == TokenType::ATOMIC && peekNextToken()->type == TokenType::L_BR)
                     ret->children.push_back(atomicTypeSpecifier(begin));
                 else
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
             else
                 break;
         }
-        
-        // Handle typedef name tracking
-        if (start->type == TokenType::TYPEDEF)
-        {
-            auto itr = currentToken;
-            while (itr->type != TokenType::ID && itr != symbolTable.end())
-            {
-                appendList(symbolTable);
-                itr = std::next(itr);
-            }
-            if (itr != symbolTable.end() && itr->type == TokenType::ID)
-                definedTypeNames.insert(itr->lexeme);
-        }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::abstractDeclarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::abstractDeclarator(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::ABSTRACT_DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::MUL)
     {
@@ -652,39 +793,40 @@ std::shared_ptr<Node> AST::abstractDeclarator(std::list<Token>::iterator begin)
         ret->children.push_back(directAbstractDeclarator(begin));
     return ret;
 }
-std::shared_ptr<Node> AST::initDeclarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::initDeclarator(TokenStore::iterator begin)
 {
     Node stmt(TokenType::INIT_DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     ret->children.push_back(declarator(begin));
     if (peekNextToken()->type == TokenType::ASSIGN)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(initializer(begin));
     }
     return ret;
 }
-std::shared_ptr<Node> AST::initializer(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::initializer(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::INITIALIZER);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::L_CUR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(initializerList(begin));
         begin = getNextToken();
         if (begin->type == TokenType::COMMA)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
         }
         if (begin->type == TokenType::R_CUR)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         else
         {
             loggedError.addError(begin->lineNo, "Expected '}' in initializer");
@@ -698,10 +840,10 @@ std::shared_ptr<Node> AST::initializer(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::initializerList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::initializerList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::INITIALIZER_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     // Check for designation
     if ((begin->type == TokenType::L_SQR) || (begin->type == TokenType::DOT))
@@ -711,14 +853,14 @@ std::shared_ptr<Node> AST::initializerList(std::list<Token>::iterator begin)
     }
     ret->children.push_back(initializer(begin));
 
-    while (peekNextToken()->type == TokenType::COMMA && peekNextToken() != symbolTable.end())
+    while (peekNextToken() != tokenEnd() && peekNextToken()->type == TokenType::COMMA)
     {
         auto next = peekNextToken();
-        if (std::next(next) != symbolTable.end() && std::next(next)->type == TokenType::R_CUR)
+        if (std::next(next) != tokenEnd() && std::next(next)->type == TokenType::R_CUR)
             break;
 
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
 
         // Check for designation
@@ -732,14 +874,14 @@ std::shared_ptr<Node> AST::initializerList(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::designation(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::designation(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DESIGNATION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(designatorList(begin));
     begin = getNextToken();
     if (begin->type == TokenType::ASSIGN)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     else
     {
         loggedError.addError(begin->lineNo, "Expected '=' after designator list");
@@ -748,10 +890,10 @@ std::shared_ptr<Node> AST::designation(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::designatorList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::designatorList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DESIGNATOR_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(designator(begin));
 
     while (peekNextToken()->type == TokenType::L_SQR || peekNextToken()->type == TokenType::DOT)
@@ -762,54 +904,55 @@ std::shared_ptr<Node> AST::designatorList(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::designator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::designator(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DESIGNATOR);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::L_SQR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(constantExpression(begin));
         begin = getNextToken();
         if (begin->type == TokenType::R_SQR)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
     }
     else if (begin->type == TokenType::DOT)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::ID)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         else
             loggedError.addError(begin->lineNo, "Expected identifier after '.'");
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::directAbstractDeclarator(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::DIRECT_ABSTRACT_DECLARATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
-    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+    ret = makeNode(std::move(stmt));
+    ret->children.push_back(leaf(begin));
     if (begin->type == TokenType::L_BR)
     {
 
         begin = getNextToken();
         if (begin->type == TokenType::R_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
 
-        else if (storageClassSpecifier(begin) || typeSpecifier(begin))
+        else if (startsWith(TokenType::PARAMETER_TYPE_LIST, begin))
         {
             ret->children.push_back(parameterTypeList(begin));
             begin = getNextToken();
 
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else
         {
@@ -817,7 +960,7 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
             begin = getNextToken();
 
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
     }
     else if (begin->type == TokenType::L_SQR)
@@ -827,18 +970,18 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
         // Handle C11 array syntax
         if (begin->type == TokenType::R_SQR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
         else if (begin->type == TokenType::MUL)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_SQR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else if (begin->type == TokenType::STATIC)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             
             // Optional type qualifier list
@@ -852,7 +995,7 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
             ret->children.push_back(assignmentExpression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_SQR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else if (typeQualifier(begin))
         {
@@ -861,12 +1004,12 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
             
             if (begin->type == TokenType::MUL)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
             }
             else if (begin->type == TokenType::STATIC)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(assignmentExpression(begin));
                 begin = getNextToken();
@@ -878,7 +1021,7 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
             }
             
             if (begin->type == TokenType::R_SQR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else
         {
@@ -886,7 +1029,7 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
             ret->children.push_back(assignmentExpression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_SQR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
     }
     while (1)
@@ -896,41 +1039,41 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
         {
 
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
 
             begin = getNextToken();
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
-            else if (storageClassSpecifier(begin) || typeSpecifier(begin))
+                ret->children.push_back(leaf(begin));
+            else if (startsWith(TokenType::PARAMETER_TYPE_LIST, begin))
             {
                 ret->children.push_back(parameterTypeList(begin));
                 begin = getNextToken();
 
                 if (begin->type == TokenType::R_BR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
         }
         else if (peeked->type == TokenType::L_SQR)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
 
             // Handle C11 array syntax
             if (begin->type == TokenType::R_SQR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             }
             else if (begin->type == TokenType::MUL)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 if (begin->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
             else if (begin->type == TokenType::STATIC)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 
                 if (typeQualifier(begin))
@@ -942,7 +1085,7 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
                 ret->children.push_back(assignmentExpression(begin));
                 begin = getNextToken();
                 if (begin->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
             else if (typeQualifier(begin))
             {
@@ -951,12 +1094,12 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
                 
                 if (begin->type == TokenType::MUL)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
                     begin = getNextToken();
                 }
                 else if (begin->type == TokenType::STATIC)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
                     begin = getNextToken();
                     ret->children.push_back(assignmentExpression(begin));
                     begin = getNextToken();
@@ -968,14 +1111,14 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
                 }
                 
                 if (begin->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
             else
             {
                 ret->children.push_back(assignmentExpression(begin));
                 begin = getNextToken();
                 if (begin->type == TokenType::R_SQR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
         }
         else
@@ -984,14 +1127,15 @@ std::shared_ptr<Node> AST::directAbstractDeclarator(std::list<Token>::iterator b
 
     return ret;
 }
-std::shared_ptr<Node> AST::pointer(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::pointer(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::POINTER);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     if (begin->type == TokenType::MUL)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = peekNextToken();
         if (begin->type == TokenType::MUL)
         {
@@ -1012,110 +1156,110 @@ std::shared_ptr<Node> AST::pointer(std::list<Token>::iterator begin)
 
     return ret;
 }
-std::shared_ptr<Node> AST::typeQualifierList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::typeQualifierList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::TYPE_QUALIFIER_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     while (typeQualifier(begin))
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
     }
     ungetToken();
     return ret;
 }
-std::shared_ptr<Node> AST::specifierQualifierList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::specifierQualifierList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::SPECIFIER_QUALIFIER_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     
     // Synchronize currentToken with begin iterator
     currentToken = begin;
     
-    while (typeQualifier(begin) || typeSpecifier(begin))
+    while (startsWith(TokenType::SPECIFIER_QUALIFIER_LIST, begin))
     {
         if (structUnion(begin))
             ret->children.push_back(structUnionSpecifier(begin));
         else if (begin->type == TokenType::ENUM)
             ret->children.push_back(enumSpecifier(begin));
         else
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         begin = getNextToken();
     }
     ungetToken();
     return ret;
 }
-std::shared_ptr<Node> AST::enumSpecifier(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::enumSpecifier(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ENUM_SPECIFIER);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     if (begin->type == TokenType::ENUM)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     begin = getNextToken();
     if (begin->type == TokenType::L_CUR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(enumeratorList(begin));
         begin = getNextToken();
         if (begin->type == TokenType::R_CUR)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
     }
     if (begin->type == TokenType::ID)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = peekNextToken();
         if (begin->type == TokenType::L_CUR)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(enumeratorList(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_CUR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::enumerator(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::enumerator(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ENUMERATOR);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     if (begin->type == TokenType::ID)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = peekNextToken();
         if (begin->type == TokenType::ASSIGN)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = peekNextToken();
             if (begin->type == TokenType::CONSTANT)
             {
                 begin = getNextToken();
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             }
         }
     }
     return ret;
 }
-std::shared_ptr<Node> AST::enumeratorList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::enumeratorList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ENUMERATOR_LIST);
     std::shared_ptr<Node> ret;
-    ret = std::make_shared<Node>(std::move(stmt));
+    ret = makeNode(std::move(stmt));
     if (begin->type == TokenType::ID)
     {
         ret->children.push_back(enumerator(begin));
         while (peekNextToken()->type == TokenType::COMMA)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = peekNextToken();
             if (begin->type == TokenType::ID)
             {
@@ -1127,10 +1271,10 @@ std::shared_ptr<Node> AST::enumeratorList(std::list<Token>::iterator begin)
     return ret;
 }
 // Declaration and function definition functions
-std::shared_ptr<Node> AST::declaration(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::declaration(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DECLARATION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     // Synchronize currentToken with begin iterator
     currentToken = begin;
@@ -1156,6 +1300,8 @@ std::shared_ptr<Node> AST::declaration(std::list<Token>::iterator begin)
     {
         begin = getNextToken();
         ret->children.push_back(initDeclaratorList(begin));
+        // every name a typedef declares, once its declarators are parsed
+        declareTypedefNames(ret);
         begin = getNextToken();
     }
     else if (next->type == TokenType::SEMI_COLON)
@@ -1171,34 +1317,37 @@ std::shared_ptr<Node> AST::declaration(std::list<Token>::iterator begin)
     }
 
     if (begin->type == TokenType::SEMI_COLON)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     else
+    {
         loggedError.addGrammarError(begin->lineNo, "Expected ';' after declaration");
+        ungetToken(); // it may start the next declaration
+    }
 
     return ret;
 }
 
-std::shared_ptr<Node> AST::initDeclaratorList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::initDeclaratorList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::INIT_DECLARATOR_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     ret->children.push_back(initDeclarator(begin));
 
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(initDeclarator(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::functionDefinition(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::functionDefinition(TokenStore::iterator begin)
 {
     Node stmt(TokenType::FUNCTION_DEFINITION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     // Synchronize currentToken with begin iterator
     currentToken = begin;
@@ -1210,7 +1359,7 @@ std::shared_ptr<Node> AST::functionDefinition(std::list<Token>::iterator begin)
     // Check if there's a declaration list (old-style K&R C)
     auto next = peekNextToken();
     
-    if (storageClassSpecifier(next) || typeSpecifier(next) || typeQualifier(next))
+    if (startsWith(TokenType::DECLARATION, next))
     {
         begin = getNextToken();
         ret->children.push_back(declarationList(begin));
@@ -1221,7 +1370,10 @@ std::shared_ptr<Node> AST::functionDefinition(std::list<Token>::iterator begin)
     if (next->type == TokenType::L_CUR)
     {
         begin = getNextToken();  // Get the { token
-        ret->children.push_back(compoundStatement(begin));
+        if (lazyBodies)
+            ret->children.push_back(skipBody(begin));
+        else
+            ret->children.push_back(compoundStatement(begin));
     }
     else
     {
@@ -1231,17 +1383,77 @@ std::shared_ptr<Node> AST::functionDefinition(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::declarationList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::skipBody(TokenStore::iterator begin)
+{
+    Node stmt(TokenType::UNPARSED_BODY, begin.index());
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
+
+    // begin is the '{'; stop after the matching '}'
+    int depth = 1;
+    while (depth > 0)
+    {
+        auto next = peekNextToken();
+        if (next->type == TokenType::END)
+        {
+            loggedError.addGrammarError(begin->lineNo, "Expected '}' at end of function body");
+            break;
+        }
+        getNextToken();
+        if (next->type == TokenType::L_CUR)
+            depth++;
+        else if (next->type == TokenType::R_CUR)
+            depth--;
+    }
+    UnparsedBody &body = unparsedBodies[ret.get()];
+    body.tokens = TokenRange{begin, std::next(currentToken)};
+    body.typeNames = typeNameOrder.size();
+    return ret;
+}
+
+std::shared_ptr<Node> AST::expandBody(const std::shared_ptr<Node> &function)
+{
+    for (auto &child : function->children)
+    {
+        if (child->type == TokenType::COMPOUND_STATEMENT)
+            return child;
+        if (child->type != TokenType::UNPARSED_BODY)
+            continue;
+        auto range = unparsedBodies.find(child.get());
+        if (range == unparsedBodies.end())
+            return nullptr;
+        // the typedef names declared after the body are hidden while it is
+        // parsed; those it declares itself go after every other
+        std::size_t before = range->second.typeNames, declared = typeNameOrder.size();
+        for (std::size_t i = before; i < declared; i++)
+            definedTypeNames.erase(typeNameOrder[i]);
+        std::shared_ptr<Node> body;
+        if (range->second.tableState >= 0)
+            body = tableBody(range->second.tokens.begin, range->second.tableState);
+        else
+        {
+            currentToken = range->second.tokens.begin;
+            body = compoundStatement(currentToken);
+        }
+        for (std::size_t i = before; i < declared; i++)
+            definedTypeNames.insert(typeNameOrder[i]);
+        unparsedBodies.erase(range);
+        child = body;
+        return body;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Node> AST::declarationList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::DECLARATION_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     ret->children.push_back(declaration(begin));
 
     while (true)
     {
         auto next = peekNextToken();
-        if (storageClassSpecifier(next) || typeSpecifier(next) || typeQualifier(next))
+        if (startsWith(TokenType::DECLARATION, next))
         {
             begin = getNextToken();
             ret->children.push_back(declaration(begin));
@@ -1255,7 +1467,7 @@ std::shared_ptr<Node> AST::declarationList(std::list<Token>::iterator begin)
 std::shared_ptr<Node> AST::externalDeclaration()
 {
     Node stmt(TokenType::EXTERNAL_DECLARATION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     auto begin = getNextToken();
 
@@ -1267,10 +1479,7 @@ std::shared_ptr<Node> AST::externalDeclaration()
     auto saved = currentToken;
 
     // Parse declaration specifiers (including C11 specifiers)
-    if (!storageClassSpecifier(begin) && !typeSpecifier(begin) && !typeQualifier(begin) &&
-        !functionSpecifier(begin) && !isAlignmentSpecifier(begin) &&
-        !(begin->type == TokenType::STATIC_ASSERT) &&
-        !(!begin->lexeme.empty() && isTypeName(begin->lexeme)))
+    if (!startsWith(TokenType::EXTERNAL_DECLARATION, begin))
     {
         // Don't log error if we're at END - this is expected
         if (begin->type != TokenType::END)
@@ -1367,7 +1576,7 @@ std::shared_ptr<Node> AST::externalDeclaration()
                 continue;
             }
             
-            if (typeSpecifier(tok) || (!tok->lexeme.empty() && isTypeName(tok->lexeme)))
+            if (typeSpecifier(tok))
             {
                 getNextToken();
                 continue;
@@ -1384,10 +1593,7 @@ std::shared_ptr<Node> AST::externalDeclaration()
     
     // Check if next token can start a declarator
     // If it's a type specifier, storage class, etc., it starts a NEW declaration, not a declarator!
-    if (nextTok->type == TokenType::SEMI_COLON ||
-        storageClassSpecifier(nextTok) || typeSpecifier(nextTok) || typeQualifier(nextTok) ||
-        functionSpecifier(nextTok) || isAlignmentSpecifier(nextTok) ||
-        nextTok->type == TokenType::STATIC_ASSERT)
+    if (nextTok->type == TokenType::SEMI_COLON || startsWith(TokenType::DECLARATION, nextTok))
     {
         // Cannot start a declarator - this must be a declaration
         foundCompound = false;
@@ -1421,6 +1627,11 @@ std::shared_ptr<Node> AST::externalDeclaration()
                 break;
             if (tok->type == TokenType::END)
                 break;
+            // a specifier outside brackets starts the next declaration (_Atomic
+            // can still qualify a pointer); stopping there keeps this lookahead
+            // from running over the rest of a malformed file
+            if (bracketDepth == 0 && specifierStarts.contains(tok->type) && tok->type != TokenType::ATOMIC)
+                break;
             if (tok->type == TokenType::L_BR)
                 bracketDepth++;
             if (tok->type == TokenType::R_BR)
@@ -1446,10 +1657,11 @@ std::shared_ptr<Node> AST::externalDeclaration()
 }
 
 // Statement parsing functions
-std::shared_ptr<Node> AST::statement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::statement(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::CASE || begin->type == TokenType::DEFAULT ||
         (begin->type == TokenType::ID && peekNextToken()->type == TokenType::COLON))
@@ -1480,42 +1692,42 @@ std::shared_ptr<Node> AST::statement(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::labeledStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::labeledStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::LABELED_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::ID)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::COLON)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(statement(begin));
         }
     }
     else if (begin->type == TokenType::CASE)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(constantExpression(begin));
         begin = getNextToken();
         if (begin->type == TokenType::COLON)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(statement(begin));
         }
     }
     else if (begin->type == TokenType::DEFAULT)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::COLON)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(statement(begin));
         }
@@ -1523,19 +1735,19 @@ std::shared_ptr<Node> AST::labeledStatement(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::compoundStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::compoundStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::COMPOUND_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::L_CUR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = peekNextToken();
         if (begin->type == TokenType::R_CUR)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
         else
         {
@@ -1543,7 +1755,7 @@ std::shared_ptr<Node> AST::compoundStatement(std::list<Token>::iterator begin)
             ret->children.push_back(blockItemList(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_CUR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
                 loggedError.addError(begin->lineNo, "Expected '}' in compound statement");
         }
@@ -1551,55 +1763,34 @@ std::shared_ptr<Node> AST::compoundStatement(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::blockItemList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::blockItemList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::BLOCK_ITEM_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
-    ret->children.push_back(blockItem(begin));
-
-    // Track previous position to detect infinite loops
-    auto prevToken = currentToken;
-    int noProgressCount = 0;
-    
+    // every block item starts on a token read here, so the loop always moves
+    // forward; after an error the rest of the item is skipped
     while (true)
     {
+        std::size_t reported = loggedError.reported;
+        ret->children.push_back(blockItem(begin));
+        if (loggedError.reported != reported && !atConstructEnd())
+            synchronize(blockSync);
+
         auto next = peekNextToken();
         if (next->type == TokenType::R_CUR || next->type == TokenType::END)
             break;
-        
-        // Check if we're making progress
-        if (currentToken == prevToken)
-        {
-            noProgressCount++;
-            if (noProgressCount > 3)
-            {
-                // Parser is stuck - advance anyway to prevent infinite loop
-                loggedError.addError(next->lineNo, "Parser recovery: skipping token to prevent infinite loop");
-                getNextToken();
-                break;
-            }
-        }
-        else
-        {
-            noProgressCount = 0;
-            prevToken = currentToken;
-        }
-        
         begin = getNextToken();
-        ret->children.push_back(blockItem(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::blockItem(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::blockItem(TokenStore::iterator begin)
 {
     Node stmt(TokenType::BLOCK_ITEM);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
-    if (storageClassSpecifier(begin) || typeSpecifier(begin) || typeQualifier(begin) || 
-        functionSpecifier(begin) || isAlignmentSpecifier(begin) || begin->type == TokenType::STATIC_ASSERT ||
-        (!begin->lexeme.empty() && isTypeName(begin->lexeme)))
+    if (startsWith(TokenType::DECLARATION, begin))
     {
         ret->children.push_back(declaration(begin));
     }
@@ -1610,52 +1801,55 @@ std::shared_ptr<Node> AST::blockItem(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::expressionStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::expressionStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::EXPRESSION_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::SEMI_COLON)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     }
     else
     {
         ret->children.push_back(expression(begin));
         begin = getNextToken();
         if (begin->type == TokenType::SEMI_COLON)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         else
+        {
             loggedError.addError(begin->lineNo, "Expected ';' after expression");
+            ungetToken(); // it may start the next statement or close the block
+        }
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::selectionStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::selectionStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::SELECTION_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::IF)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(expression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(statement(begin));
 
                 if (peekNextToken()->type == TokenType::ELSE)
                 {
                     begin = getNextToken();
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
                     begin = getNextToken();
                     ret->children.push_back(statement(begin));
                 }
@@ -1664,17 +1858,17 @@ std::shared_ptr<Node> AST::selectionStatement(std::list<Token>::iterator begin)
     }
     else if (begin->type == TokenType::SWITCH)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(expression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(statement(begin));
             }
@@ -1683,24 +1877,24 @@ std::shared_ptr<Node> AST::selectionStatement(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::iterationStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::iterationStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ITERATION_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::WHILE)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(expression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(statement(begin));
             }
@@ -1708,41 +1902,41 @@ std::shared_ptr<Node> AST::iterationStatement(std::list<Token>::iterator begin)
     }
     else if (begin->type == TokenType::DO)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(statement(begin));
         begin = getNextToken();
         if (begin->type == TokenType::WHILE)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             if (begin->type == TokenType::L_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(expression(begin));
                 begin = getNextToken();
                 if (begin->type == TokenType::R_BR)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
                     begin = getNextToken();
                     if (begin->type == TokenType::SEMI_COLON)
-                        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                        ret->children.push_back(leaf(begin));
                 }
             }
         }
     }
     else if (begin->type == TokenType::FOR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
 
             // First part: declaration or expression-statement
-            if (storageClassSpecifier(begin) || typeSpecifier(begin) || typeQualifier(begin))
+            if (startsWith(TokenType::DECLARATION, begin))
             {
                 ret->children.push_back(declaration(begin));
             }
@@ -1768,7 +1962,7 @@ std::shared_ptr<Node> AST::iterationStatement(std::list<Token>::iterator begin)
 
             if (begin->type == TokenType::R_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(statement(begin));
             }
@@ -1777,34 +1971,34 @@ std::shared_ptr<Node> AST::iterationStatement(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::jumpStatement(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::jumpStatement(TokenStore::iterator begin)
 {
     Node stmt(TokenType::JUMP_STATEMENT);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::GOTO)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::ID)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             if (begin->type == TokenType::SEMI_COLON)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
     }
     else if (begin->type == TokenType::CONT || begin->type == TokenType::BRK)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         if (begin->type == TokenType::SEMI_COLON)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
     }
     else if (begin->type == TokenType::RETURN)
     {
         int returnLineNo = begin->lineNo;  // Save line number of return statement (this is the correct line)
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = peekNextToken();
         
         if (begin->type != TokenType::SEMI_COLON)
@@ -1821,7 +2015,7 @@ std::shared_ptr<Node> AST::jumpStatement(std::list<Token>::iterator begin)
         if (begin->type == TokenType::SEMI_COLON)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
         else
         {
@@ -1834,15 +2028,15 @@ std::shared_ptr<Node> AST::jumpStatement(std::list<Token>::iterator begin)
 }
 
 // Expression parsing functions
-std::shared_ptr<Node> AST::primaryExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::primaryExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::PRIMARY_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::ID || begin->type == TokenType::CONSTANT || 
         begin->type == TokenType::STRING_LITERAL || begin->type == TokenType::FUNC_NAME)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
     }
     else if (begin->type == TokenType::GENERIC)
     {
@@ -1850,127 +2044,180 @@ std::shared_ptr<Node> AST::primaryExpression(std::list<Token>::iterator begin)
     }
     else if (begin->type == TokenType::L_BR)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(expression(begin));
         begin = getNextToken();
         if (begin->type == TokenType::R_BR)
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         else
             loggedError.addGrammarError(begin->lineNo, "Expected ')' in primary expression");
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::postfixExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::postfixExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::POSTFIX_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(primaryExpression(begin));
+    postfixOperators(ret);
+    return ret;
+}
 
+void AST::postfixOperators(std::shared_ptr<Node> &ret)
+{
+    TokenStore::iterator begin;
     while (true)
     {
         auto next = peekNextToken();
         if (next->type == TokenType::L_SQR)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(expression(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_SQR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else if (next->type == TokenType::L_BR)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
             {
                 ret->children.push_back(argumentExpressionList(begin));
                 begin = getNextToken();
                 if (begin->type == TokenType::R_BR)
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
             }
         }
         else if (next->type == TokenType::DOT || next->type == TokenType::ARRORW)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             if (begin->type == TokenType::ID)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
         }
         else if (next->type == TokenType::INC || next->type == TokenType::DEC)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
         }
         else
             break;
     }
+}
+
+// '(' type_name ')' has already been parsed by the caller; currentToken is the ')'
+// and the next token is the '{' of the initializer list.
+std::shared_ptr<Node> AST::compoundLiteral(std::shared_ptr<Node> open, std::shared_ptr<Node> type, std::shared_ptr<Node> close)
+{
+    Node stmt(TokenType::POSTFIX_EXPRESSION);
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
+    ret->children.push_back(open);
+    ret->children.push_back(type);
+    ret->children.push_back(close);
+
+    auto begin = getNextToken();
+    ret->children.push_back(leaf(begin));
+    begin = getNextToken();
+    ret->children.push_back(initializerList(begin));
+    begin = getNextToken();
+    if (begin->type == TokenType::COMMA)
+    {
+        ret->children.push_back(leaf(begin));
+        begin = getNextToken();
+    }
+    if (begin->type == TokenType::R_CUR)
+        ret->children.push_back(leaf(begin));
+    else
+    {
+        loggedError.addGrammarError(begin->lineNo, "Expected '}' in compound literal");
+        ungetToken();
+    }
+    postfixOperators(ret);
     return ret;
 }
 
-std::shared_ptr<Node> AST::argumentExpressionList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::argumentExpressionList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ARGUMENT_EXPRESSION_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(assignmentExpression(begin));
 
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(assignmentExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::unaryExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::unaryExpression(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::UNARY_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     if (begin->type == TokenType::INC || begin->type == TokenType::DEC)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(unaryExpression(begin));
     }
     else if (begin->type == TokenType::SIZEOF || begin->type == TokenType::ALIGNOF)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        bool isAlignof = begin->type == TokenType::ALIGNOF;
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
-        if (begin->type == TokenType::L_BR)
+        // sizeof ( type_name ) and sizeof ( expression ) are told apart by the token
+        // after '(' alone; the parenthesized expression is left to unaryExpression.
+        if (begin->type == TokenType::L_BR && startsTypeName(peekNextToken()))
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            auto open = leaf(begin);
             begin = getNextToken();
-            ret->children.push_back(typeName(begin));
+            auto type = typeName(begin);
             begin = getNextToken();
-            if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
-            else
+            if (begin->type != TokenType::R_BR)
+            {
                 loggedError.addGrammarError(begin->lineNo, "Expected ')' after type name");
-        }
-        else
-        {
-            // sizeof can have unary expression, but alignof requires parentheses
-            if (begin->type == TokenType::ALIGNOF)
-                loggedError.addGrammarError(begin->lineNo, "_Alignof requires parentheses");
+                ungetToken();
+                ret->children.push_back(open);
+                ret->children.push_back(type);
+            }
+            else if (!isAlignof && peekNextToken()->type == TokenType::L_CUR)
+            {
+                // sizeof (T){...} applies to a compound literal, which is a unary expression
+                Node unary(TokenType::UNARY_EXPRESSION);
+                std::shared_ptr<Node> operand = makeNode(std::move(unary));
+                operand->children.push_back(compoundLiteral(open, type, leaf(begin)));
+                ret->children.push_back(operand);
+            }
             else
-                ret->children.push_back(unaryExpression(begin));
+            {
+                ret->children.push_back(open);
+                ret->children.push_back(type);
+                ret->children.push_back(leaf(begin));
+            }
         }
+        else if (isAlignof)
+            loggedError.addGrammarError(begin->lineNo, "_Alignof requires parentheses");
+        else
+            ret->children.push_back(unaryExpression(begin));
     }
     else if (begin->type == TokenType::REFERENCE || begin->type == TokenType::MUL ||
              begin->type == TokenType::PLUS || begin->type == TokenType::MINUS ||
              begin->type == TokenType::TILDE || begin->type == TokenType::NOT)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(castExpression(begin));
     }
@@ -1981,43 +2228,55 @@ std::shared_ptr<Node> AST::unaryExpression(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::castExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::castExpression(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::CAST_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
-    // Check if this is a cast: '(' type-name ')'
-    if (begin->type == TokenType::L_BR)
+    // '(' starts a cast or a compound literal only when the next token begins a
+    // type name (keyword or typedef name); otherwise it is a parenthesized
+    // expression and unaryExpression takes it from here. Nothing is consumed
+    // speculatively, so there is never anything to rewind.
+    if (begin->type == TokenType::L_BR && startsTypeName(peekNextToken()))
     {
-        auto saved = currentToken;
+        auto open = leaf(begin);
         begin = getNextToken();
-        if (typeSpecifier(begin) || typeQualifier(begin))
+        auto type = typeName(begin);
+        begin = getNextToken();
+        if (begin->type != TokenType::R_BR)
         {
-            currentToken = std::prev(currentToken);
-            begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
-            begin = getNextToken();
-            ret->children.push_back(typeName(begin));
-            begin = getNextToken();
-            if (begin->type == TokenType::R_BR)
-            {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
-                begin = getNextToken();
-                ret->children.push_back(castExpression(begin));
-                return ret;
-            }
+            loggedError.addGrammarError(begin->lineNo, "Expected ')' after type name in cast");
+            ungetToken();
+            ret->children.push_back(open);
+            ret->children.push_back(type);
+            return ret;
         }
-        currentToken = saved;
-        begin = currentToken;
+        auto close = leaf(begin);
+        if (peekNextToken()->type == TokenType::L_CUR)
+        {
+            // (T){...} is a compound literal: cast_expression -> unary -> postfix
+            Node unary(TokenType::UNARY_EXPRESSION);
+            std::shared_ptr<Node> operand = makeNode(std::move(unary));
+            operand->children.push_back(compoundLiteral(open, type, close));
+            ret->children.push_back(operand);
+            return ret;
+        }
+        ret->children.push_back(open);
+        ret->children.push_back(type);
+        ret->children.push_back(close);
+        begin = getNextToken();
+        ret->children.push_back(castExpression(begin));
+        return ret;
     }
     ret->children.push_back(unaryExpression(begin));
     return ret;
 }
 
-std::shared_ptr<Node> AST::multiplicativeExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::multiplicativeExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::MULTIPLICATIVE_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(castExpression(begin));
 
     while (true)
@@ -2026,7 +2285,7 @@ std::shared_ptr<Node> AST::multiplicativeExpression(std::list<Token>::iterator b
         if (next->type == TokenType::MUL || next->type == TokenType::DIV || next->type == TokenType::MOD)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(castExpression(begin));
         }
@@ -2036,10 +2295,10 @@ std::shared_ptr<Node> AST::multiplicativeExpression(std::list<Token>::iterator b
     return ret;
 }
 
-std::shared_ptr<Node> AST::additiveExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::additiveExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ADDITIVE_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(multiplicativeExpression(begin));
 
     while (true)
@@ -2048,7 +2307,7 @@ std::shared_ptr<Node> AST::additiveExpression(std::list<Token>::iterator begin)
         if (next->type == TokenType::PLUS || next->type == TokenType::MINUS)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(multiplicativeExpression(begin));
         }
@@ -2058,10 +2317,10 @@ std::shared_ptr<Node> AST::additiveExpression(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::shiftExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::shiftExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::SHIFT_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(additiveExpression(begin));
 
     while (true)
@@ -2070,7 +2329,7 @@ std::shared_ptr<Node> AST::shiftExpression(std::list<Token>::iterator begin)
         if (next->type == TokenType::LEF_SHIFT || next->type == TokenType::RIGHT_SHIFT)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(additiveExpression(begin));
         }
@@ -2080,10 +2339,10 @@ std::shared_ptr<Node> AST::shiftExpression(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::relationalExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::relationalExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::RELATIONAL_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(shiftExpression(begin));
 
     while (true)
@@ -2093,7 +2352,7 @@ std::shared_ptr<Node> AST::relationalExpression(std::list<Token>::iterator begin
             next->type == TokenType::LTE || next->type == TokenType::GTE)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(shiftExpression(begin));
         }
@@ -2103,10 +2362,10 @@ std::shared_ptr<Node> AST::relationalExpression(std::list<Token>::iterator begin
     return ret;
 }
 
-std::shared_ptr<Node> AST::equalityExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::equalityExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::EQUALITY_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(relationalExpression(begin));
 
     while (true)
@@ -2115,7 +2374,7 @@ std::shared_ptr<Node> AST::equalityExpression(std::list<Token>::iterator begin)
         if (next->type == TokenType::EQ || next->type == TokenType::UNEQUAL)
         {
             begin = getNextToken();
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(relationalExpression(begin));
         }
@@ -2125,102 +2384,103 @@ std::shared_ptr<Node> AST::equalityExpression(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::andExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::andExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::AND_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(equalityExpression(begin));
 
     while (peekNextToken()->type == TokenType::REFERENCE)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(equalityExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::exclusiveOrExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::exclusiveOrExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::EXCLUSIVE_OR_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(andExpression(begin));
 
     while (peekNextToken()->type == TokenType::CARET)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(andExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::inclusiveOrExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::inclusiveOrExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::INCLUSIVE_OR_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(exclusiveOrExpression(begin));
 
     while (peekNextToken()->type == TokenType::PIPE)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(exclusiveOrExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::logicalAndExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::logicalAndExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::LOGICAL_AND_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(inclusiveOrExpression(begin));
 
     while (peekNextToken()->type == TokenType::AND)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(inclusiveOrExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::logicalOrExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::logicalOrExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::LOGICAL_OR_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(logicalAndExpression(begin));
 
     while (peekNextToken()->type == TokenType::OR)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(logicalAndExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::conditionalExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::conditionalExpression(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::CONDITIONAL_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(logicalOrExpression(begin));
 
     if (peekNextToken()->type == TokenType::QUESTION)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(expression(begin));
         begin = getNextToken();
         if (begin->type == TokenType::COLON)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(conditionalExpression(begin));
         }
@@ -2230,10 +2490,11 @@ std::shared_ptr<Node> AST::conditionalExpression(std::list<Token>::iterator begi
     return ret;
 }
 
-std::shared_ptr<Node> AST::assignmentExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::assignmentExpression(TokenStore::iterator begin)
 {
+    Nesting level(*this);
     Node stmt(TokenType::ASSIGNMENT_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
 
     // Try to parse as conditional expression first
     ret->children.push_back(conditionalExpression(begin));
@@ -2243,41 +2504,41 @@ std::shared_ptr<Node> AST::assignmentExpression(std::list<Token>::iterator begin
     if (assignOperator(next))
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(assignmentExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::expression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::expression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(assignmentExpression(begin));
 
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(assignmentExpression(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::constantExpression(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::constantExpression(TokenStore::iterator begin)
 {
     Node stmt(TokenType::CONSTANT_EXPRESSION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(conditionalExpression(begin));
     return ret;
 }
 
-std::shared_ptr<Node> AST::typeName(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::typeName(TokenStore::iterator begin)
 {
     Node stmt(TokenType::TYPE_NAME);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     ret->children.push_back(specifierQualifierList(begin));
 
     auto next = peekNextToken();
@@ -2290,33 +2551,33 @@ std::shared_ptr<Node> AST::typeName(std::list<Token>::iterator begin)
 }
 
 // C11 specific implementations
-std::shared_ptr<Node> AST::genericSelection(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::genericSelection(TokenStore::iterator begin)
 {
     Node stmt(TokenType::GENERIC_SELECTION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     if (begin->type == TokenType::GENERIC)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(assignmentExpression(begin));
             begin = getNextToken();
             
             if (begin->type == TokenType::COMMA)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 ret->children.push_back(genericAssocList(begin));
                 begin = getNextToken();
             }
             
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
                 loggedError.addGrammarError(begin->lineNo, "Expected ')' in generic selection");
         }
@@ -2326,31 +2587,31 @@ std::shared_ptr<Node> AST::genericSelection(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::genericAssocList(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::genericAssocList(TokenStore::iterator begin)
 {
     Node stmt(TokenType::GENERIC_ASSOC_LIST);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     ret->children.push_back(genericAssociation(begin));
     
     while (peekNextToken()->type == TokenType::COMMA)
     {
         begin = getNextToken();
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(genericAssociation(begin));
     }
     return ret;
 }
 
-std::shared_ptr<Node> AST::genericAssociation(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::genericAssociation(TokenStore::iterator begin)
 {
     Node stmt(TokenType::GENERIC_ASSOCIATION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     if (begin->type == TokenType::DEFAULT)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
     }
     else
@@ -2361,7 +2622,7 @@ std::shared_ptr<Node> AST::genericAssociation(std::list<Token>::iterator begin)
     
     if (begin->type == TokenType::COLON)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         ret->children.push_back(assignmentExpression(begin));
     }
@@ -2371,31 +2632,31 @@ std::shared_ptr<Node> AST::genericAssociation(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::staticAssertDeclaration(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::staticAssertDeclaration(TokenStore::iterator begin)
 {
     Node stmt(TokenType::STATIC_ASSERT_DECLARATION);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     if (begin->type == TokenType::STATIC_ASSERT)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(constantExpression(begin));
             begin = getNextToken();
             
             if (begin->type == TokenType::COMMA)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
                 
                 if (begin->type == TokenType::STRING_LITERAL)
                 {
-                    ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                    ret->children.push_back(leaf(begin));
                     begin = getNextToken();
                 }
                 else
@@ -2404,14 +2665,14 @@ std::shared_ptr<Node> AST::staticAssertDeclaration(std::list<Token>::iterator be
             
             if (begin->type == TokenType::R_BR)
             {
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
                 begin = getNextToken();
             }
             else
                 loggedError.addGrammarError(begin->lineNo, "Expected ')' in static assertion");
             
             if (begin->type == TokenType::SEMI_COLON)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
                 loggedError.addGrammarError(begin->lineNo, "Expected ';' after static assertion");
         }
@@ -2421,23 +2682,23 @@ std::shared_ptr<Node> AST::staticAssertDeclaration(std::list<Token>::iterator be
     return ret;
 }
 
-std::shared_ptr<Node> AST::alignmentSpecifier(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::alignmentSpecifier(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ALIGNMENT_SPECIFIER);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     if (begin->type == TokenType::ALIGNAS)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             
             // Try to parse as type-name first, if it fails, parse as constant expression
-            if (typeSpecifier(begin) || typeQualifier(begin))
+            if (startsTypeName(begin))
             {
                 ret->children.push_back(typeName(begin));
             }
@@ -2448,7 +2709,7 @@ std::shared_ptr<Node> AST::alignmentSpecifier(std::list<Token>::iterator begin)
             begin = getNextToken();
             
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
                 loggedError.addGrammarError(begin->lineNo, "Expected ')' in alignment specifier");
         }
@@ -2458,25 +2719,25 @@ std::shared_ptr<Node> AST::alignmentSpecifier(std::list<Token>::iterator begin)
     return ret;
 }
 
-std::shared_ptr<Node> AST::atomicTypeSpecifier(std::list<Token>::iterator begin)
+std::shared_ptr<Node> AST::atomicTypeSpecifier(TokenStore::iterator begin)
 {
     Node stmt(TokenType::ATOMIC_TYPE_SPECIFIER);
-    std::shared_ptr<Node> ret = std::make_shared<Node>(std::move(stmt));
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
     
     if (begin->type == TokenType::ATOMIC)
     {
-        ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+        ret->children.push_back(leaf(begin));
         begin = getNextToken();
         
         if (begin->type == TokenType::L_BR)
         {
-            ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+            ret->children.push_back(leaf(begin));
             begin = getNextToken();
             ret->children.push_back(typeName(begin));
             begin = getNextToken();
             
             if (begin->type == TokenType::R_BR)
-                ret->children.push_back(std::make_shared<Node>(std::move(*begin)));
+                ret->children.push_back(leaf(begin));
             else
                 loggedError.addGrammarError(begin->lineNo, "Expected ')' in atomic type specifier");
         }
@@ -2489,55 +2750,35 @@ std::shared_ptr<Node> AST::atomicTypeSpecifier(std::list<Token>::iterator begin)
     return ret;
 }
 
-void AST::printBranches(const std::vector<bool> &isLast, std::ostream &os)
+void AST::printAST(std::ostream &os)
 {
-    for (size_t i = 0; i < isLast.size() - 1; ++i)
-    {
-        if (!isLast[i])
-        {
-            os << "│   ";
-        }
-        else
-        {
-            os << "    ";
-        }
-    }
+    DumpWriter out(os);
+    printAST(out);
 }
 
-void AST::traverseTree(std::shared_ptr<Node> node, std::vector<bool> &isLast, std::ostream &os)
+void AST::printAST(DumpWriter &out)
 {
-    if (!node)
-        return;
-
-    // Print branches for current level
-    if (!isLast.empty())
-    {
-        printBranches(isLast, os);
-        if (isLast.back())
-        {
-            os << "└── ";
-        }
-        else
-        {
-            os << "├── ";
-        }
-    }
-    os << "Token: " << t(node->t.type) << " ";
-    os << "lexeme: " << node->t.lexeme << std::endl;
-
-    // Process children
-    for (size_t i = 0; i < node->children.size(); ++i)
-    {
-        isLast.push_back(i == node->children.size() - 1);
-        traverseTree(node->children[i], isLast, os);
-        isLast.pop_back();
-    }
-}
-void AST::printAST(std::ostream &os)
-{
-
     if (!root)
         return;
-    std::vector<bool> isLast;
-    traverseTree(root, isLast, os);
+    // the branches in front of the children of the node being printed; each
+    // node extends it for its children and cuts it back when it is left
+    std::string prefix;
+    std::vector<std::size_t> lengths;
+    auto enter = [&](const Node &node, std::size_t depth, bool last)
+    {
+        if (depth > 0)
+            out << prefix << (last ? "└── " : "├── ");
+        out << "Token: " << TokenToString::name(node.type) << " ";
+        out << "lexeme: " << lexeme(node) << '\n';
+        lengths.push_back(prefix.size());
+        if (depth > 0)
+            prefix += last ? "    " : "│   ";
+        return true;
+    };
+    auto leave = [&](const Node &)
+    {
+        prefix.resize(lengths.back());
+        lengths.pop_back();
+    };
+    walkTree(static_cast<const Node &>(*root), enter, leave);
 }
@@ -3,263 +3,370 @@
 #include <memory>
 #include "Scanner.hpp"
 #include "Error.hpp"
+#include "Grammar.hpp"
+#include "ParserContext.hpp"
 #include <queue>
 #include <array>
 #include <set>
+#include <unordered_map>
+
+// A terminal names its token by index into the TokenStore of the tree it
+// belongs to; a non-terminal has none, except UNPARSED_BODY, which names its '{'.
+struct Node;
+// the children of a node; in a tree parsed in a ParserContext the lists take
+// their memory from the context's arena, elsewhere from the heap
+using NodeList = std::pmr::vector<std::shared_ptr<Node>>;
 
 struct Node
 {
-    Token t;
-    std::vector<std::shared_ptr<Node>> children;
-    // Node(Token &&t){s}
-    Node(Token t) : t(t) {};
-    Node(TokenType type) : t(type, "") {};
+    static constexpr uint32_t NO_TOKEN = TokenStore::npos;
+    TokenType type = TokenType::END;
+    uint32_t token = NO_TOKEN;
+    NodeList children;
+    Node(TokenType type, uint32_t token = NO_TOKEN, std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : type(type), token(token), children(memory) {};
     Node() = default;
+    Node(const Node &) = default;
+    Node(Node &&) = default;
+    Node &operator=(const Node &) = default;
+    Node &operator=(Node &&) = default;
+    // frees the nodes that die with this one without recursing, however deep
+    // the tree
+    ~Node();
+};
+
+// The recursive-descent parser is the default; LALR drives the tables that
+// table.cpp generates from grammar.y (see LALR.cpp).
+enum class ParserEngine
+{
+    RecursiveDescent,
+    LALR
+};
+
+struct ParseOptions
+{
+    ParserEngine engine = ParserEngine::RecursiveDescent;
+    // more than one parses the top-level declarations on a thread pool (see
+    // Parallel.cpp); a parse with a budget is always sequential
+    unsigned threads = 1;
+    // skip function bodies, leaving an UNPARSED_BODY node until AST::expandBody
+    // parses it; a lazy parse is always sequential
+    bool lazyBodies = false;
+    ParseBudget budget;
+};
+
+// tokens [begin, end) of the symbol table
+struct TokenRange
+{
+    TokenStore::iterator begin;
+    TokenStore::iterator end;
+};
+
+// tokens [first, last] of the store
+struct SourceRange
+{
+    uint32_t first = Node::NO_TOKEN;
+    uint32_t last = Node::NO_TOKEN;
 };
+
+// receives the parse as events instead of a tree; see ParseEvents.hpp
+class ParseListener;
+
+// typedef name -> index of the top-level declaration that declared it first
+using TypeNameIndex = std::unordered_map<std::string, std::size_t>;
 class AST : public Scanner
 {
 
 protected:
     std::shared_ptr<Node> root;
     std::set<std::string> definedTypeNames;
-    inline bool isTypeName(const std::string &name) { return definedTypeNames.count(name) > 0; }
+    // the names of definedTypeNames in the order they were declared, so that a
+    // lazy body can see only those declared before it
+    std::vector<std::string> typeNameOrder;
+    inline void defineTypeName(const std::string &name)
+    {
+        if (definedTypeNames.insert(name).second)
+            typeNameOrder.push_back(name);
+    }
+    // when this AST parses one top-level declaration of a larger file, the
+    // typedef names of the declarations before it
+    const TypeNameIndex *outerTypeNames = nullptr;
+    // the arena of the ParserContext the file is parsed in, if any
+    NodeArena *arena = nullptr;
+    // for the node and time budgets
+    uint32_t nodeCount = 0;
+    void countNode();
+    // one level of the recursive-descent functions that can nest without
+    // bound, counted against the depth budget for as long as it lives
+    uint32_t nesting = 0;
+    struct Nesting
+    {
+        AST &ast;
+        explicit Nesting(AST &ast) : ast(ast)
+        {
+            if (++ast.nesting > ast.budget.depth && ast.budget.depth)
+                ast.exceed(Budget::Depth, true);
+        }
+        ~Nesting() { ast.nesting--; }
+    };
+    inline std::shared_ptr<Node> makeNode(TokenType type, uint32_t token = Node::NO_TOKEN)
+    {
+        if (budgeted)
+            countNode();
+        if (arena)
+            return std::allocate_shared<Node>(ArenaAllocator<Node>(arena), type, token, arena);
+        return std::make_shared<Node>(type, token);
+    }
+    inline std::shared_ptr<Node> makeNode(Node &&node)
+    {
+        if (!arena)
+            return std::make_shared<Node>(std::move(node));
+        auto made = makeNode(node.type, node.token);
+        made->children.assign(std::make_move_iterator(node.children.begin()), std::make_move_iterator(node.children.end()));
+        return made;
+    }
+    std::size_t declarationIndex = 0;
+    inline bool isTypeName(const std::string &name)
+    {
+        if (definedTypeNames.count(name) > 0)
+            return true;
+        if (!outerTypeNames)
+            return false;
+        auto itr = outerTypeNames->find(name);
+        return itr != outerTypeNames->end() && itr->second < declarationIndex;
+    }
+    struct UnparsedBody
+    {
+        TokenRange tokens; // from '{' to the matching '}'
+        int16_t tableState = -1; // LALR state that was about to read it, -1 for recursive descent
+        std::size_t typeNames = 0; // how many of typeNameOrder were declared before it
+    };
+    bool lazyBodies = false;
+    std::unordered_map<const Node *, UnparsedBody> unparsedBodies;
+    std::shared_ptr<Node> skipBody(TokenStore::iterator begin);
+
+    // parses one top-level declaration, tokens [first, last) of the store of
+    // the whole file, so that its leaves index that store
+    AST(std::shared_ptr<TokenStore> tokens, uint32_t first, uint32_t last, Error &e, ParserEngine engine, const TypeNameIndex *outer, std::size_t index);
+    std::shared_ptr<Node> parse(std::shared_ptr<Node> root, ParserEngine engine);
+    // parses the whole file the Scanner reads, as options say
+    void parseFile(const ParseOptions &options);
     std::shared_ptr<Node> parsingFile(std::shared_ptr<Node> root);
+
+    // ParseEvents.cpp: with a listener, each top-level declaration is handed
+    // to it as events and dropped instead of joining the tree
+    ParseListener *listener = nullptr;
+    std::vector<SourceRange> replayRanges;
+    std::vector<std::size_t> replayOpen;
+    void deliver(const std::shared_ptr<Node> &node);
+    // what a delivered declaration held: its nodes and, unless the listener
+    // keeps them, the tokens before the current one
+    void releaseDelivered();
+
+    // LALR.cpp
+    struct TableEntry
+    {
+        int16_t state;
+        std::shared_ptr<Node> node;
+        std::size_t first; // position of the first token in the token stream
+    };
+    // #include lines the table engine read, with their positions
+    std::vector<std::pair<std::size_t, std::shared_ptr<Node>>> tableIncludes;
+    std::size_t placedIncludes = 0;
+    void placeIncludes(NodeList &children, std::size_t before);
+    // the same for a listener, which is handed them and forgets them
+    void deliverIncludes(std::size_t before);
+    void runTable(std::vector<TableEntry> &stack, bool stopAtBody);
+    std::shared_ptr<Node> parsingTable(std::shared_ptr<Node> root);
+    std::shared_ptr<Node> tableBody(TokenStore::iterator begin, int16_t state);
+    std::shared_ptr<Node> parsingParallel(std::shared_ptr<Node> root, const ParseOptions &options);
+    friend class IncrementalParser;
+    void declareTypedefNames(const std::shared_ptr<Node> &declaration);
     std::shared_ptr<Node> includeStmt();
+    inline std::shared_ptr<Node> leaf(TokenStore::iterator itr) { return makeNode(itr->type, itr.index()); }
+    // panic-mode recovery after an error: skips to just past the next ';' or
+    // to the next token of stopBefore, outside brackets (see AST.cpp)
+    void synchronize(const TokenSet &stopBefore);
+    // whether the last token read closes a declaration or statement
+    inline bool atConstructEnd()
+    {
+        return currentToken != tokenEnd() && (currentToken->type == TokenType::SEMI_COLON || currentToken->type == TokenType::R_CUR);
+    }
 
     // Translation unit and external declarations
     std::shared_ptr<Node> translationUnit();
     std::shared_ptr<Node> externalDeclaration();
-    std::shared_ptr<Node> functionDefinition(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> declarationList(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> functionDefinition(TokenStore::iterator begin);
+    std::shared_ptr<Node> declarationList(TokenStore::iterator begin);
 
     // Declarations
-    std::shared_ptr<Node> declaration(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> declarationSpecifier(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> initDeclaratorList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> initDeclarator(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> declaration(TokenStore::iterator begin);
+    std::shared_ptr<Node> declarationSpecifier(TokenStore::iterator begin);
+    std::shared_ptr<Node> initDeclaratorList(TokenStore::iterator begin);
+    std::shared_ptr<Node> initDeclarator(TokenStore::iterator begin);
 
     // Struct/Union/Enum
-    std::shared_ptr<Node> structUnionSpecifier(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> structDeclarationList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> structDeclaration(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> structDeclaratorList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> structDeclarator(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> enumSpecifier(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> enumerator(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> enumeratorList(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> structUnionSpecifier(TokenStore::iterator begin);
+    std::shared_ptr<Node> structDeclarationList(TokenStore::iterator begin);
+    std::shared_ptr<Node> structDeclaration(TokenStore::iterator begin);
+    std::shared_ptr<Node> structDeclaratorList(TokenStore::iterator begin);
+    std::shared_ptr<Node> structDeclarator(TokenStore::iterator begin);
+    std::shared_ptr<Node> enumSpecifier(TokenStore::iterator begin);
+    std::shared_ptr<Node> enumerator(TokenStore::iterator begin);
+    std::shared_ptr<Node> enumeratorList(TokenStore::iterator begin);
 
     // Declarators
-    std::shared_ptr<Node> declarator(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> directDeclarator(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> pointer(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> abstractDeclarator(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> directAbstractDeclarator(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> declarator(TokenStore::iterator begin);
+    std::shared_ptr<Node> directDeclarator(TokenStore::iterator begin);
+    std::shared_ptr<Node> pointer(TokenStore::iterator begin);
+    std::shared_ptr<Node> abstractDeclarator(TokenStore::iterator begin);
+    std::shared_ptr<Node> directAbstractDeclarator(TokenStore::iterator begin);
 
     // Parameters and type names
-    std::shared_ptr<Node> parameterTypeList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> parameterList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> parameterDeclaration(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> identifierList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> typeName(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> typeQualifierList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> specifierQualifierList(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> parameterTypeList(TokenStore::iterator begin);
+    std::shared_ptr<Node> parameterList(TokenStore::iterator begin);
+    std::shared_ptr<Node> parameterDeclaration(TokenStore::iterator begin);
+    std::shared_ptr<Node> identifierList(TokenStore::iterator begin);
+    std::shared_ptr<Node> typeName(TokenStore::iterator begin);
+    std::shared_ptr<Node> typeQualifierList(TokenStore::iterator begin);
+    std::shared_ptr<Node> specifierQualifierList(TokenStore::iterator begin);
 
     // Initializers
-    std::shared_ptr<Node> initializer(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> initializerList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> designation(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> designatorList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> designator(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> initializer(TokenStore::iterator begin);
+    std::shared_ptr<Node> initializerList(TokenStore::iterator begin);
+    std::shared_ptr<Node> designation(TokenStore::iterator begin);
+    std::shared_ptr<Node> designatorList(TokenStore::iterator begin);
+    std::shared_ptr<Node> designator(TokenStore::iterator begin);
 
     // C11 specific constructs
-    std::shared_ptr<Node> genericSelection(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> genericAssocList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> genericAssociation(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> staticAssertDeclaration(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> alignmentSpecifier(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> atomicTypeSpecifier(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> genericSelection(TokenStore::iterator begin);
+    std::shared_ptr<Node> genericAssocList(TokenStore::iterator begin);
+    std::shared_ptr<Node> genericAssociation(TokenStore::iterator begin);
+    std::shared_ptr<Node> staticAssertDeclaration(TokenStore::iterator begin);
+    std::shared_ptr<Node> alignmentSpecifier(TokenStore::iterator begin);
+    std::shared_ptr<Node> atomicTypeSpecifier(TokenStore::iterator begin);
     
     // Expressions
-    std::shared_ptr<Node> primaryExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> postfixExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> argumentExpressionList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> unaryExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> castExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> multiplicativeExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> additiveExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> shiftExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> relationalExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> equalityExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> andExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> exclusiveOrExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> inclusiveOrExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> logicalAndExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> logicalOrExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> conditionalExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> assignmentExpression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> expression(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> constantExpression(std::list<Token>::iterator begin);
+    std::shared_ptr<Node> primaryExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> postfixExpression(TokenStore::iterator begin);
+    void postfixOperators(std::shared_ptr<Node> &ret);
+    std::shared_ptr<Node> compoundLiteral(std::shared_ptr<Node> open, std::shared_ptr<Node> type, std::shared_ptr<Node> close);
+    std::shared_ptr<Node> argumentExpressionList(TokenStore::iterator begin);
+    std::shared_ptr<Node> unaryExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> castExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> multiplicativeExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> additiveExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> shiftExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> relationalExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> equalityExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> andExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> exclusiveOrExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> inclusiveOrExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> logicalAndExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> logicalOrExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> conditionalExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> assignmentExpression(TokenStore::iterator begin);
+    std::shared_ptr<Node> expression(TokenStore::iterator begin);
+    std::shared_ptr<Node> constantExpression(TokenStore::iterator begin);
 
     // Statements
-    std::shared_ptr<Node> statement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> labeledStatement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> compoundStatement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> blockItemList(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> blockItem(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> expressionStatement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> selectionStatement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> iterationStatement(std::list<Token>::iterator begin);
-    std::shared_ptr<Node> jumpStatement(std::list<Token>::iterator begin);
-    inline bool typeSpecifier(const std::list<Token>::iterator &itr)
+    std::shared_ptr<Node> statement(TokenStore::iterator begin);
+    std::shared_ptr<Node> labeledStatement(TokenStore::iterator begin);
+    std::shared_ptr<Node> compoundStatement(TokenStore::iterator begin);
+    std::shared_ptr<Node> blockItemList(TokenStore::iterator begin);
+    std::shared_ptr<Node> blockItem(TokenStore::iterator begin);
+    std::shared_ptr<Node> expressionStatement(TokenStore::iterator begin);
+    std::shared_ptr<Node> selectionStatement(TokenStore::iterator begin);
+    std::shared_ptr<Node> iterationStatement(TokenStore::iterator begin);
+    std::shared_ptr<Node> jumpStatement(TokenStore::iterator begin);
+    // true when the token can begin the given non-terminal of grammar.y; an ID
+    // counts as TYPEDEF_NAME only after a typedef has declared it
+    inline bool startsWith(TokenType nonterminal, const TokenStore::iterator &itr)
     {
-        TokenType type = itr->type;
-        switch (type)
-        {
-        case TokenType::INT_TYPE:
-            return true;
-        case TokenType::CHAR_TYPE:
-            return true;
-        case TokenType::DOULBLE_TYPE:
-            return true;
-        case TokenType::FLOAT_TYPE:
-            return true;
-        case TokenType::LONG_TYPE:
-            return true;
-        case TokenType::SHORT_TYPE:
-            return true;
-        case TokenType::VOID:
-            return true;
-        case TokenType::UNSINGED:
-            return true;
-        case TokenType::SIGNED:
-            return true;
-
-        case TokenType::STRUCT:
-            return true;
-        case TokenType::UNION:
-            return true;
-        case TokenType::ENUM:
-            return true;
-            
-        // C11 type specifiers
-        case TokenType::BOOL_TYPE:
-            return true;
-        case TokenType::COMPLEX:
-            return true;
-        case TokenType::IMAGINARY:
-            return true;
-        case TokenType::ATOMIC:
+        const TokenSet &first = firstSet(nonterminal);
+        if (first.contains(itr->type))
             return true;
+        return itr->type == TokenType::ID && first.contains(TokenType::TYPEDEF_NAME) && isTypeName(itr->lexeme);
+    }
+    inline bool typeSpecifier(const TokenStore::iterator &itr)
+    {
+        return startsWith(TokenType::TYPE_SPECIFIER, itr);
+    }
 
-        default:
-            if (!itr->lexeme.empty() && isTypeName(itr->lexeme))
-                return true;
-            return false;
-        }
+    // FIRST(type_name): a type specifier (including typedef names) or a qualifier.
+    inline bool startsTypeName(const TokenStore::iterator &itr)
+    {
+        return startsWith(TokenType::TYPE_NAME, itr);
     }
 
-    inline bool structUnion(const std::list<Token>::iterator &itr)
+    inline bool structUnion(const TokenStore::iterator &itr)
     {
-        return itr->type == TokenType::STRUCT || itr->type == TokenType::UNION;
+        return firstSet(TokenType::STRUCT_OR_UNION).contains(itr->type);
     }
-    inline bool typeQualifier(const std::list<Token>::iterator &itr)
+    inline bool typeQualifier(const TokenStore::iterator &itr)
     {
-        TokenType type = itr->type;
-        switch (type)
-        {
-        case TokenType::CONST:
-            return true;
-        case TokenType::VOLATILE:
-            return true;
-        case TokenType::RESTRICT:
-            return true;
-        case TokenType::ATOMIC:
-            return true;
-        default:
-            return false;
-        }
+        return firstSet(TokenType::TYPE_QUALIFIER).contains(itr->type);
     }
-    inline bool storageClassSpecifier(const std::list<Token>::iterator &itr)
+    inline bool storageClassSpecifier(const TokenStore::iterator &itr)
     {
-        TokenType type = itr->type;
-        switch (type)
-        {
-        case TokenType::TYPEDEF:
-            return true;
-        case TokenType::EXTERN:
-            return true;
-        case TokenType::AUTO:
-            return true;
-        case TokenType::STATIC:
-            return true;
-        case TokenType::REGISTER:
-            return true;
-        case TokenType::THREAD_LOCAL:
-            return true;
-        default:
-            return false;
-        }
+        return firstSet(TokenType::STORAGE_CLASS_SPECIFIER).contains(itr->type);
     }
-    
-    inline bool functionSpecifier(const std::list<Token>::iterator &itr)
+    inline bool functionSpecifier(const TokenStore::iterator &itr)
     {
-        TokenType type = itr->type;
-        switch (type)
-        {
-        case TokenType::INLINE:
-            return true;
-        case TokenType::NORETURN:
-            return true;
-        default:
-            return false;
-        }
+        return firstSet(TokenType::FUNCTION_SPECIFIER).contains(itr->type);
     }
-    
-    inline bool isAlignmentSpecifier(const std::list<Token>::iterator &itr)
+    inline bool isAlignmentSpecifier(const TokenStore::iterator &itr)
     {
-        return itr->type == TokenType::ALIGNAS;
+        return firstSet(TokenType::ALIGNMENT_SPECIFIER).contains(itr->type);
     }
-    inline bool assignOperator(const std::list<Token>::iterator &itr)
+    inline bool assignOperator(const TokenStore::iterator &itr)
     {
-        switch (itr->type)
-        {
-        case TokenType::ASSIGN:
-            return true;
-
-        case TokenType::MUL_ASSIGN:
-            return true;
-        case TokenType::DIV_ASSIGN:
-            return true;
-        case TokenType::MOD_ASSIGN:
-            return true;
-        case TokenType::ADD_ASSIGN:
-            return true;
-        case TokenType::SUB_ASSIGN:
-            return true;
-        case TokenType::LEFT_ASSIGN:
-            return true;
-        case TokenType::RIGHT_ASSIGN:
-            return true;
-        case TokenType::OR_ASSIGN:
-            return true;
-        case TokenType::AND_ASSIGN:
-            return true;
-        case TokenType::XOR_ASSIGN:
-            return true;
-        default:
-            return false;
-        }
+        return firstSet(TokenType::ASSIGNMENT_OPERATOR).contains(itr->type);
     }
     std::set<std::string> definedStruct;
     std::set<std::string> definedUnion;
 
-private:
-    void printBranches(const std::vector<bool> &isLast, std::ostream &os);
-    void traverseTree(std::shared_ptr<Node> node, std::vector<bool> &isLast, std::ostream &os);
-    TokenToString t;
-
 public:
-    AST(const std::string &path, Error &e);
+    AST(const std::string &path, Error &e, const ParseOptions &options = ParseOptions());
+    // parses source already in memory, named name, without touching the disk
+    // or checking the extension; text is not copied and must outlive the AST
+    AST(std::string_view text, const std::string &name, Error &e, const ParseOptions &options = ParseOptions());
+    // parses text, named name, with the nodes, tokens and Error of context;
+    // call context.reset() between files
+    AST(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options = ParseOptions());
+    // parses text as above but builds no tree: the parse goes to listener as
+    // events (see ParseEvents.hpp) and root stays an empty TRANSLATION_UNIT
+    AST(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options, ParseListener &listener);
+    // parses the tokens a Scanner lexed from the file name before, complete
+    // up to their END, with the nodes and Error of context; macros are those
+    // the lexing defined. The tokens are only read, so that many parses can
+    // share them.
+    AST(ParserContext &context, std::shared_ptr<TokenStore> tokens, const std::map<std::string, Macro> &macros, const std::string &name,
+        const ParseOptions &options);
+    void printAST(DumpWriter &out);
     void printAST(std::ostream &os);
+    inline const std::shared_ptr<Node> &getRoot() const { return root; }
+    // the tokens the leaves of the tree refer to
+    inline std::shared_ptr<const TokenStore> getTokens() const { return store; }
+    // the lexeme of a terminal, the path of the file for the root, or nothing
+    inline std::string_view lexeme(const Node &node) const
+    {
+        if (node.type == TokenType::TRANSLATION_UNIT)
+            return pathToFile;
+        if (node.token == Node::NO_TOKEN || isNonterminal(node.type))
+            return {};
+        return symbolTable[node.token].lexeme;
+    }
+    // Finds the end of the top-level declaration that starts at itr by bracket
+    // depth: a ';' at depth 0, or the '}' closing a function body (a '{' opened
+    // at depth 0 right after a ')'). An #include line is its own declaration.
+    // complete is false when END came first.
+    static TokenStore::iterator declarationEnd(TokenStore::iterator itr, bool &introducesTypedef, bool &complete);
+    // Parses the skipped body of a FUNCTION_DEFINITION from a lazy parse and
+    // puts the COMPOUND_STATEMENT in place of its UNPARSED_BODY; returns the
+    // body, or nullptr when the node has none. The body sees the typedef names
+    // declared before it, as in an eager parse, and its errors go to the Error
+    // the AST was built with.
+    std::shared_ptr<Node> expandBody(const std::shared_ptr<Node> &function);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "Batch.hpp"
+#include "DeclarationIndex.hpp"
+#include "JsonWriter.hpp"
+#include "ParseEvents.hpp"
+#include "Syntax.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <filesystem>
+#include <numeric>
+
+// the JSON and count formats from the cache, parsing the file and keeping
+// the result on a miss; false when the result could not be cached, and the
+// file is yet to be dumped
+static bool dumpCached(ParseCache &cache, ParserContext &context, std::string_view text, const std::string &path,
+                       const ParseOptions &options, DumpFormat format, DumpWriter &out)
+{
+    uint64_t key = ParseCache::key(text, options);
+    std::unique_ptr<TreeFile> tree = cache.find(key);
+    if (!tree)
+    {
+        AST parsed(context, text, path, options);
+        if (!cache.store(key, parsed, context.error()) || !(tree = cache.find(key)))
+            return false;
+    }
+    if (format == DumpFormat::Counts)
+    {
+        Error errors;
+        tree->loadErrors(errors);
+        errors.printError(out);
+        KindCounter counter;
+        for (uint32_t i = 0; i < tree->nodeCount(); i++)
+            counter.add(tree->kind(i));
+        counter.print(out);
+        return true;
+    }
+    JsonOptions json;
+    json.compact = format == DumpFormat::CompactJson;
+    writeJsonDocument(*tree, path, json, out);
+    return true;
+}
+
+// a parsed tree in one of the formats that need nothing but the tree
+static void dumpTree(AST &tree, Error &error, DumpFormat format, DumpWriter &out)
+{
+    if (format == DumpFormat::Declarations)
+    {
+        error.printError(out);
+        DeclarationIndex(SyntaxTree(*tree.getRoot(), tree.getTokens()), &tree).print(out);
+        return;
+    }
+    JsonOptions json;
+    json.compact = format == DumpFormat::CompactJson;
+    writeJsonDocument(tree, error, json, out);
+}
+
+void dumpFile(ParserContext &context, const std::string &path, const ParseOptions &options, DumpFormat format, DumpWriter &out,
+              ParseCache *cache, TokenCache *tokens)
+{
+    context.reset();
+    // the parse cache goes first for the formats it keeps whole; the others
+    // list the tokens as they are lexed, or parse to events that let go of
+    // them, so they cannot share them
+    bool json = format == DumpFormat::Json || format == DumpFormat::CompactJson;
+    std::shared_ptr<const TokenCache::Lexed> lexed;
+    if (tokens && (format == DumpFormat::Declarations || (json && !cache)) && TokenCache::replayable(options) &&
+        (lexed = tokens->lex(path)))
+    {
+        context.error() = lexed->errors;
+        AST tree(context, lexed->tokens, lexed->macros, path, options);
+        // the LALR engine stops at the first error, where lexing as it parses
+        // would not have seen the macros defined further on
+        bool stopped = options.engine == ParserEngine::LALR && !context.error().grammarErrors.empty();
+        if (format != DumpFormat::Declarations || !stopped)
+        {
+            dumpTree(tree, context.error(), format, out);
+            return;
+        }
+        context.reset();
+    }
+    std::string_view text = context.load(path);
+    dumpText(context, text, path, options, format, out, cache);
+}
+
+void dumpText(ParserContext &context, std::string_view text, const std::string &path, const ParseOptions &options, DumpFormat format,
+              DumpWriter &out, ParseCache *cache)
+{
+    Error &error = context.error();
+    // a file that cannot be read has nothing worth keeping
+    bool cached = format == DumpFormat::Json || format == DumpFormat::CompactJson || format == DumpFormat::Counts;
+    if (cache && cached && !error.hasErrors() && ParseCache::cacheable(options))
+    {
+        if (dumpCached(*cache, context, text, path, options, format, out))
+            return;
+        // the text is not the context's to drop
+        context.reset();
+    }
+    bool json = format == DumpFormat::Json || format == DumpFormat::CompactJson;
+    if (json && options.threads <= 1)
+    {
+        // written as it is parsed, rather than from a tree of the whole file
+        JsonOptions written;
+        written.compact = format == DumpFormat::CompactJson;
+        writeJsonDocument(context, text, path, options, written, out);
+        return;
+    }
+    if (json || format == DumpFormat::Declarations)
+    {
+        AST tree(context, text, path, options);
+        dumpTree(tree, error, format, out);
+        return;
+    }
+    if (format == DumpFormat::Counts)
+    {
+        KindCounter counter;
+        parseEvents(context, text, path, options, counter);
+        error.printError(out);
+        counter.print(out);
+        return;
+    }
+    // the listing has its own sink, so that a budget it runs out of does not
+    // close the one the parse reports to; the parse finds the same lexical
+    // errors again
+    Error listed;
+    Scanner scanner(text, path, listed, context.store());
+    scanner.setBudget(options.budget);
+    auto itr = scanner.getNextToken();
+    out << TokenToString::name(itr->type) << '\n';
+    int thisline = scanner.getlineNo();
+
+    for (auto itr = scanner.getNextToken(); itr->type != TokenType::END; itr = scanner.getNextToken())
+    {
+        if (thisline != scanner.getlineNo())
+        {
+            if (thisline != 1)
+                out << "line NO: " << thisline << '\n';
+            thisline = scanner.getlineNo();
+        }
+        out << "Type: " << TokenToString::name(itr->type) << " Lexeme: " << itr->lexeme << '\n';
+    }
+    AST tree(context, text, path, options);
+    error.printError(out);
+    scanner.printMacro(out);
+    if (format == DumpFormat::Syntax)
+        SyntaxTree(*tree.getRoot(), tree.getTokens()).print(out);
+    else
+        tree.printAST(out);
+}
+
+// the leading digits of text, as atoi reads them
+static int number(std::string_view text)
+{
+    int value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+bool readDumpOption(const std::vector<std::string_view> &args, std::size_t &i, ParseOptions &options, DumpFormat &format)
+{
+    std::string_view arg = args[i];
+    bool valued = i + 1 < args.size();
+    if (arg == "--lalr")
+        options.engine = ParserEngine::LALR;
+    else if (arg == "--lazy")
+        options.lazyBodies = true;
+    else if (arg == "--syntax")
+        format = DumpFormat::Syntax;
+    else if (arg == "--json")
+        format = DumpFormat::Json;
+    else if (arg == "--json-compact")
+        format = DumpFormat::CompactJson;
+    else if (arg == "--count")
+        format = DumpFormat::Counts;
+    else if (arg == "--declarations")
+        format = DumpFormat::Declarations;
+    else if (arg == "--max-tokens" && valued)
+        options.budget.tokens = number(args[++i]);
+    else if (arg == "--max-depth" && valued)
+        options.budget.depth = number(args[++i]);
+    else if (arg == "--max-nodes" && valued)
+        options.budget.nodes = number(args[++i]);
+    else if (arg == "--max-macro-tokens" && valued)
+        options.budget.macroTokens = number(args[++i]);
+    else if (arg == "--time-limit" && valued)
+        options.budget.time = std::chrono::milliseconds(number(args[++i]));
+    else
+        return false;
+    return true;
+}
+
+bool readResponseFile(const std::string &path, std::vector<std::string> &paths)
+{
+    std::ifstream list(path);
+    if (!list)
+        return false;
+    for (std::string line; std::getline(list, line);)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (!line.empty())
+            paths.push_back(line);
+    }
+    return true;
+}
+
+void runBatch(const std::vector<std::string> &paths, const BatchOptions &options, DumpWriter &out)
+{
+    // largest first; a file that cannot be sized counts as empty
+    std::vector<std::uintmax_t> sizes(paths.size());
+    for (std::size_t i = 0; i < paths.size(); i++)
+    {
+        std::error_code failed;
+        sizes[i] = std::filesystem::file_size(paths[i], failed);
+        if (failed)
+            sizes[i] = 0;
+    }
+    std::vector<std::size_t> order(paths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                     { return sizes[a] > sizes[b]; });
+
+    ParseOptions parse = options.parse;
+    parse.threads = 1;
+
+    std::vector<std::string> dumps(paths.size());
+    std::vector<char> done(paths.size(), false);
+    std::mutex lock;
+    std::condition_variable finished;
+    std::atomic<std::size_t> claimed = 0;
+
+    ThreadPool pool(options.threads);
+    // every worker keeps taking the largest file no one has claimed yet, so a
+    // worker that is free always gets the next-largest file; the parser
+    // context and the writer's buffer are the worker's own and are reused from
+    // file to file
+    for (std::size_t worker = 0; worker < pool.size(); worker++)
+        pool.submit([&]()
+                    {
+            ParserContext context;
+            std::string dump;
+            DumpWriter writer(dump, 1 << 16);
+            for (std::size_t next; (next = claimed++) < order.size();)
+            {
+                std::size_t file = order[next];
+                const std::string &path = paths[file];
+                // a JSON document names its file
+                if (options.format != DumpFormat::Json && options.format != DumpFormat::CompactJson)
+                    writer << "File: " << path << '\n';
+                dumpFile(context, path, parse, options.format, writer, options.cache, options.tokens);
+                writer.flush();
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    dumps[file] = std::move(dump);
+                    done[file] = true;
+                }
+                dump.clear();
+                finished.notify_one();
+            } });
+
+    for (std::size_t i = 0; i < paths.size(); i++)
+    {
+        std::string dump;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            finished.wait(guard, [&]
+                          { return done[i]; });
+            dump = std::move(dumps[i]);
+        }
+        out << dump;
+    }
+    pool.wait();
+}
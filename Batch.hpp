@@ -0,0 +1,65 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+#include "AST.hpp"
+#include "DumpWriter.hpp"
+#include "ParseCache.hpp"
+#include "TokenCache.hpp"
+
+// Dumping many files in one process. The files are parsed on a ThreadPool,
+// largest first so that a big file does not start last and hold up the end of
+// the run; each worker parses its files in a ParserContext of its own, and
+// nothing is shared between the workers but the list of files. The dumps are
+// written in the order the files were given, each as soon as it and every
+// file before it are done, whatever order they finish in.
+// what is printed for each file
+enum class DumpFormat
+{
+    Tree,       // the tokens, errors, macros and parse tree, as text
+    Syntax,     // the same with the lowered abstract syntax tree
+    Json,       // a line of JSON with the errors and the parse tree
+    CompactJson, // the same without punctuation and wrapper nodes
+    Counts,      // the errors and the number of nodes of each kind, from a
+                 // parse that builds no tree
+    Declarations // the errors and every name the file declares
+};
+
+struct BatchOptions
+{
+    // how each file is parsed; threads is ignored, every file is parsed on a
+    // single worker
+    ParseOptions parse;
+    DumpFormat format = DumpFormat::Tree;
+    // files parsed at once, 0: one per core
+    unsigned threads = 0;
+    // where the JSON and count formats read and keep parse results, if
+    // anywhere; shared by the workers
+    ParseCache *cache = nullptr;
+    // where the JSON and declaration formats find files lexed before, if
+    // anywhere; shared by the workers
+    TokenCache *tokens = nullptr;
+};
+
+// one file as main prints it in format; the file is parsed in context, which
+// is reset first, unless cache has the result of parsing it already, and from
+// the tokens in tokens when it has them
+void dumpFile(ParserContext &context, const std::string &path, const ParseOptions &options, DumpFormat format, DumpWriter &out,
+              ParseCache *cache = nullptr, TokenCache *tokens = nullptr);
+
+// text as dumpFile prints the file at path, for text that comes from
+// elsewhere; context has been reset and holds only the errors of reading text
+void dumpText(ParserContext &context, std::string_view text, const std::string &path, const ParseOptions &options, DumpFormat format,
+              DumpWriter &out, ParseCache *cache = nullptr);
+
+// reads the command line option at args[i] that sets how files are parsed or
+// what is printed for them, moving i past its value if it takes one; false,
+// leaving both alone, when args[i] is not one of them
+bool readDumpOption(const std::vector<std::string_view> &args, std::size_t &i, ParseOptions &options, DumpFormat &format);
+
+// appends the paths listed in a response file, one per line, skipping blank
+// lines; false when the file cannot be read
+bool readResponseFile(const std::string &path, std::vector<std::string> &paths);
+
+// dumps every file to out, each after a "File: <path>" line, or as JSON Lines
+// (one document per file) in the JSON formats
+void runBatch(const std::vector<std::string> &paths, const BatchOptions &options, DumpWriter &out);
+#endif
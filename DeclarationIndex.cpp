@@ -0,0 +1,173 @@
+#include "DeclarationIndex.hpp"
+#include "TreeWalk.hpp"
+
+std::string_view declarationKindName(DeclarationKind kind)
+{
+    static constexpr std::string_view names[] = {
+        "Function", "Variable", "Parameter", "Typedef", "Struct", "Union", "Enum", "Enumerator", "Field", "Macro"};
+    return names[static_cast<std::size_t>(kind)];
+}
+
+DeclarationIndex::DeclarationIndex(const SyntaxTree &tree, const Scanner *scanner)
+{
+    nameStart.push_back(0);
+    slots.assign(64, 0);
+    add(tree, *tree.getRoot(), NO_SCOPE);
+    if (scanner)
+        for (const auto &[macro, definition] : scanner->macros())
+            declarations.push_back({intern(macro), NO_SCOPE, Node::NO_TOKEN, definition.lineNo, DeclarationKind::Macro, true});
+    groupByName();
+}
+
+uint32_t DeclarationIndex::find(std::string_view name) const
+{
+    // linear probing; the table is never more than half full, so a free slot
+    // ends every search
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t at = std::hash<std::string_view>()(name) & mask;; at = (at + 1) & mask)
+    {
+        if (slots[at] == 0 || this->name(slots[at] - 1) == name)
+            return static_cast<uint32_t>(at);
+    }
+}
+
+uint32_t DeclarationIndex::intern(std::string_view name)
+{
+    uint32_t at = find(name);
+    if (slots[at])
+        return slots[at] - 1;
+    uint32_t n = static_cast<uint32_t>(nameStart.size() - 1);
+    names.append(name);
+    nameStart.push_back(static_cast<uint32_t>(names.size()));
+    slots[at] = n + 1;
+    if (2 * (n + 1) > slots.size())
+    {
+        std::vector<uint32_t> old(slots.size() * 2, 0);
+        old.swap(slots);
+        for (uint32_t slot : old)
+            if (slot)
+                slots[find(this->name(slot - 1))] = slot;
+    }
+    return n;
+}
+
+void DeclarationIndex::add(const SyntaxTree &tree, const SyntaxNode &root, uint32_t scope)
+{
+    const TokenStore &tokens = *tree.getTokens();
+    // the scope of the children of each node the walk is inside of
+    std::vector<uint32_t> scopes{scope};
+    // preorder, so that the declarations come out in source order
+    auto enter = [&](const SyntaxNode &node, std::size_t, bool)
+    {
+        // nothing is declared inside an expression
+        if (node.kind >= SyntaxKind::Identifier)
+            return false;
+        uint32_t in = scopes.back();
+        DeclarationKind kind = DeclarationKind::Variable;
+        bool declares = true;
+        bool definition = true;
+        bool opensScope = false;
+        switch (node.kind)
+        {
+        case SyntaxKind::FunctionDecl:
+            kind = DeclarationKind::Function;
+            definition = !node.children.empty() &&
+                         (node.children.back()->kind == SyntaxKind::CompoundStmt || node.children.back()->kind == SyntaxKind::UnparsedBody);
+            opensScope = true;
+            break;
+        case SyntaxKind::VarDecl:
+            kind = DeclarationKind::Variable;
+            definition = node.op != TokenType::EXTERN;
+            break;
+        case SyntaxKind::ParamDecl:
+            kind = DeclarationKind::Parameter;
+            break;
+        case SyntaxKind::TypedefDecl:
+            kind = DeclarationKind::Typedef;
+            break;
+        case SyntaxKind::RecordDecl:
+            kind = node.op == TokenType::UNION ? DeclarationKind::Union : DeclarationKind::Struct;
+            opensScope = true;
+            break;
+        case SyntaxKind::EnumDecl:
+            kind = DeclarationKind::Enum;
+            break;
+        case SyntaxKind::EnumConstantDecl:
+            kind = DeclarationKind::Enumerator;
+            break;
+        case SyntaxKind::FieldDecl:
+            kind = DeclarationKind::Field;
+            break;
+        default:
+            declares = false;
+        }
+        uint32_t inner = in;
+        if (declares && node.name != Node::NO_TOKEN)
+        {
+            const Token &token = tokens[node.name];
+            declarations.push_back({intern(token.lexeme), in, node.name, token.lineNo, kind, definition});
+            // the members of an anonymous struct belong to the one around it
+            if (opensScope)
+                inner = static_cast<uint32_t>(declarations.size() - 1);
+        }
+        scopes.push_back(inner);
+        return true;
+    };
+    auto leave = [&](const SyntaxNode &node)
+    {
+        if (node.kind < SyntaxKind::Identifier)
+            scopes.pop_back();
+    };
+    walkTree(root, enter, leave);
+}
+
+void DeclarationIndex::groupByName()
+{
+    // a counting sort by name, stable, so each run stays in source order
+    uint32_t count = static_cast<uint32_t>(nameStart.size() - 1);
+    firstOf.assign(count + 1, 0);
+    for (const auto &declaration : declarations)
+        firstOf[declaration.name + 1]++;
+    for (uint32_t n = 0; n < count; n++)
+        firstOf[n + 1] += firstOf[n];
+    byName.resize(declarations.size());
+    std::vector<uint32_t> next(firstOf.begin(), firstOf.end() - 1);
+    for (uint32_t i = 0; i < size(); i++)
+        byName[next[declarations[i].name]++] = i;
+}
+
+std::span<const uint32_t> DeclarationIndex::lookup(std::string_view name) const
+{
+    uint32_t slot = slots[find(name)];
+    if (slot == 0)
+        return {};
+    return {byName.data() + firstOf[slot - 1], byName.data() + firstOf[slot]};
+}
+
+uint32_t DeclarationIndex::definitionOf(std::string_view name) const
+{
+    std::span<const uint32_t> found = lookup(name);
+    for (uint32_t i : found)
+        if (declarations[i].definition)
+            return i;
+    return found.empty() ? NOT_FOUND : found.front();
+}
+
+std::size_t DeclarationIndex::memoryUsage() const
+{
+    return declarations.capacity() * sizeof(Declaration) + names.capacity() +
+           (nameStart.capacity() + firstOf.capacity() + byName.capacity() + slots.capacity()) * sizeof(uint32_t);
+}
+
+void DeclarationIndex::print(DumpWriter &out) const
+{
+    for (const auto &declaration : declarations)
+    {
+        out << declarationKindName(declaration.kind) << ' ' << name(declaration) << " line " << declaration.line;
+        if (!declaration.definition)
+            out << " declaration";
+        if (declaration.scope != NO_SCOPE)
+            out << " in " << name(declarations[declaration.scope]);
+        out << '\n';
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef DECLARATION_INDEX_HPP
+#define DECLARATION_INDEX_HPP
+#include "Syntax.hpp"
+#include <span>
+
+enum class DeclarationKind : uint8_t
+{
+    Function,
+    Variable,
+    Parameter,
+    Typedef,
+    Struct,
+    Union,
+    Enum,
+    Enumerator,
+    Field,
+    Macro
+};
+
+std::string_view declarationKindName(DeclarationKind kind);
+
+struct Declaration
+{
+    uint32_t name;  // the interned name, see DeclarationIndex::name
+    uint32_t scope; // the declaration it is declared in, or NO_SCOPE
+    uint32_t token; // the token of the name; Node::NO_TOKEN for a macro
+    int32_t line;
+    DeclarationKind kind;
+    // a function with its body, a variable that is not extern, a struct,
+    // union or enum with its members; everything else declares and defines
+    // at once
+    bool definition;
+};
+
+// Every name a file declares, with its kind, scope and line, found once after
+// the parse so that "where is add declared?" is a hash lookup rather than a
+// walk of the tree. The scope of a declaration is the function its parameters
+// and locals belong to, or the struct or union its fields belong to;
+// enumerators belong to the scope the enum is in, as in C. Tags are indexed
+// where they are defined, with their members, and a lazy parse has no locals
+// in the bodies it skipped.
+//
+// Each distinct name is stored once, in one buffer; the declarations sit in
+// source order in an array of 20-byte entries, and an open-addressed table of
+// 32-bit slots maps a name to the run of its declarations.
+class DeclarationIndex
+{
+private:
+    std::vector<Declaration> declarations;
+    // name n is names[nameStart[n], nameStart[n + 1])
+    std::string names;
+    std::vector<uint32_t> nameStart;
+    // the declarations of name n are byName[firstOf[n], firstOf[n + 1]), in
+    // source order
+    std::vector<uint32_t> firstOf;
+    std::vector<uint32_t> byName;
+    // name + 1 in each used slot, 0 in a free one; a power of two long
+    std::vector<uint32_t> slots;
+
+    uint32_t find(std::string_view name) const;
+    uint32_t intern(std::string_view name);
+    void add(const SyntaxTree &tree, const SyntaxNode &node, uint32_t scope);
+    void groupByName();
+
+public:
+    static constexpr uint32_t NO_SCOPE = UINT32_MAX;
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    // the declarations of tree; with scanner, the scanner that read its
+    // source, the macros it defined as well
+    explicit DeclarationIndex(const SyntaxTree &tree, const Scanner *scanner = nullptr);
+
+    inline uint32_t size() const { return static_cast<uint32_t>(declarations.size()); }
+    inline const Declaration &operator[](uint32_t i) const { return declarations[i]; }
+    inline std::string_view name(const Declaration &declaration) const { return name(declaration.name); }
+    inline std::string_view name(uint32_t n) const { return std::string_view(names).substr(nameStart[n], nameStart[n + 1] - nameStart[n]); }
+
+    // the declarations of name, as indices, in source order; empty when the
+    // file declares no such name
+    std::span<const uint32_t> lookup(std::string_view name) const;
+    // the first definition of name, or the first declaration when there is no
+    // definition; NOT_FOUND when there is neither
+    uint32_t definitionOf(std::string_view name) const;
+
+    // bytes held by the tables
+    std::size_t memoryUsage() const;
+    // one line per declaration, those of the tree in source order and then
+    // the macros: "Function add line 3 in outer", with "declaration" after the
+    // line of one that is not a definition
+    void print(DumpWriter &out) const;
+};
+#endif
@@ -0,0 +1,67 @@
+#include "DumpWriter.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+void DumpWriter::drain(const char *data, std::size_t size)
+{
+    if (stream)
+    {
+        stream->write(data, size);
+        return;
+    }
+    if (sink)
+    {
+        sink->append(data, size);
+        return;
+    }
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // the reader went away, or the disk is full; whoever wrote
+            // to a file can ask good()
+            failed = true;
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void DumpWriter::flush()
+{
+    if (used > 0)
+        drain(buffer.data(), used);
+    used = 0;
+    if (stream)
+        stream->flush();
+}
+
+bool replaceFile(const std::string &path, const std::function<void(DumpWriter &)> &write)
+{
+    // unique among the threads and processes that may write path at once
+    static std::atomic<unsigned> written = 0;
+    std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(written++);
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool good;
+    {
+        DumpWriter out(fd);
+        write(out);
+        out.flush();
+        good = out.good();
+    }
+    if (::close(fd) != 0 || !good || std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef DUMP_WRITER_HPP
+#define DUMP_WRITER_HPP
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Output for the token and tree dumps. Text is gathered in one large buffer
+// that goes out in a single write(2) (or std::ostream::write, or an append to
+// a string) whenever it fills up, and once more on flush or destruction;
+// nothing flushes per line.
+class DumpWriter
+{
+private:
+    int fd = -1;
+    std::ostream *stream = nullptr;
+    std::string *sink = nullptr;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+    bool failed = false; // a write(2) failed
+
+    void drain(const char *data, std::size_t size);
+
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 1 << 20;
+
+    explicit DumpWriter(int fd, std::size_t capacity = DEFAULT_CAPACITY) : fd(fd), buffer(capacity) {}
+    explicit DumpWriter(std::ostream &os, std::size_t capacity = DEFAULT_CAPACITY) : stream(&os), buffer(capacity) {}
+    explicit DumpWriter(std::string &target, std::size_t capacity = DEFAULT_CAPACITY) : sink(&target), buffer(capacity) {}
+    DumpWriter(const DumpWriter &) = delete;
+    DumpWriter &operator=(const DumpWriter &) = delete;
+    ~DumpWriter() { flush(); }
+
+    // writes out whatever is buffered
+    void flush();
+    // whether everything written to a file descriptor so far went out
+    inline bool good() const { return !failed; }
+
+    inline DumpWriter &operator<<(std::string_view text)
+    {
+        if (text.empty())
+            return *this;
+        if (text.size() > buffer.size() - used)
+        {
+            flush();
+            // too large to be worth copying
+            if (text.size() >= buffer.size())
+            {
+                drain(text.data(), text.size());
+                return *this;
+            }
+        }
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+        return *this;
+    }
+    inline DumpWriter &operator<<(const char *text) { return *this << std::string_view(text); }
+    inline DumpWriter &operator<<(char c)
+    {
+        if (used == buffer.size())
+            flush();
+        buffer[used++] = c;
+        return *this;
+    }
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    inline DumpWriter &operator<<(Integer value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+};
+
+// writes a file through write, to a temporary name next to path that is then
+// renamed over it, so that a reader, in this process or another, finds either
+// the old file or the whole new one; false, leaving nothing behind, when any
+// of it fails
+bool replaceFile(const std::string &path, const std::function<void(DumpWriter &)> &write);
+#endif
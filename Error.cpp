@@ -1,24 +1,35 @@
 #include "Error.hpp"
 void Error::addError(int line, const std::string &error)
 {
+    if (closed)
+        return;
+    reported++;
     if (errors.count(line) == 0)
         errors[line] = error;
 }
 
 void Error::addGrammarError(int line, const std::string &error)
 {
+    if (closed)
+        return;
+    reported++;
     grammarErrors.emplace_back(line, error);
 }
 
-void Error::printError(std::ostream &os)
+void Error::printError(DumpWriter &out)
 {
     for (auto itr = errors.begin(); itr != errors.end(); ++itr)
     {
-        os << "Line No. " << itr->first << "\t" << "Errors:\t";
-        os << itr->second << "\n";
+        out << "Line No. " << itr->first << "\t" << "Errors:\t";
+        out << itr->second << "\n";
     }
     for (const auto &entry : grammarErrors)
     {
-        os << "Line No. " << entry.first << "\t" << "Grammar Error:\t" << entry.second << "\n";
+        out << "Line No. " << entry.first << "\t" << "Grammar Error:\t" << entry.second << "\n";
     }
 }
+void Error::printError(std::ostream &os)
+{
+    DumpWriter out(os);
+    printError(out);
+}
@@ -1,5 +1,6 @@
 #ifndef ERROR_HPP
 #define ERROR_HPP
+#include "DumpWriter.hpp"
 #include <iostream>
 #include <map>
 #include <string>
@@ -12,17 +13,35 @@
 #define DEFINE_ERROR "Define Syntax is wrong"
 #define STRUCT_UNION_ERROR "Struct/Union define Error"
 #define MAIN_ERROR "Main function Error"
+#define EXTENSION_ERROR "The extension of file should be .c"
+#define OPEN_ERROR "The file cannot be read"
 class Error
 {
 public:
     std::map<int, std::string> errors;
     std::vector<std::pair<int, std::string>> grammarErrors;
+    // every error ever added, including those on a line that already had one
+    std::size_t reported = 0;
+    // set by close(); errors added after it are dropped
+    bool closed = false;
 
 public:
     Error() = default;
     void addError(int line, const std::string &error);
     void addGrammarError(int line, const std::string &error);
+    void printError(DumpWriter &out);
     void printError(std::ostream &os);
+    // forgets every error, for the next file
+    inline void clear()
+    {
+        errors.clear();
+        grammarErrors.clear();
+        reported = 0;
+        closed = false;
+    }
+    // drops every error added from now on; a parse that stops early closes
+    // its sink so that it does not report the file ending where it stopped
+    inline void close() { closed = true; }
     inline bool hasErrors() const { return !errors.empty() || !grammarErrors.empty(); }
 
     ~Error() = default;
@@ -0,0 +1,83 @@
+#include "FlatTree.hpp"
+#include "TreeWalk.hpp"
+#include <algorithm>
+
+FlatTree::FlatTree(const Node &root, std::shared_ptr<const TokenStore> tokens) : store(std::move(tokens))
+{
+    // the nodes entered and not yet left; a node's size is known when it is left
+    std::vector<uint32_t> open;
+    auto enter = [&](const Node &node, std::size_t, bool)
+    {
+        parents.push_back(open.empty() ? NO_PARENT : open.back());
+        open.push_back(nodeCount());
+        kinds.push_back(static_cast<uint16_t>(node.type));
+        this->tokens.push_back(node.token);
+        sizes.push_back(1);
+        return true;
+    };
+    auto leave = [&](const Node &)
+    {
+        sizes[open.back()] = nodeCount() - open.back();
+        open.pop_back();
+    };
+    walkTree(root, enter, leave);
+    indexKinds();
+}
+
+void FlatTree::indexKinds()
+{
+    // a counting sort by kind; scanning in preorder keeps each list ascending
+    kindStart.assign(TOKEN_TYPE_COUNT + 1, 0);
+    for (uint16_t k : kinds)
+        kindStart[k + 1]++;
+    for (std::size_t k = 0; k < TOKEN_TYPE_COUNT; k++)
+        kindStart[k + 1] += kindStart[k];
+    byKind.resize(nodeCount());
+    std::vector<uint32_t> next(kindStart.begin(), kindStart.end() - 1);
+    for (uint32_t i = 0; i < nodeCount(); i++)
+        byKind[next[kinds[i]]++] = i;
+}
+
+std::span<const uint32_t> FlatTree::ofKind(TokenType k, uint32_t root) const
+{
+    std::span<const uint32_t> all = ofKind(k);
+    auto first = std::lower_bound(all.begin(), all.end(), root);
+    auto last = std::lower_bound(first, all.end(), subtreeEnd(root));
+    return {first, last};
+}
+
+uint32_t FlatTree::enclosing(uint32_t i, TokenType k) const
+{
+    for (uint32_t p = parents[i]; p != NO_PARENT; p = parents[p])
+        if (kind(p) == k)
+            return p;
+    return NO_PARENT;
+}
+
+uint32_t FlatTree::childCount(uint32_t i) const
+{
+    uint32_t count = 0;
+    for (auto child = i + 1, end = subtreeEnd(i); child < end; child += sizes[child])
+        count++;
+    return count;
+}
+
+uint32_t FlatTree::depth(uint32_t i) const
+{
+    uint32_t count = 0;
+    for (uint32_t p = parents[i]; p != NO_PARENT; p = parents[p])
+        count++;
+    return count;
+}
+
+std::shared_ptr<Node> FlatTree::toNode(uint32_t i) const
+{
+    std::vector<std::shared_ptr<Node>> built(sizes[i]);
+    for (uint32_t j = i; j < subtreeEnd(i); j++)
+    {
+        built[j - i] = std::make_shared<Node>(kind(j), tokens[j]);
+        if (j != i)
+            built[parents[j] - i]->children.push_back(built[j - i]);
+    }
+    return built[0];
+}
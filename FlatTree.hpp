@@ -0,0 +1,113 @@
+#ifndef FLAT_TREE_HPP
+#define FLAT_TREE_HPP
+#include "AST.hpp"
+#include <span>
+
+// A finished tree frozen into parallel arrays in preorder: the kind, token
+// index, subtree size and parent of node i sit at position i of each. The
+// subtree of i is [i, i + subtreeSize(i)), its first child is i + 1, and the
+// next sibling of a child c is c + subtreeSize(c), so a full walk is a linear
+// scan and skipping a subtree is one addition. Node 0 is the root.
+// Building the arrays also files every node under its kind, in preorder, so
+// the nodes of one kind, in the whole tree or under one node, are found in
+// time proportional to how many there are rather than to the size of the tree.
+class FlatTree
+{
+private:
+    static_assert(TOKEN_TYPE_COUNT <= UINT16_MAX, "kinds are stored in 16 bits");
+    std::vector<uint16_t> kinds;
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> parents;
+    // the nodes of kind k are byKind[kindStart[k], kindStart[k + 1]), ascending
+    std::vector<uint32_t> kindStart;
+    std::vector<uint32_t> byKind;
+    std::shared_ptr<const TokenStore> store;
+
+    void indexKinds();
+
+public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    // the siblings [first, end) of one parent, each as its index
+    class ChildIterator
+    {
+    private:
+        const FlatTree *tree;
+        uint32_t position;
+
+    public:
+        ChildIterator(const FlatTree *tree, uint32_t position) : tree(tree), position(position) {}
+        inline uint32_t operator*() const { return position; }
+        inline ChildIterator &operator++()
+        {
+            position += tree->sizes[position];
+            return *this;
+        }
+        inline bool operator==(const ChildIterator &other) const { return position == other.position; }
+        inline bool operator!=(const ChildIterator &other) const { return position != other.position; }
+    };
+    struct ChildRange
+    {
+        ChildIterator first;
+        ChildIterator last;
+        inline ChildIterator begin() const { return first; }
+        inline ChildIterator end() const { return last; }
+    };
+
+    FlatTree() = default;
+    // copies the tree under root; tokens is the store its leaves index
+    FlatTree(const Node &root, std::shared_ptr<const TokenStore> tokens);
+
+    inline uint32_t nodeCount() const { return static_cast<uint32_t>(kinds.size()); }
+    inline TokenType kind(uint32_t i) const { return static_cast<TokenType>(kinds[i]); }
+    inline uint32_t token(uint32_t i) const { return tokens[i]; }
+    inline uint32_t subtreeSize(uint32_t i) const { return sizes[i]; }
+    inline uint32_t subtreeEnd(uint32_t i) const { return i + sizes[i]; }
+    inline uint32_t parent(uint32_t i) const { return parents[i]; }
+    inline bool isLeaf(uint32_t i) const { return sizes[i] == 1; }
+    inline ChildRange children(uint32_t i) const { return {ChildIterator(this, i + 1), ChildIterator(this, i + sizes[i])}; }
+    uint32_t childCount(uint32_t i) const;
+    // the number of ancestors of i
+    uint32_t depth(uint32_t i) const;
+    // the token of a terminal; nullptr for a non-terminal
+    inline const Token *tokenOf(uint32_t i) const { return tokens[i] == Node::NO_TOKEN || isNonterminal(kind(i)) ? nullptr : &(*store)[tokens[i]]; }
+    inline std::string_view lexeme(uint32_t i) const
+    {
+        const Token *t = tokenOf(i);
+        return t ? std::string_view(t->lexeme) : std::string_view();
+    }
+    inline const std::shared_ptr<const TokenStore> &getTokens() const { return store; }
+    // bytes held by the arrays and the kind index
+    inline std::size_t memoryUsage() const
+    {
+        return kinds.capacity() * sizeof(uint16_t) +
+               (tokens.capacity() + sizes.capacity() + parents.capacity() + kindStart.capacity() + byKind.capacity()) * sizeof(uint32_t);
+    }
+
+    // every node of kind k, in preorder
+    inline std::span<const uint32_t> ofKind(TokenType k) const
+    {
+        if (kindStart.empty())
+            return {};
+        auto at = static_cast<std::size_t>(k);
+        return {byKind.data() + kindStart[at], byKind.data() + kindStart[at + 1]};
+    }
+    // the nodes of kind k in the subtree of root, root included, in preorder:
+    // a subtree is a range of positions, so two binary searches find them
+    std::span<const uint32_t> ofKind(TokenType k, uint32_t root) const;
+    // the nearest proper ancestor of i of kind k; NO_PARENT when there is none
+    uint32_t enclosing(uint32_t i, TokenType k) const;
+
+    // Calls visit(i) on every node of the subtree of root in preorder; when it
+    // returns false the subtree of i is skipped.
+    template <typename Visit>
+    void walk(uint32_t root, Visit &&visit) const
+    {
+        for (uint32_t i = root, end = subtreeEnd(root); i < end;)
+            i = visit(i) ? i + 1 : subtreeEnd(i);
+    }
+    // builds the Node tree of the subtree of i again
+    std::shared_ptr<Node> toNode(uint32_t i = 0) const;
+};
+#endif
@@ -0,0 +1,113 @@
+#ifndef GRAMMAR_HPP
+#define GRAMMAR_HPP
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include "Token.hpp"
+
+// A set of TokenType values stored as one bit per enumerator, so membership
+// is a single shift-and-mask instead of a switch or a chain of comparisons.
+class TokenSet
+{
+private:
+    std::array<uint64_t, (TOKEN_TYPE_COUNT + 63) / 64> bits{};
+
+public:
+    constexpr TokenSet() = default;
+    constexpr TokenSet(std::initializer_list<TokenType> types)
+    {
+        for (auto t : types)
+            insert(t);
+    }
+    constexpr void insert(TokenType t)
+    {
+        auto i = static_cast<std::size_t>(t);
+        bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+    constexpr bool contains(TokenType t) const
+    {
+        auto i = static_cast<std::size_t>(t);
+        return (bits[i / 64] >> (i % 64)) & 1;
+    }
+    // adds every member of other; returns whether anything new was added
+    constexpr bool merge(const TokenSet &other)
+    {
+        bool changed = false;
+        for (std::size_t i = 0; i < bits.size(); i++)
+        {
+            uint64_t merged = bits[i] | other.bits[i];
+            changed = changed || merged != bits[i];
+            bits[i] = merged;
+        }
+        return changed;
+    }
+    constexpr TokenSet operator|(const TokenSet &other) const
+    {
+        TokenSet ret = *this;
+        ret.merge(other);
+        return ret;
+    }
+};
+
+struct Production
+{
+    TokenType lhs;
+    std::array<TokenType, 8> rhs;
+    std::size_t length;
+};
+
+template <typename... Symbols>
+constexpr Production rule(TokenType lhs, Symbols... rhs)
+{
+    static_assert(sizeof...(rhs) > 0 && sizeof...(rhs) <= 8, "production length out of range");
+    return Production{lhs, {rhs...}, sizeof...(rhs)};
+}
+
+// The productions of grammar.y written with TokenType symbols, generated from
+// grammar.y by table.cpp. Terminals use the Scanner's token types (IDENTIFIER
+// is ID, I_CONSTANT and F_CONSTANT are CONSTANT, ...); the constant, string
+// and enumeration_constant non-terminals are folded into the rules that use
+// them because the Scanner already produces a single token for each of them.
+constexpr auto grammarRules()
+{
+    using enum TokenType;
+    return std::to_array<Production>({
+#include "GrammarRules.inc"
+    });
+}
+constexpr auto GRAMMAR = grammarRules();
+constexpr std::size_t GRAMMAR_SIZE = GRAMMAR.size();
+
+// FIRST set of every non-terminal, computed by fixed-point iteration over
+// GRAMMAR at compile time. grammar.y has no empty productions, so FIRST(A) is
+// the union of FIRST of the first symbol of each of A's productions.
+constexpr std::array<TokenSet, TOKEN_TYPE_COUNT> computeFirstSets()
+{
+    std::array<TokenSet, TOKEN_TYPE_COUNT> first{};
+    for (std::size_t i = 0; i < TOKEN_TYPE_COUNT; i++)
+        if (!isNonterminal(static_cast<TokenType>(i)))
+            first[i].insert(static_cast<TokenType>(i));
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (const auto &p : GRAMMAR)
+        {
+            bool grew = first[static_cast<std::size_t>(p.lhs)].merge(first[static_cast<std::size_t>(p.rhs[0])]);
+            changed = changed || grew;
+        }
+    }
+    return first;
+}
+constexpr std::array<TokenSet, TOKEN_TYPE_COUNT> FIRST_SETS = computeFirstSets();
+
+constexpr const TokenSet &firstSet(TokenType symbol)
+{
+    return FIRST_SETS[static_cast<std::size_t>(symbol)];
+}
+
+static_assert(firstSet(TokenType::STORAGE_CLASS_SPECIFIER).contains(TokenType::TYPEDEF));
+static_assert(firstSet(TokenType::DECLARATION).contains(TokenType::TYPEDEF_NAME));
+static_assert(!firstSet(TokenType::TYPE_SPECIFIER).contains(TokenType::CONST));
+#endif
@@ -0,0 +1,52 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// A fast 64-bit hash of bytes, for keys that are written to disk: unlike
+// std::hash it gives the same value in every run and every build. It reads
+// the bytes eight at a time in the machine's byte order, so files that store
+// it record that order as well. Not for adversarial input.
+inline uint64_t mixHash(uint64_t h)
+{
+    // the finalizer of MurmurHash3
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t hashBytes(std::string_view data, uint64_t seed = 0)
+{
+    constexpr uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ull;
+    uint64_t h = seed ^ (data.size() * MULTIPLIER);
+    std::size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, 8);
+        h = (h ^ mixHash(word)) * MULTIPLIER;
+    }
+    if (i < data.size())
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, data.data() + i, data.size() - i);
+        h = (h ^ mixHash(word)) * MULTIPLIER;
+    }
+    return mixHash(h);
+}
+
+// a hash as 16 hex digits, for file names
+inline std::string hexHash(uint64_t hash)
+{
+    static constexpr char HEX[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; i--, hash >>= 4)
+        text[i] = HEX[hash & 15];
+    return text;
+}
+#endif
@@ -0,0 +1,247 @@
+#include "Incremental.hpp"
+#include "TreeWalk.hpp"
+#include <algorithm>
+
+// a '#' followed by "define", possibly with spaces in between
+static bool definesMacro(std::string_view text)
+{
+    for (std::size_t i = text.find('#'); i != std::string_view::npos; i = text.find('#', i + 1))
+    {
+        std::size_t word = text.find_first_not_of(" \t", i + 1);
+        if (word != std::string_view::npos && text.compare(word, 6, "define") == 0)
+            return true;
+    }
+    return false;
+}
+
+IncrementalParser::IncrementalParser(const std::string &path, std::string text, const ParseOptions &options)
+    : path(path), text(std::move(text)), options(options)
+{
+    this->options.lazyBodies = false;
+    parseAll();
+}
+
+// token with its line and offset moved by lines and bytes
+static Token rebase(Token token, int lines, long bytes)
+{
+    token.lineNo += lines;
+    if (token.offset >= 0)
+        token.offset += bytes;
+    return token;
+}
+
+// error with its lines moved by lines, into into
+static void rebase(const Error &error, int lines, Error &into)
+{
+    for (const auto &entry : error.errors)
+        into.errors.emplace(entry.first + lines, entry.second);
+    for (const auto &entry : error.grammarErrors)
+        into.grammarErrors.emplace_back(entry.first + lines, entry.second);
+}
+
+bool IncrementalParser::sameTypeNames(std::vector<Unit>::const_iterator begin, std::vector<Unit>::const_iterator end, const std::vector<Unit> &fresh)
+{
+    std::vector<std::string_view> before, after;
+    for (; begin != end; ++begin)
+        before.insert(before.end(), begin->typeNames.begin(), begin->typeNames.end());
+    for (const auto &unit : fresh)
+        after.insert(after.end(), unit.typeNames.begin(), unit.typeNames.end());
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    return before == after;
+}
+
+bool IncrementalParser::parseRegion(std::size_t begin, std::size_t end, int line, std::size_t firstUnit, std::vector<Unit> &out)
+{
+    Error lexErrors;
+    Scanner lexer(std::string_view(text).substr(begin, end - begin), lexErrors, line, static_cast<int>(begin));
+    std::shared_ptr<TokenStore> lexed = lexer.takeTokens();
+    Token endToken = lexed->back();
+
+    // cut the tokens into units, each followed by an END in the store
+    bool complete = true;
+    auto itr = lexed->begin();
+    while (itr->type != TokenType::END)
+    {
+        Unit unit;
+        unit.begin = out.empty() ? begin : static_cast<std::size_t>(itr->offset);
+        unit.line = out.empty() ? line : itr->lineNo;
+        auto first = itr;
+        bool typedefs;
+        itr = AST::declarationEnd(itr, typedefs, complete);
+        if (!out.empty())
+            out.back().end = unit.begin;
+        long bytes = -static_cast<long>(unit.begin);
+        unit.first = tokens->size();
+        for (; first != itr; ++first)
+            tokens->push_back(rebase(std::move(*first), -unit.line, bytes));
+        tokens->push_back(rebase(endToken, -unit.line, bytes));
+        unit.last = tokens->size();
+        liveTokens += unit.last - unit.first;
+        out.push_back(std::move(unit));
+    }
+    if (out.empty())
+        return true;
+    out.back().end = end;
+    // each lexing error goes to the unit of its line
+    auto owner = [&out](int line) -> Unit &
+    {
+        auto itr = std::upper_bound(out.begin() + 1, out.end(), line, [](int at, const Unit &unit)
+                                    { return at < unit.line; });
+        return *(itr - 1);
+    };
+    for (const auto &entry : lexErrors.errors)
+    {
+        Unit &unit = owner(entry.first);
+        unit.error.errors.emplace(entry.first - unit.line, entry.second);
+    }
+    for (const auto &entry : lexErrors.grammarErrors)
+    {
+        Unit &unit = owner(entry.first);
+        unit.error.grammarErrors.emplace_back(entry.first - unit.line, entry.second);
+    }
+
+    // every unit sees the typedef names of the units before it, as in Parallel.cpp
+    TypeNameIndex typeNames;
+    for (std::size_t i = 0; i < firstUnit; i++)
+        for (const auto &name : units[i].typeNames)
+            typeNames.emplace(name, i);
+    for (std::size_t i = 0; i < out.size(); i++)
+    {
+        Unit &unit = out[i];
+        AST part(tokens, unit.first, unit.last, unit.error, options.engine, &typeNames, firstUnit + i);
+        unit.nodes = std::move(part.root->children);
+        unit.typeNames.assign(part.definedTypeNames.begin(), part.definedTypeNames.end());
+        for (const auto &name : unit.typeNames)
+            typeNames.emplace(name, firstUnit + i);
+    }
+    return complete;
+}
+
+void IncrementalParser::parseAll()
+{
+    units.clear();
+    tokens = std::make_shared<TokenStore>();
+    liveTokens = 0;
+    parseRegion(0, text.size(), 1, 0, units);
+    hasMacros = definesMacro(text);
+    reparsed = units.size();
+    rebuildRoot();
+}
+
+void IncrementalParser::rebuildRoot()
+{
+    // a new root each time, so a tree handed out earlier keeps its children
+    root = std::make_shared<Node>(Node(TokenType::TRANSLATION_UNIT));
+    for (const auto &unit : units)
+        root->children.insert(root->children.end(), unit.nodes.begin(), unit.nodes.end());
+}
+
+void IncrementalParser::compact()
+{
+    auto next = std::make_shared<TokenStore>();
+    for (auto &unit : units)
+    {
+        // the leaves move down by as much as the range does
+        uint32_t delta = next->size() - unit.first;
+        for (uint32_t j = unit.first; j < unit.last; j++)
+            next->push_back(std::move((*tokens)[j]));
+        unit.first += delta;
+        unit.last += delta;
+        auto move = [delta](Node &node, std::size_t, bool)
+        {
+            if (node.token != Node::NO_TOKEN)
+                node.token += delta;
+            return true;
+        };
+        if (delta != 0)
+            for (const auto &node : unit.nodes)
+                walkTree(*node, move);
+    }
+    tokens = std::move(next);
+}
+
+void IncrementalParser::edit(std::size_t offset, std::size_t length, const std::string &replacement)
+{
+    offset = std::min(offset, text.size());
+    length = std::min(length, text.size() - offset);
+    std::string_view removed = std::string_view(text).substr(offset, length);
+    long bytes = static_cast<long>(replacement.size()) - static_cast<long>(length);
+    int lines = static_cast<int>(std::count(replacement.begin(), replacement.end(), '\n') - std::count(removed.begin(), removed.end(), '\n'));
+    bool touchesDirective = removed.find('#') != std::string_view::npos || replacement.find('#') != std::string::npos;
+    text.replace(offset, length, replacement);
+
+    if (hasMacros || touchesDirective || units.empty())
+    {
+        parseAll();
+        return;
+    }
+
+    // the units whose bytes the edit touches; text inserted right at the start
+    // of a unit belongs to that unit, since the one before it is complete
+    std::size_t first = std::lower_bound(units.begin(), units.end(), offset, [](const Unit &unit, std::size_t at)
+                                         { return unit.end <= at; }) -
+                        units.begin();
+    first = std::min(first, units.size() - 1);
+    std::size_t last = first;
+    while (last + 1 < units.size() && units[last + 1].begin <= offset + length)
+        last++;
+
+    // the new units go after everything in the store
+    uint32_t mark = tokens->size();
+    uint32_t live = liveTokens;
+    std::vector<Unit> fresh;
+    while (true)
+    {
+        fresh.clear();
+        tokens->truncate(mark);
+        liveTokens = live;
+        bool complete = parseRegion(units[first].begin, units[last].end + bytes, units[first].line, first, fresh);
+        if (last + 1 < units.size() && (!complete || !sameTypeNames(units.begin() + first, units.begin() + last + 1, fresh)))
+        {
+            // the edit ran into the declarations after it (doubling the region
+            // each time), or changed the typedef names they see
+            last = complete ? units.size() - 1 : std::min(units.size() - 1, last + (last - first + 1));
+            continue;
+        }
+        break;
+    }
+
+    // the units after it keep their tokens and tree and only move
+    for (std::size_t i = last + 1; i < units.size(); i++)
+    {
+        units[i].begin += bytes;
+        units[i].end += bytes;
+        units[i].line += lines;
+    }
+    for (std::size_t i = first; i <= last; i++)
+        liveTokens -= units[i].last - units[i].first;
+    reparsed = fresh.size();
+    units.erase(units.begin() + first, units.begin() + last + 1);
+    units.insert(units.begin() + first, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    if (fresh.empty() && first > 0)
+        units[first - 1].end = first < units.size() ? units[first].begin : text.size();
+    if (tokens->size() - liveTokens > liveTokens)
+        compact();
+    rebuildRoot();
+}
+
+IncrementalParser::Snapshot IncrementalParser::snapshot() const
+{
+    // the same indices as the store, so that the tree needs no change
+    auto laidOut = std::make_shared<TokenStore>();
+    for (uint32_t i = 0; i < tokens->size(); i++)
+        laidOut->push_back((*tokens)[i]);
+    for (const auto &unit : units)
+        for (uint32_t j = unit.first; j < unit.last; j++)
+            (*laidOut)[j] = rebase(std::move((*laidOut)[j]), unit.line, static_cast<long>(unit.begin));
+    return {root, laidOut};
+}
+
+Error IncrementalParser::errors() const
+{
+    Error merged;
+    for (const auto &unit : units)
+        rebase(unit.error, unit.line, merged);
+    return merged;
+}
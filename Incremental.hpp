@@ -0,0 +1,86 @@
+#ifndef INCREMENTAL_HPP
+#define INCREMENTAL_HPP
+#include "AST.hpp"
+
+// Keeps the text and tree of one file and applies edits to both. The file is
+// held as a list of units, one per top-level declaration, each covering the
+// bytes up to the start of the next. An edit re-lexes and re-parses only the
+// units it touches; the subtrees of the others are reused as they are.
+//
+// Every unit has a token range of its own in one TokenStore, followed by an
+// END, and its tokens, and the lines of its diagnostics, are relative to the
+// line and byte where the unit begins. An edit appends the tokens of the units
+// it reparses at the end of the store and only moves the line and byte of the
+// units after it, so its cost follows the size of the edit, not of the file.
+// The ranges of replaced units stay behind in the store until they add up to
+// more than the live ones, when the store is laid out again.
+//
+// Two cases widen the reparse: an edit that changes the typedef names the
+// reparsed declarations declare reparses everything after it, since the names
+// change how later declarations parse, and a file with #define (or an edit touching a '#') is
+// reparsed whole, since a macro can change the meaning of any later token.
+// Bodies are always parsed eagerly here.
+class IncrementalParser
+{
+private:
+    struct Unit
+    {
+        std::size_t begin; // byte range in text
+        std::size_t end;
+        int line; // line of begin
+        // tokens [first, last) of the store, END last, with their lines and
+        // offsets counted from line and begin
+        uint32_t first = 0;
+        uint32_t last = 0;
+        std::vector<std::string> typeNames; // typedef names it declares
+        NodeList nodes;
+        Error error; // lines counted from line
+    };
+    std::string path;
+    std::string text;
+    ParseOptions options;
+    std::vector<Unit> units;
+    std::shared_ptr<TokenStore> tokens;
+    uint32_t liveTokens = 0; // in the ranges of units, the rest are left over
+    std::shared_ptr<Node> root;
+    bool hasMacros = false;
+    std::size_t reparsed = 0;
+
+    // lexes and parses text[begin, end) into units, appending their tokens to
+    // the store; false when the last declaration runs past end
+    bool parseRegion(std::size_t begin, std::size_t end, int line, std::size_t firstUnit, std::vector<Unit> &out);
+    void parseAll();
+    void rebuildRoot();
+    // whether units [begin, end) and fresh declare the same typedef names
+    static bool sameTypeNames(std::vector<Unit>::const_iterator begin, std::vector<Unit>::const_iterator end, const std::vector<Unit> &fresh);
+    // lays out the store again with only the ranges of the units
+    void compact();
+
+public:
+    // the whole file as one tree over one store, as a parse of getText() gives
+    struct Snapshot
+    {
+        std::shared_ptr<Node> root;
+        std::shared_ptr<TokenStore> tokens;
+    };
+
+    IncrementalParser(const std::string &path, std::string text, const ParseOptions &options = ParseOptions());
+
+    // replaces text[offset, offset + length) with replacement
+    void edit(std::size_t offset, std::size_t length, const std::string &replacement);
+
+    // the tree, whose leaves refer to the tokens of snapshot()
+    inline const std::shared_ptr<Node> &getRoot() const { return root; }
+    // the tree with a copy of the store whose tokens carry the lines and
+    // offsets of the file, for dumps; it costs a pass over every token, and
+    // the two must not be used together after the next edit
+    Snapshot snapshot() const;
+    inline const std::string &getPath() const { return path; }
+    inline const std::string &getText() const { return text; }
+    // units parsed by the last edit (or by the constructor)
+    inline std::size_t reparsedUnits() const { return reparsed; }
+    inline std::size_t unitCount() const { return units.size(); }
+    // the diagnostics of every unit in source order
+    Error errors() const;
+};
+#endif
@@ -0,0 +1,410 @@
+#include "JsonWriter.hpp"
+#include "ParseEvents.hpp"
+#include "TreeWalk.hpp"
+#include <array>
+
+// the bytes a JSON string cannot hold as they are, and those from 0x80 up,
+// which must be checked to be UTF-8
+static constexpr std::array<bool, 256> buildEscapes()
+{
+    std::array<bool, 256> escapes{};
+    for (int c = 0; c < 0x20; c++)
+        escapes[c] = true;
+    for (int c = 0x80; c < 0x100; c++)
+        escapes[c] = true;
+    escapes['"'] = escapes['\\'] = true;
+    return escapes;
+}
+static constexpr std::array<bool, 256> ESCAPES = buildEscapes();
+
+// the length of the well-formed UTF-8 sequence at text[i], which is 0x80 or
+// above, or 0 when there is none: no overlong forms, surrogates or code
+// points past U+10FFFF
+static std::size_t utf8Length(std::string_view text, std::size_t i)
+{
+    unsigned char c = text[i];
+    std::size_t length;
+    unsigned char low = 0x80, high = 0xbf; // the range of the second byte
+    if (c >= 0xc2 && c <= 0xdf)
+        length = 2;
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        length = 3;
+        if (c == 0xe0)
+            low = 0xa0;
+        else if (c == 0xed)
+            high = 0x9f;
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        length = 4;
+        if (c == 0xf0)
+            low = 0x90;
+        else if (c == 0xf4)
+            high = 0x8f;
+    }
+    else
+        return 0;
+    if (i + length > text.size())
+        return 0;
+    unsigned char second = text[i + 1];
+    if (second < low || second > high)
+        return 0;
+    for (std::size_t k = 2; k < length; k++)
+        if ((static_cast<unsigned char>(text[i + k]) & 0xc0) != 0x80)
+            return 0;
+    return length;
+}
+
+// the tokens a compact tree leaves out
+static constexpr TokenSet punctuation = {
+    TokenType::L_CUR, TokenType::R_CUR, TokenType::L_SQR, TokenType::R_SQR,
+    TokenType::L_BR, TokenType::R_BR, TokenType::COMMA, TokenType::COLON,
+    TokenType::SEMI_COLON, TokenType::QUESTION};
+
+void writeJsonString(std::string_view text, DumpWriter &out)
+{
+    static constexpr char HEX[] = "0123456789abcdef";
+    std::size_t run = 0; // the first character not written yet
+    for (std::size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char c = text[i];
+        if (!ESCAPES[c])
+            continue;
+        std::size_t length = c >= 0x80 ? utf8Length(text, i) : 0;
+        if (length)
+        {
+            i += length - 1;
+            continue;
+        }
+        out << text.substr(run, i - run);
+        switch (c)
+        {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        case '\r':
+            out << "\\r";
+            break;
+        default:
+            // a byte that is not part of any UTF-8 character is a U+FFFD
+            if (c >= 0x80)
+                out << "\\ufffd";
+            else
+                out << "\\u00" << HEX[c >> 4] << HEX[c & 15];
+        }
+        run = i + 1;
+    }
+    out << text.substr(run);
+}
+
+// the text of a terminal that has a token
+struct JsonToken
+{
+    std::string_view text;
+    int line;
+    int offset;
+};
+
+// The writing both trees share, fed one node at a time in preorder: enter
+// says whether to go on into the node's children, and every node entered is
+// left once they are done.
+class JsonTreeWriter
+{
+private:
+    const JsonOptions &options;
+    std::string_view name;
+    DumpWriter &out;
+    // what enter did with each node that has not been left yet
+    enum class Written : char
+    {
+        Nothing,  // dropped, or a leaf already closed
+        InPlace,  // a wrapper written as its only child
+        Children  // an object whose children array is open
+    };
+    std::vector<Written> entered;
+    // for each open children array, whether it has an element yet
+    std::vector<char> started;
+
+public:
+    JsonTreeWriter(const JsonOptions &options, std::string_view name, DumpWriter &out) : options(options), name(name), out(out) {}
+
+    inline bool dropped(TokenType kind) const
+    {
+        return options.compact && !isNonterminal(kind) && punctuation.contains(kind);
+    }
+    // kept() counts the children of a non-terminal that are not dropped;
+    // token is that of a terminal, nullptr when it has none
+    template <typename Kept>
+    bool enter(TokenType kind, bool nested, Kept &&kept, const JsonToken *token)
+    {
+        if (dropped(kind))
+        {
+            entered.push_back(Written::Nothing);
+            return false;
+        }
+        if (options.compact && nested && isNonterminal(kind) && kept() == 1)
+        {
+            entered.push_back(Written::InPlace);
+            return true;
+        }
+        if (!started.empty())
+        {
+            if (started.back())
+                out << ',';
+            started.back() = true;
+        }
+        out << "{\"kind\":\"" << TokenToString::name(kind) << '"';
+        if (kind == TokenType::TRANSLATION_UNIT)
+        {
+            out << ",\"file\":\"";
+            writeJsonString(name, out);
+            out << '"';
+        }
+        if (!isNonterminal(kind))
+        {
+            if (token)
+            {
+                out << ",\"text\":\"";
+                writeJsonString(token->text, out);
+                out << "\",\"line\":" << token->line;
+                if (token->offset >= 0)
+                    out << ",\"offset\":" << token->offset;
+            }
+            out << '}';
+            entered.push_back(Written::Nothing);
+            return false;
+        }
+        out << ",\"children\":[";
+        entered.push_back(Written::Children);
+        started.push_back(false);
+        return true;
+    }
+    void leave()
+    {
+        if (entered.back() == Written::Children)
+        {
+            out << "]}";
+            started.pop_back();
+        }
+        entered.pop_back();
+    }
+};
+
+void writeJsonTree(const Node &root, const TokenStore &tokens, std::string_view name, const JsonOptions &options, DumpWriter &out)
+{
+    JsonTreeWriter writer(options, name, out);
+    auto enter = [&](const Node &node, std::size_t depth, bool)
+    {
+        auto kept = [&]()
+        {
+            std::size_t count = 0;
+            for (const auto &child : node.children)
+                count += !writer.dropped(child->type);
+            return count;
+        };
+        JsonToken token;
+        bool hasToken = !isNonterminal(node.type) && node.token != Node::NO_TOKEN;
+        if (hasToken)
+        {
+            const Token &read = tokens[node.token];
+            token = {read.lexeme, read.lineNo, read.offset};
+        }
+        return writer.enter(node.type, depth > 0, kept, hasToken ? &token : nullptr);
+    };
+    walkTree(root, enter, [&](const Node &)
+             { writer.leave(); });
+}
+
+void writeJsonTree(const TreeFile &tree, std::string_view name, const JsonOptions &options, DumpWriter &out)
+{
+    JsonTreeWriter writer(options, name, out);
+    // the ends of the subtrees entered and not yet left
+    std::vector<uint32_t> open;
+    for (uint32_t i = 0; i < tree.nodeCount();)
+    {
+        while (!open.empty() && open.back() <= i)
+        {
+            writer.leave();
+            open.pop_back();
+        }
+        auto kept = [&]()
+        {
+            std::size_t count = 0;
+            for (uint32_t child : tree.children(i))
+                count += !writer.dropped(tree.kind(child));
+            return count;
+        };
+        JsonToken token;
+        uint32_t t = tree.token(i);
+        bool hasToken = !isNonterminal(tree.kind(i)) && t != Node::NO_TOKEN;
+        if (hasToken)
+            token = {tree.tokenLexeme(t), tree.tokenAt(t).line, tree.tokenAt(t).offset};
+        if (writer.enter(tree.kind(i), !open.empty(), kept, hasToken ? &token : nullptr))
+        {
+            open.push_back(tree.subtreeEnd(i));
+            i++;
+        }
+        else
+        {
+            writer.leave();
+            i = tree.subtreeEnd(i);
+        }
+    }
+    for (; !open.empty(); open.pop_back())
+        writer.leave();
+}
+
+// Writes the tree from parse events as they come. A compact tree holds each
+// top-level declaration back until it ends, as only then is it known which of
+// its non-terminals have one child left; its tokens stay in the store until
+// then.
+class JsonListener : public ParseListener
+{
+private:
+    JsonTreeWriter writer;
+    bool compact;
+    std::size_t depth = 0;
+    struct Event
+    {
+        TokenType kind;
+        const Token *token; // a terminal's, nullptr for a non-terminal
+        bool exit;
+        std::size_t kept; // the children of a non-terminal the writer keeps
+    };
+    std::vector<Event> held;
+    std::vector<std::size_t> open;
+
+    void write(TokenType kind, const Token *token, std::size_t kept)
+    {
+        auto count = [kept]() { return kept; };
+        if (!token)
+        {
+            writer.enter(kind, depth > 0, count, nullptr);
+            return;
+        }
+        JsonToken text{token->lexeme, token->lineNo, token->offset};
+        writer.enter(kind, true, count, &text);
+        writer.leave();
+    }
+    // writes the declaration held back, now that it has ended
+    void release()
+    {
+        for (std::size_t i = 0; i < held.size(); i++)
+        {
+            if (held[i].exit)
+            {
+                open.pop_back();
+                continue;
+            }
+            if (!open.empty() && !writer.dropped(held[i].kind))
+                held[open.back()].kept++;
+            if (!held[i].token)
+                open.push_back(i);
+        }
+        for (const Event &event : held)
+        {
+            if (event.exit)
+                writer.leave();
+            else
+                write(event.kind, event.token, event.kept);
+        }
+        held.clear();
+    }
+
+public:
+    JsonListener(const JsonOptions &options, std::string_view name, DumpWriter &out) : writer(options, name, out), compact(options.compact) {}
+
+    void onEnter(TokenType kind, SourceRange) override
+    {
+        if (compact && depth > 0)
+            held.push_back({kind, nullptr, false, 0});
+        else
+            write(kind, nullptr, 0);
+        depth++;
+    }
+    void onExit(TokenType) override
+    {
+        depth--;
+        if (!compact || depth == 0)
+        {
+            writer.leave();
+            return;
+        }
+        held.push_back({TokenType::END, nullptr, true, 0});
+        if (depth == 1)
+            release();
+    }
+    void onToken(const Token &token, uint32_t) override
+    {
+        if (compact && depth > 1)
+            held.push_back({token.type, &token, false, 0});
+        else
+            write(token.type, &token, 0);
+    }
+};
+
+// {"file":...,"tree": everything before the tree
+static void writeJsonHead(std::string_view name, DumpWriter &out)
+{
+    out << "{\"file\":\"";
+    writeJsonString(name, out);
+    out << "\",\"tree\":";
+}
+
+// ,"errors":[...]} and the end of the line
+static void writeJsonTail(const Error &errors, DumpWriter &out)
+{
+    out << ",\"errors\":[";
+    bool first = true;
+    auto error = [&](int line, const char *kind, const std::string &message)
+    {
+        if (!first)
+            out << ',';
+        first = false;
+        out << "{\"line\":" << line << ",\"kind\":\"" << kind << "\",\"message\":\"";
+        writeJsonString(message, out);
+        out << "\"}";
+    };
+    for (const auto &entry : errors.errors)
+        error(entry.first, "lexical", entry.second);
+    for (const auto &entry : errors.grammarErrors)
+        error(entry.first, "grammar", entry.second);
+    out << "]}\n";
+}
+
+void writeJsonDocument(const AST &tree, const Error &errors, const JsonOptions &options, DumpWriter &out)
+{
+    const Node &root = *tree.getRoot();
+    std::string_view name = tree.lexeme(root);
+    writeJsonHead(name, out);
+    writeJsonTree(root, *tree.getTokens(), name, options, out);
+    writeJsonTail(errors, out);
+}
+
+void writeJsonDocument(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &parse,
+                       const JsonOptions &options, DumpWriter &out)
+{
+    writeJsonHead(name, out);
+    JsonListener listener(options, name, out);
+    parseEvents(context, text, name, parse, listener);
+    writeJsonTail(context.error(), out);
+}
+
+void writeJsonDocument(const TreeFile &tree, std::string_view name, const JsonOptions &options, DumpWriter &out)
+{
+    Error errors;
+    tree.loadErrors(errors);
+    writeJsonHead(name, out);
+    writeJsonTree(tree, name, options, out);
+    writeJsonTail(errors, out);
+}
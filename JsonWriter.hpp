@@ -0,0 +1,43 @@
+#ifndef JSON_WRITER_HPP
+#define JSON_WRITER_HPP
+#include "AST.hpp"
+#include "TreeFile.hpp"
+
+// Parse trees as JSON, written while the tree is walked: nothing is built on
+// the way but one entry per level of nesting, and the text goes out through a
+// DumpWriter, so the output can be far larger than memory. A non-terminal is
+//   {"kind":"DECLARATION","children":[...]}
+// and a terminal
+//   {"kind":"ID","text":"x","line":3,"offset":12}
+// with offset left out for a token that was not read from the source.
+struct JsonOptions
+{
+    // leave out the brackets, braces, parentheses and the ',' ':' ';' '?'
+    // tokens, and write a non-terminal that has only one child left as that
+    // child
+    bool compact = false;
+};
+
+// writes text as the body of a JSON string; the runs that need no escaping
+// are copied whole, UTF-8 is copied as it is, and a byte that is not part of
+// a well-formed UTF-8 character is written as U+FFFD
+void writeJsonString(std::string_view text, DumpWriter &out);
+
+// the tree under root, whose leaves index tokens; name is the "file" of a
+// TRANSLATION_UNIT
+void writeJsonTree(const Node &root, const TokenStore &tokens, std::string_view name, const JsonOptions &options, DumpWriter &out);
+
+// the same from a tree file, where it lies
+void writeJsonTree(const TreeFile &tree, std::string_view name, const JsonOptions &options, DumpWriter &out);
+
+// one line: {"file":...,"tree":{...},"errors":[{"line":...,"kind":"lexical"|"grammar","message":...}]},
+// the errors last, as a parse that is written as it goes knows them only then
+void writeJsonDocument(const AST &tree, const Error &errors, const JsonOptions &options, DumpWriter &out);
+// the same, parsing text, named name, to events (see parseEvents) in context
+// and writing the tree as they come, so that memory follows the largest
+// declaration rather than the file
+void writeJsonDocument(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &parse,
+                       const JsonOptions &options, DumpWriter &out);
+// the same from a tree file and the errors it holds, under name
+void writeJsonDocument(const TreeFile &tree, std::string_view name, const JsonOptions &options, DumpWriter &out);
+#endif
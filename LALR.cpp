@@ -0,0 +1,299 @@
+#include "AST.hpp"
+#include <climits>
+
+// Table-driven LALR(1) engine. The ACTION/GOTO tables are generated from
+// grammar.y by table.cpp at build time; this file holds the driver loop and
+// the rules for turning reductions into the same Node shapes that the
+// recursive-descent parser builds.
+
+struct LalrRule
+{
+    TokenType lhs;
+    int16_t length;
+};
+struct LalrEntry
+{
+    int16_t state;
+    TokenType symbol;
+    int16_t value;
+};
+
+// ACTION encoding: 0 is a syntax error, a positive value shifts to state
+// value - 1, a negative value reduces by rule -value - 1
+constexpr int16_t LALR_ACCEPT = INT16_MAX;
+constexpr int16_t lalrShift(int state) { return state + 1; }
+constexpr int16_t lalrReduce(int rule) { return -(rule + 1); }
+
+#include "ParseTable.inc"
+
+// One row per state indexed by TokenType: ACTION for terminals and GOTO
+// (encoded as a shift) for non-terminals, so the loop does one lookup per step.
+using LalrRow = std::array<int16_t, TOKEN_TYPE_COUNT>;
+constexpr std::array<LalrRow, LALR_STATE_COUNT> buildParseTable()
+{
+    std::array<LalrRow, LALR_STATE_COUNT> table{};
+    for (const auto &e : LALR_ACTIONS)
+        table[e.state][static_cast<std::size_t>(e.symbol)] = e.value;
+    for (const auto &e : LALR_GOTOS)
+        table[e.state][static_cast<std::size_t>(e.symbol)] = lalrShift(e.value);
+    return table;
+}
+constexpr std::array<LalrRow, LALR_STATE_COUNT> PARSE_TABLE = buildParseTable();
+
+// grammar.y non-terminals the recursive-descent parser never builds; reducing
+// one passes its only child up unchanged
+static constexpr TokenSet transparentRules = {
+    TokenType::STORAGE_CLASS_SPECIFIER,
+    TokenType::TYPE_SPECIFIER,
+    TokenType::TYPE_QUALIFIER,
+    TokenType::FUNCTION_SPECIFIER,
+    TokenType::ASSIGNMENT_OPERATOR,
+    TokenType::UNARY_OPERATOR,
+    TokenType::STRUCT_OR_UNION};
+
+// recursive rules whose nesting the recursive-descent parser keeps; every other
+// rule splices a child of its own kind, so lists and left-associative
+// expressions come out flat
+static constexpr TokenSet nestedRules = {
+    TokenType::POINTER,
+    TokenType::UNARY_EXPRESSION,
+    TokenType::CAST_EXPRESSION,
+    TokenType::CONDITIONAL_EXPRESSION,
+    TokenType::ASSIGNMENT_EXPRESSION};
+
+// the identifier a declarator declares; a loop, as declarators nest as deep
+// as their parentheses
+static const Node *declaredIdentifier(const std::shared_ptr<Node> &declarator)
+{
+    const Node *current = declarator.get();
+    while (current)
+    {
+        const Node *inner = nullptr;
+        for (const auto &child : current->children)
+        {
+            if (child->type == TokenType::ID)
+                return child.get();
+            if (child->type == TokenType::DECLARATOR || child->type == TokenType::DIRECT_DECLARATOR)
+            {
+                inner = child.get();
+                break;
+            }
+        }
+        current = inner;
+    }
+    return nullptr;
+}
+
+void AST::declareTypedefNames(const std::shared_ptr<Node> &declaration)
+{
+    // declaration: declaration_specifiers init_declarator_list ';', where the
+    // recursive descent parser has not read the ';' yet
+    if (declaration->children.size() < 2 || declaration->children[0]->type != TokenType::DECLARATION_SPECIFIERS ||
+        declaration->children[1]->type != TokenType::INIT_DECLARATOR_LIST)
+        return;
+    bool isTypedef = false;
+    for (const auto &specifier : declaration->children[0]->children)
+        isTypedef = isTypedef || specifier->type == TokenType::TYPEDEF;
+    if (!isTypedef)
+        return;
+    for (const auto &initDeclarator : declaration->children[1]->children)
+    {
+        if (initDeclarator->type != TokenType::INIT_DECLARATOR)
+            continue;
+        if (const Node *name = declaredIdentifier(initDeclarator->children[0]))
+            defineTypeName(symbolTable[name->token].lexeme);
+    }
+}
+
+void AST::placeIncludes(NodeList &children, std::size_t before)
+{
+    for (; placedIncludes < tableIncludes.size() && tableIncludes[placedIncludes].first < before; placedIncludes++)
+        children.push_back(tableIncludes[placedIncludes].second);
+}
+
+void AST::deliverIncludes(std::size_t before)
+{
+    for (; placedIncludes < tableIncludes.size() && tableIncludes[placedIncludes].first < before; placedIncludes++)
+        deliver(tableIncludes[placedIncludes].second);
+    tableIncludes.erase(tableIncludes.begin(), tableIncludes.begin() + placedIncludes);
+    placedIncludes = 0;
+}
+
+void AST::runTable(std::vector<TableEntry> &stack, bool stopAtBody)
+{
+    TokenStore::iterator lookahead;
+    TokenType symbol = TokenType::END;
+    std::size_t position = stack.back().first;
+    bool haveLookahead = false;
+    auto readToken = [&]()
+    {
+        lookahead = getNextToken();
+        // #include lines are not part of grammar.y; they are parsed as they
+        // are read and placed between the external declarations they precede
+        while (lookahead->type == TokenType::INCLUDE)
+        {
+            tableIncludes.push_back({position++, includeStmt()});
+            lookahead = getNextToken();
+        }
+        position++;
+        // the typedef-name feedback: an ID names a type once a typedef declared it
+        symbol = lookahead->type;
+        if (symbol == TokenType::MAIN)
+            symbol = TokenType::ID;
+        else if (symbol == TokenType::ID && isTypeName(lookahead->lexeme))
+            symbol = TokenType::TYPEDEF_NAME;
+        haveLookahead = true;
+    };
+
+    while (true)
+    {
+        int16_t state = stack.back().state;
+        int16_t action = LALR_DEFAULT_REDUCTIONS[state] >= 0 ? lalrReduce(LALR_DEFAULT_REDUCTIONS[state]) : 0;
+        if (!action)
+        {
+            if (!haveLookahead)
+                readToken();
+            if (symbol == TokenType::END && stack.size() == 1)
+                break; // nothing but #include lines
+            if (lazyBodies && symbol == TokenType::L_CUR && LALR_BODY_STATES[state])
+            {
+                // a skipped body stands in for the COMPOUND_STATEMENT
+                auto body = skipBody(lookahead);
+                unparsedBodies[body.get()].tableState = state;
+                haveLookahead = false;
+                int16_t next = PARSE_TABLE[state][static_cast<std::size_t>(TokenType::COMPOUND_STATEMENT)];
+                stack.push_back({static_cast<int16_t>(next - 1), body, position - 1});
+                continue;
+            }
+            action = PARSE_TABLE[state][static_cast<std::size_t>(symbol)];
+        }
+
+        if (action == LALR_ACCEPT)
+            break;
+        if (action > 0)
+        {
+            stack.push_back({static_cast<int16_t>(action - 1), leaf(lookahead), position - 1});
+            haveLookahead = false;
+            // the stack is the nesting of the table engine
+            if (budget.depth && stack.size() > budget.depth)
+            {
+                exceed(Budget::Depth, true);
+                break;
+            }
+        }
+        else if (action < 0)
+        {
+            const LalrRule &rule = LALR_RULES[-action - 1];
+            std::size_t base = stack.size() - rule.length;
+            std::shared_ptr<Node> ret;
+            bool delivered = listener && rule.lhs == TokenType::TRANSLATION_UNIT;
+            if (transparentRules.contains(rule.lhs))
+                ret = stack[base].node;
+            else if (delivered)
+            {
+                // with a listener the translation unit stays empty: each
+                // external declaration reduced into it is handed out instead,
+                // after the #include lines before it
+                if (stack[base].node->type == TokenType::TRANSLATION_UNIT)
+                    ret = stack[base].node;
+                else
+                    ret = std::make_shared<Node>(TokenType::TRANSLATION_UNIT);
+                for (std::size_t i = base; i < stack.size(); i++)
+                    if (stack[i].node->type == TokenType::EXTERNAL_DECLARATION)
+                    {
+                        deliverIncludes(stack[i].first);
+                        deliver(stack[i].node);
+                    }
+            }
+            else
+            {
+                bool splice = !nestedRules.contains(rule.lhs);
+                std::size_t i = base;
+                // a list that grows on the left goes on growing in place, so a
+                // long list is not copied again at every reduction
+                if (splice && stack[base].node->type == rule.lhs && stack[base].node.use_count() == 1)
+                    ret = std::move(stack[i++].node);
+                else
+                {
+                    Node stmt(rule.lhs);
+                    ret = makeNode(std::move(stmt));
+                }
+                for (; i < stack.size(); i++)
+                {
+                    auto &child = stack[i].node;
+                    if (rule.lhs == TokenType::TRANSLATION_UNIT && child->type == TokenType::EXTERNAL_DECLARATION)
+                        placeIncludes(ret->children, stack[i].first);
+                    if (splice && child->type == rule.lhs)
+                        ret->children.insert(ret->children.end(), std::make_move_iterator(child->children.begin()), std::make_move_iterator(child->children.end()));
+                    else
+                        ret->children.push_back(std::move(child));
+                }
+                if (rule.lhs == TokenType::DECLARATION)
+                    declareTypedefNames(ret);
+            }
+            std::size_t first = stack[base].first;
+            stack.resize(base);
+            int16_t next = PARSE_TABLE[stack.back().state][static_cast<std::size_t>(rule.lhs)];
+            stack.push_back({static_cast<int16_t>(next - 1), ret, first});
+            // #include lines read ahead still hold their nodes and tokens
+            if (delivered && tableIncludes.empty())
+                releaseDelivered();
+            if (stopAtBody && base == 1 && rule.lhs == TokenType::COMPOUND_STATEMENT)
+                break;
+        }
+        else
+        {
+            if (symbol == TokenType::END)
+                loggedError.addGrammarError(lookahead->lineNo, "Unexpected end of file");
+            else
+                loggedError.addGrammarError(lookahead->lineNo, "Unexpected '" + lookahead->lexeme + "'");
+            break;
+        }
+    }
+}
+
+std::shared_ptr<Node> AST::parsingTable(std::shared_ptr<Node> root)
+{
+    std::vector<TableEntry> stack;
+    stack.reserve(256);
+    stack.push_back({0, nullptr, 0});
+    runTable(stack, false);
+
+    // after accepting, the stack holds the translation unit; after an error,
+    // whatever was reduced so far is kept as a partial tree
+    for (std::size_t i = 1; i < stack.size(); i++)
+    {
+        auto &node = stack[i].node;
+        if (node->type == TokenType::TRANSLATION_UNIT)
+            root->children.insert(root->children.end(), node->children.begin(), node->children.end());
+        else if (listener)
+            deliver(node);
+        else
+            root->children.push_back(node);
+    }
+    if (listener)
+        deliverIncludes(SIZE_MAX);
+    else
+        placeIncludes(root->children, SIZE_MAX);
+    return root;
+}
+
+std::shared_ptr<Node> AST::tableBody(TokenStore::iterator begin, int16_t state)
+{
+    // restart the tables in the state that was about to read the body; the
+    // COMPOUND_STATEMENT is reduced right above it
+    std::vector<TableEntry> stack;
+    stack.push_back({state, nullptr, 0});
+    currentToken = std::prev(begin);
+    bool lazy = lazyBodies;
+    lazyBodies = false;
+    runTable(stack, true);
+    lazyBodies = lazy;
+    if (stack.size() == 2 && stack[1].node->type == TokenType::COMPOUND_STATEMENT)
+        return stack[1].node;
+    Node stmt(TokenType::COMPOUND_STATEMENT);
+    std::shared_ptr<Node> ret = makeNode(std::move(stmt));
+    for (std::size_t i = 1; i < stack.size(); i++)
+        ret->children.push_back(stack[i].node);
+    return ret;
+}
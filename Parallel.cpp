@@ -0,0 +1,207 @@
+#include "AST.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+// Parallel parsing of one file. A sequential pre-pass lexes the whole file and
+// cuts the token stream at the end of every top-level declaration by bracket
+// depth: a ';' at depth 0, or the '}' closing a function body (a '{' opened at
+// depth 0 right after a ')'). It also reads the typedef names a declaration
+// declares off its tokens. Every declaration is then parsed on a thread pool,
+// each seeing the typedef names of the declarations before it, and the
+// subtrees are put back under TRANSLATION_UNIT in source order.
+//
+// The tokens are laid out again with an END after every declaration, so that
+// each one is parsed from a window of the one store and the leaves of every
+// subtree index the store of the whole file.
+//
+// From the first declaration that fails, with a syntax error (a cut in the
+// wrong place: a K&R parameter declaration, a missing ';') or with typedef
+// names other than those read off its tokens, the rest of the file is parsed
+// again sequentially, so that the diagnostics are the ones the sequential
+// parser gives and every declaration sees the right names.
+
+struct Segment
+{
+    uint32_t first = 0; // window [first, last) of the store, END last
+    uint32_t last = 0;
+    std::vector<std::string> expected; // the typedef names read off its tokens, sorted
+    std::vector<std::string> typeNames; // those its parse declared, in order
+    Error error;
+    NodeList nodes;
+};
+
+// The typedef names a declaration declares, read off its tokens [begin, end)
+// without parsing it: if a typedef is among its specifiers, the last
+// identifier of each declarator outside braces, parameter lists and array
+// sizes. The parse of the declaration checks the guess.
+static std::vector<std::string> readTypeNames(TokenStore::iterator begin, TokenStore::iterator end)
+{
+    std::vector<std::string> names;
+    bool isTypedef = false;
+    int braces = 0;
+    // the open '(' and '[', each true when what is inside is skipped
+    std::vector<bool> brackets;
+    int skipped = 0;
+    const std::string *last = nullptr;
+    TokenType prev = TokenType::END;
+    for (; begin != end; prev = begin->type, ++begin)
+    {
+        TokenType type = begin->type;
+        if (braces > 0)
+        {
+            braces += type == TokenType::L_CUR ? 1 : type == TokenType::R_CUR ? -1 : 0;
+            continue;
+        }
+        if (type == TokenType::L_CUR)
+            braces++;
+        else if (type == TokenType::L_BR || type == TokenType::L_SQR)
+        {
+            // a '(' right after a name or a ')' opens a parameter list
+            bool skip = type == TokenType::L_SQR || prev == TokenType::ID || prev == TokenType::R_BR;
+            brackets.push_back(skip);
+            skipped += skip;
+        }
+        else if ((type == TokenType::R_BR || type == TokenType::R_SQR) && !brackets.empty())
+        {
+            skipped -= brackets.back();
+            brackets.pop_back();
+        }
+        else if (type == TokenType::TYPEDEF && brackets.empty())
+            isTypedef = true;
+        else if (type == TokenType::ID && skipped == 0)
+            last = &begin->lexeme;
+        else if ((type == TokenType::COMMA || type == TokenType::SEMI_COLON) && brackets.empty())
+        {
+            if (isTypedef && last)
+                names.push_back(*last);
+            last = nullptr;
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
+TokenStore::iterator AST::declarationEnd(TokenStore::iterator itr, bool &introducesTypedef, bool &complete)
+{
+    introducesTypedef = false;
+    complete = true;
+    if (itr->type == TokenType::INCLUDE)
+    {
+        // INCLUDE, the opening quote or '<', the path and the closing one
+        for (int i = 0; i < 4 && itr->type != TokenType::END; i++)
+            ++itr;
+        return itr;
+    }
+    int depth = 0;
+    bool functionBody = false;
+    TokenType prev = TokenType::END;
+    for (; itr->type != TokenType::END; prev = itr->type, ++itr)
+    {
+        TokenType type = itr->type;
+        if (type == TokenType::TYPEDEF)
+            introducesTypedef = true;
+        if (type == TokenType::L_BR || type == TokenType::L_SQR)
+            depth++;
+        else if (type == TokenType::R_BR || type == TokenType::R_SQR)
+            depth--;
+        else if (type == TokenType::L_CUR)
+        {
+            if (depth == 0 && prev == TokenType::R_BR)
+                functionBody = true;
+            depth++;
+        }
+        else if (type == TokenType::R_CUR)
+        {
+            if (--depth == 0 && functionBody)
+                return ++itr;
+        }
+        else if (type == TokenType::SEMI_COLON && depth == 0)
+            return ++itr;
+    }
+    complete = false;
+    return itr;
+}
+
+std::shared_ptr<Node> AST::parsingParallel(std::shared_ptr<Node> root, const ParseOptions &options)
+{
+    lexAll();
+
+    std::vector<Segment> segments;
+    TokenStore laidOut;
+    Token endToken = symbolTable.back();
+    TypeNameIndex expected;
+    auto itr = symbolTable.begin();
+    while (itr != symbolTable.end() && itr->type != TokenType::END)
+    {
+        auto begin = itr;
+        bool introducesTypedef, complete;
+        itr = declarationEnd(itr, introducesTypedef, complete);
+        segments.emplace_back();
+        Segment &segment = segments.back();
+        if (introducesTypedef)
+            segment.expected = readTypeNames(begin, itr);
+        for (const auto &name : segment.expected)
+            expected.emplace(name, segments.size() - 1);
+        segment.first = laidOut.size();
+        for (; begin != itr; ++begin)
+            laidOut.push_back(std::move(*begin));
+        laidOut.push_back(endToken);
+        segment.last = laidOut.size();
+    }
+    laidOut.push_back(endToken);
+    symbolTable = std::move(laidOut);
+    currentToken = tokenEnd();
+
+    {
+        ThreadPool pool(options.threads);
+        for (std::size_t i = 0; i < segments.size(); i++)
+            pool.submit([&, i]()
+                        {
+                Segment &segment = segments[i];
+                AST part(store, segment.first, segment.last, segment.error, options.engine, &expected, i);
+                segment.nodes = std::move(part.root->children);
+                segment.typeNames = std::move(part.typeNameOrder); });
+        pool.wait();
+    }
+
+    // the declarations before the first that fails were parsed as the
+    // sequential parser would; one whose names were not those expected was
+    // too, but not those after it
+    std::size_t failed = segments.size();
+    for (std::size_t i = 0; i < segments.size() && failed == segments.size(); i++)
+    {
+        std::vector<std::string> declared = segments[i].typeNames;
+        std::sort(declared.begin(), declared.end());
+        if (segments[i].error.hasErrors())
+            failed = i;
+        else if (declared != segments[i].expected)
+            failed = i + 1;
+    }
+    TypeNameIndex typeNames;
+    for (std::size_t i = 0; i < failed; i++)
+    {
+        root->children.insert(root->children.end(), segments[i].nodes.begin(), segments[i].nodes.end());
+        for (const auto &name : segments[i].typeNames)
+        {
+            typeNames.emplace(name, i);
+            defineTypeName(name);
+        }
+    }
+    if (failed == segments.size())
+        return root;
+
+    // the rest is laid out again in place, without the ENDs between the
+    // declarations, and parsed as one
+    uint32_t first = segments[failed].first, to = first;
+    for (std::size_t i = failed; i < segments.size(); i++)
+        for (uint32_t j = segments[i].first; j + 1 < segments[i].last; j++)
+            symbolTable[to++] = std::move(symbolTable[j]);
+    symbolTable[to++] = endToken;
+    symbolTable.truncate(to);
+    AST rest(store, first, to, loggedError, options.engine, &typeNames, failed);
+    root->children.insert(root->children.end(), rest.root->children.begin(), rest.root->children.end());
+    for (const auto &name : rest.typeNameOrder)
+        defineTypeName(name);
+    return root;
+}
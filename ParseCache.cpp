@@ -0,0 +1,150 @@
+#include "ParseCache.hpp"
+#include "FlatTree.hpp"
+#include "Hash.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+
+std::string ParseCache::entryPath(uint64_t key) const
+{
+    return directory + "/" + hexHash(key) + ".tree";
+}
+
+bool ParseCache::open(const std::string &at, uint64_t room, std::string &why)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    directory = at;
+    capacity = room;
+    recent.clear();
+    entries.clear();
+    total = 0;
+    std::error_code failed;
+    std::filesystem::create_directories(directory, failed);
+    if (failed)
+    {
+        why = "cannot create " + directory;
+        return false;
+    }
+    // the entries already there, newest first
+    struct Found
+    {
+        Entry entry;
+        std::filesystem::file_time_type modified;
+    };
+    std::vector<Found> found;
+    for (const auto &file : std::filesystem::directory_iterator(directory, failed))
+    {
+        std::string name = file.path().filename().string();
+        std::error_code unreadable;
+        auto modified = file.last_write_time(unreadable);
+        // what a writer that died left behind
+        if (name.find(".tree.tmp.") != std::string::npos && !unreadable &&
+            modified < std::filesystem::file_time_type::clock::now() - std::chrono::hours(1))
+            std::filesystem::remove(file.path(), unreadable);
+        uint64_t key;
+        if (name.size() != 21 || !name.ends_with(".tree") ||
+            std::from_chars(name.data(), name.data() + 16, key, 16).ptr != name.data() + 16)
+            continue;
+        uint64_t bytes = file.file_size(unreadable);
+        if (!unreadable)
+            found.push_back({{key, bytes}, modified});
+    }
+    std::sort(found.begin(), found.end(), [](const Found &a, const Found &b)
+              { return a.modified > b.modified; });
+    for (const auto &entry : found)
+    {
+        recent.push_back(entry.entry);
+        entries[entry.entry.key] = std::prev(recent.end());
+        total += entry.entry.bytes;
+    }
+    evict();
+    return true;
+}
+
+uint64_t ParseCache::key(std::string_view text, const ParseOptions &options)
+{
+    // everything but the text that decides what a parse gives
+    uint64_t environment[] = {
+        TREE_FILE_VERSION,
+        static_cast<uint64_t>(options.engine),
+        options.lazyBodies,
+        options.budget.tokens,
+        options.budget.depth,
+        options.budget.nodes,
+        options.budget.macroTokens};
+    uint64_t seed = hashBytes(std::string_view(reinterpret_cast<const char *>(environment), sizeof(environment)));
+    return hashBytes(text, seed);
+}
+
+void ParseCache::use(uint64_t key, uint64_t bytes)
+{
+    auto at = entries.find(key);
+    if (at != entries.end())
+    {
+        total -= at->second->bytes;
+        recent.erase(at->second);
+    }
+    recent.push_front({key, bytes});
+    entries[key] = recent.begin();
+    total += bytes;
+}
+
+void ParseCache::drop(uint64_t key)
+{
+    std::error_code failed;
+    std::filesystem::remove(entryPath(key), failed);
+    auto at = entries.find(key);
+    if (at == entries.end())
+        return;
+    total -= at->second->bytes;
+    recent.erase(at->second);
+    entries.erase(at);
+}
+
+void ParseCache::evict()
+{
+    while (total > capacity && !recent.empty())
+        drop(recent.back().key);
+}
+
+std::unique_ptr<TreeFile> ParseCache::find(uint64_t key)
+{
+    std::string path = entryPath(key);
+    auto tree = std::make_unique<TreeFile>();
+    std::string why;
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+    {
+        misses++;
+        return nullptr;
+    }
+    if (!tree->open(path, why))
+    {
+        // damaged, or of another version: parsed again and stored over
+        misses++;
+        std::lock_guard<std::mutex> guard(lock);
+        drop(key);
+        return nullptr;
+    }
+    // the time of last use, for the caches of other processes
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    hits++;
+    std::lock_guard<std::mutex> guard(lock);
+    use(key, status.st_size);
+    return tree;
+}
+
+bool ParseCache::store(uint64_t key, const AST &tree, const Error &errors)
+{
+    FlatTree flat(*tree.getRoot(), tree.getTokens());
+    std::string path = entryPath(key);
+    struct stat status;
+    if (!saveTreeFile(flat, tree.lexeme(*tree.getRoot()), &errors, path) || stat(path.c_str(), &status) != 0)
+        return false;
+    std::lock_guard<std::mutex> guard(lock);
+    use(key, status.st_size);
+    evict();
+    return true;
+}
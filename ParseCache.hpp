@@ -0,0 +1,70 @@
+#ifndef PARSE_CACHE_HPP
+#define PARSE_CACHE_HPP
+#include "AST.hpp"
+#include "TreeFile.hpp"
+#include <list>
+#include <mutex>
+
+// Parse results kept on disk, so that a file parsed before with the same
+// options is read back instead of parsed again. An entry is a tree file (see
+// TreeFile.hpp), tokens, tree and errors, named by a key that hashes the
+// source text together with everything else that decides the result: the
+// options and the tree file version. The text is the whole input, since
+// macros are defined in it and #include lines are kept, not read. A hit is
+// mapped where it lies.
+//
+// Many threads, and many processes, can share one directory. Entries are
+// written under a temporary name and renamed into place, so a reader finds
+// a whole entry or none. Each cache keeps its entries in least recently used
+// order, seeded from their modification times when it is opened and touched
+// on every hit, and deletes the oldest once the entries add up to more than
+// its capacity; with several processes the cap holds for what each of them
+// knows about.
+class ParseCache
+{
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t bytes;
+    };
+    std::string directory;
+    uint64_t capacity = DEFAULT_CAPACITY;
+    std::mutex lock;
+    // most recently used first
+    std::list<Entry> recent;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+    uint64_t total = 0;
+    std::atomic<uint64_t> hits = 0, misses = 0;
+
+    std::string entryPath(uint64_t key) const;
+    // records key as the most recently used entry; with the lock held
+    void use(uint64_t key, uint64_t bytes);
+    // deletes the entry of key and forgets it; with the lock held
+    void drop(uint64_t key);
+    // drops the least recently used entries until they fit; with the lock held
+    void evict();
+
+public:
+    static constexpr uint64_t DEFAULT_CAPACITY = uint64_t(1) << 30;
+
+    // uses directory, created when missing, with room for capacity bytes;
+    // false, with the reason in why, when it cannot be created
+    bool open(const std::string &directory, uint64_t capacity, std::string &why);
+
+    // whether parses with options can be cached: not when a time limit can
+    // cut them short at a different place on every run
+    static inline bool cacheable(const ParseOptions &options) { return options.budget.time.count() == 0; }
+    // the key of text parsed with options
+    static uint64_t key(std::string_view text, const ParseOptions &options);
+
+    // the entry of key mapped, or nullptr on a miss; an entry that does not
+    // open as a tree file is deleted and counts as a miss
+    std::unique_ptr<TreeFile> find(uint64_t key);
+    // adds the result of a parse under key; false when it cannot be written
+    bool store(uint64_t key, const AST &tree, const Error &errors);
+
+    inline uint64_t hitCount() const { return hits; }
+    inline uint64_t missCount() const { return misses; }
+};
+#endif
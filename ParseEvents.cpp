@@ -0,0 +1,95 @@
+#include "ParseEvents.hpp"
+#include "TreeWalk.hpp"
+
+void AST::deliver(const std::shared_ptr<Node> &node)
+{
+    // the range of every non-terminal is known only once its last token is;
+    // find them all first, in preorder, then hand the nodes out
+    replayRanges.clear();
+    auto measure = [&](const Node &n, std::size_t, bool)
+    {
+        SourceRange range;
+        if (!isNonterminal(n.type))
+            range = {n.token, n.token};
+        else if (n.type == TokenType::UNPARSED_BODY)
+        {
+            auto body = unparsedBodies.find(&n);
+            if (body != unparsedBodies.end())
+                range = {body->second.tokens.begin.index(), std::prev(body->second.tokens.end).index()};
+        }
+        replayOpen.push_back(replayRanges.size());
+        replayRanges.push_back(range);
+        return isNonterminal(n.type);
+    };
+    auto measured = [&](const Node &)
+    {
+        SourceRange done = replayRanges[replayOpen.back()];
+        replayOpen.pop_back();
+        if (replayOpen.empty() || done.first == Node::NO_TOKEN)
+            return;
+        SourceRange &parent = replayRanges[replayOpen.back()];
+        if (parent.first == Node::NO_TOKEN)
+            parent.first = done.first;
+        parent.last = done.last;
+    };
+    walkTree(*node, measure, measured);
+
+    std::size_t next = 0;
+    auto enter = [&](const Node &n, std::size_t, bool)
+    {
+        const SourceRange &range = replayRanges[next++];
+        if (!isNonterminal(n.type))
+        {
+            if (n.token != Node::NO_TOKEN)
+                listener->onToken(symbolTable[n.token], n.token);
+            return false;
+        }
+        listener->onEnter(n.type, range);
+        return true;
+    };
+    auto leave = [&](const Node &n)
+    {
+        if (isNonterminal(n.type))
+            listener->onExit(n.type);
+    };
+    walkTree(*node, enter, leave);
+}
+
+void AST::releaseDelivered()
+{
+    unparsedBodies.clear();
+    if (arena && arena->idle())
+        arena->rewind();
+    // a block of tokens is kept behind the current one, for the parser's
+    // look back
+    if (!listener->keepsTokens() && currentToken != tokenEnd() && currentToken.index() > TokenStore::BLOCK)
+        symbolTable.release(currentToken.index() - TokenStore::BLOCK);
+}
+
+void TreeBuilder::onEnter(TokenType kind, SourceRange range)
+{
+    // an UNPARSED_BODY names its '{'
+    auto node = std::make_shared<Node>(kind, kind == TokenType::UNPARSED_BODY ? range.first : Node::NO_TOKEN);
+    if (open.empty())
+        root = node;
+    else
+        open.back()->children.push_back(node);
+    open.push_back(node.get());
+}
+
+void TreeBuilder::onToken(const Token &token, uint32_t index)
+{
+    open.back()->children.push_back(std::make_shared<Node>(token.type, index));
+}
+
+void KindCounter::print(DumpWriter &out) const
+{
+    for (std::size_t kind = 0; kind < TOKEN_TYPE_COUNT; kind++)
+        if (counts[kind])
+            out << TokenToString::name(static_cast<TokenType>(kind)) << '\t' << counts[kind] << '\n';
+}
+
+void parseEvents(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options, ParseListener &listener)
+{
+    AST events(context, text, name, options, listener);
+}
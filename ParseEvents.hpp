@@ -0,0 +1,66 @@
+#ifndef PARSE_EVENTS_HPP
+#define PARSE_EVENTS_HPP
+#include "AST.hpp"
+#include "DumpWriter.hpp"
+#include <array>
+
+// The parse of a file as a stream of events, for jobs that count or collect
+// and need no tree. Each top-level declaration is parsed by the engine the
+// options choose and then handed to the listener, in preorder: onEnter for a
+// non-terminal, onToken for each of its terminals and the non-terminals in
+// it, onExit when it ends. The whole file is one TRANSLATION_UNIT around
+// them. Once the listener has had a declaration its nodes are gone and the
+// arena they came from is used again, so memory follows the largest
+// declaration rather than the size of the file, and after the first few
+// declarations a parse allocates next to nothing.
+class ParseListener
+{
+public:
+    virtual ~ParseListener() = default;
+    // a non-terminal begins; range is its tokens, empty (NO_TOKEN) when it has
+    // none and for the TRANSLATION_UNIT
+    virtual void onEnter(TokenType kind, SourceRange range) {}
+    virtual void onExit(TokenType kind) {}
+    // a terminal; index is its place in the token store
+    virtual void onToken(const Token &token, uint32_t index) {}
+    // whether the tokens must stay in the store after their declaration has
+    // been handed out; by default they are released and their indices are
+    // good only during the calls
+    virtual bool keepsTokens() const { return false; }
+};
+
+// Builds, from the events, the tree the AST would have built.
+class TreeBuilder : public ParseListener
+{
+private:
+    std::shared_ptr<Node> root;
+    std::vector<Node *> open;
+
+public:
+    void onEnter(TokenType kind, SourceRange range) override;
+    void onExit(TokenType) override { open.pop_back(); }
+    void onToken(const Token &token, uint32_t index) override;
+    bool keepsTokens() const override { return true; }
+    inline const std::shared_ptr<Node> &getRoot() const { return root; }
+};
+
+// Counts the nodes of each kind.
+class KindCounter : public ParseListener
+{
+private:
+    std::array<uint64_t, TOKEN_TYPE_COUNT> counts{};
+
+public:
+    void onEnter(TokenType kind, SourceRange) override { counts[static_cast<std::size_t>(kind)]++; }
+    void onToken(const Token &token, uint32_t) override { counts[static_cast<std::size_t>(token.type)]++; }
+    inline uint64_t count(TokenType kind) const { return counts[static_cast<std::size_t>(kind)]; }
+    // counts n more nodes of kind, found some other way than by events
+    inline void add(TokenType kind, uint64_t n = 1) { counts[static_cast<std::size_t>(kind)] += n; }
+    // "KIND<tab>count", one line for each kind that occurs
+    void print(DumpWriter &out) const;
+};
+
+// parses text, named name, in context (see AST) and hands it to listener;
+// options.threads is ignored
+void parseEvents(ParserContext &context, std::string_view text, const std::string &name, const ParseOptions &options, ParseListener &listener);
+#endif
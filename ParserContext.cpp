@@ -0,0 +1,86 @@
+#include "ParserContext.hpp"
+#include "Scanner.hpp"
+#include <algorithm>
+#include <fstream>
+
+void *NodeArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    references.fetch_add(1, std::memory_order_relaxed);
+    std::size_t start = (used + alignment - 1) & ~(alignment - 1);
+    if (current == chunks.size() || start + bytes > chunks[current].size)
+    {
+        // the next chunk, kept from an earlier file or new; a kept one too
+        // small for this allocation is replaced, since nothing is in it
+        if (current < chunks.size())
+            current++;
+        std::size_t size = std::max(chunkSize, bytes);
+        if (current == chunks.size())
+            chunks.push_back({std::make_unique<char[]>(size), size});
+        else if (chunks[current].size < bytes)
+            chunks[current] = {std::make_unique<char[]>(size), size};
+        start = 0;
+    }
+    used = start + bytes;
+    return chunks[current].data.get() + start;
+}
+
+void NodeArena::release()
+{
+    if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+}
+
+ParserContext::ParserContext(std::size_t chunkSize) : arena(new NodeArena(chunkSize)), chunkSize(chunkSize)
+{
+}
+
+ParserContext::~ParserContext()
+{
+    arena->release();
+}
+
+void ParserContext::reset()
+{
+    if (arena->idle())
+        arena->rewind();
+    else
+    {
+        arena->release();
+        arena = new NodeArena(chunkSize);
+    }
+    errors.clear();
+}
+
+std::string_view ParserContext::load(const std::string &path)
+{
+    text.clear();
+    if (!hasSourceExtension(path))
+    {
+        errors.addError(0, EXTENSION_ERROR);
+        return text;
+    }
+    std::ifstream file(path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+    if (!file)
+    {
+        errors.addError(0, OPEN_ERROR);
+        return text;
+    }
+    // read into the buffer the last file left, which keeps its capacity
+    text.resize(file.tellg());
+    file.seekg(0);
+    file.read(text.data(), text.size());
+    text.resize(file.gcount());
+    return text;
+}
+
+std::shared_ptr<TokenStore> ParserContext::store()
+{
+    for (const auto &candidate : stores)
+        if (candidate.use_count() == 1)
+        {
+            candidate->clear();
+            return candidate;
+        }
+    stores.push_back(std::make_shared<TokenStore>());
+    return stores.back();
+}
@@ -0,0 +1,101 @@
+#ifndef PARSER_CONTEXT_HPP
+#define PARSER_CONTEXT_HPP
+#include "Error.hpp"
+#include "Token.hpp"
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for the nodes of the trees parsed in one ParserContext. A
+// node is never freed on its own; the arena counts the nodes still alive, plus
+// one for the context that owns it, and is rewound for the next file only when
+// the count is back to one. A context that has to move on while a tree is
+// still held lets go of the arena instead, and the last node to die deletes
+// it. Only the owning thread allocates; nodes may die on any thread. The child
+// lists of the nodes take their memory from it as a memory_resource.
+class NodeArena : public std::pmr::memory_resource
+{
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t size; // chunkSize, or more for a larger allocation
+    };
+    std::vector<Chunk> chunks;
+    std::size_t chunkSize;
+    std::size_t current = 0; // the chunk being filled
+    std::size_t used = 0;    // bytes of it handed out
+    std::atomic<std::size_t> references = 1;
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    inline void do_deallocate(void *, std::size_t, std::size_t) override { release(); }
+    inline bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+public:
+    explicit NodeArena(std::size_t chunkSize) : chunkSize(chunkSize) {}
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    // drops one reference, a node or the owner's; the last one deletes the arena
+    void release();
+    // whether only the owner holds the arena
+    inline bool idle() const { return references.load(std::memory_order_acquire) == 1; }
+    // hands the chunks out again from the start; only when idle
+    inline void rewind() { current = used = 0; }
+};
+
+// std::allocate_shared allocator that takes memory from a NodeArena
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+    NodeArena *arena;
+
+    explicit ArenaAllocator(NodeArena *arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+    inline T *allocate(std::size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    inline void deallocate(T *p, std::size_t n) { arena->deallocate(p, n * sizeof(T), alignof(T)); }
+    template <typename U>
+    inline bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+};
+
+// What parsing one file after another on one thread can keep from file to
+// file: the node arena, the token stores, the buffer the source is read into
+// and the Error sink. Create one per worker and call reset() before each
+// file; after the first few files the buffers have grown to size and a file
+// costs few allocations beyond the lexemes too long to fit in a std::string.
+// A context is not shared between threads.
+class ParserContext
+{
+private:
+    NodeArena *arena;
+    std::size_t chunkSize;
+    std::vector<std::shared_ptr<TokenStore>> stores;
+    std::string text;
+    Error errors;
+
+public:
+    static constexpr std::size_t DEFAULT_CHUNK = 1 << 20;
+
+    explicit ParserContext(std::size_t chunkSize = DEFAULT_CHUNK);
+    ParserContext(const ParserContext &) = delete;
+    ParserContext &operator=(const ParserContext &) = delete;
+    ~ParserContext();
+
+    // forgets the last file: the arena is rewound (or replaced, when a tree
+    // from it is still held), the errors are cleared
+    void reset();
+    // reads the file at path into the text buffer, logging to error() and
+    // leaving it empty when the extension is wrong or it cannot be read
+    std::string_view load(const std::string &path);
+    // an empty token store, one no tree holds any more when there is one
+    std::shared_ptr<TokenStore> store();
+
+    inline NodeArena *nodes() { return arena; }
+    inline Error &error() { return errors; }
+};
+#endif
@@ -2,20 +2,129 @@
 #define MODIFIED
 Scanner::Scanner(const std::string &path, Error &e) : lineNo(1), loggedError(e)
 {
-
-    if (path.substr(path.size() - strlen(EXTENSION), strlen(EXTENSION)) != EXTENSION)
+    end = false;
+    pathToFile = path;
+    currentToken = tokenEnd();
+    buffer.reset(source);
+    // either failure leaves the source empty, so that there is nothing to lex
+    if (!hasSourceExtension(path))
+    {
+        loggedError.addError(0, EXTENSION_ERROR);
+        return;
+    }
+    std::ifstream file(path, std::ifstream::in | std::ifstream::binary);
+    if (!file)
     {
-        std::cerr << "The extension of file should be " << EXTENSION << std::endl;
-        exit(1);
+        loggedError.addError(0, OPEN_ERROR);
+        return;
     }
+    std::stringstream content;
+    content << file.rdbuf();
+    fileText = content.str();
+    source = fileText;
+    buffer.reset(source);
+}
+
+Scanner::Scanner(std::string_view text, Error &e, int firstLine, int firstOffset)
+    : lineNo(firstLine), source(text), sourceOffset(firstOffset), loggedError(e)
+{
+    end = false;
+    buffer.reset(source);
+    currentToken = tokenEnd();
+}
+
+Scanner::Scanner(std::string_view text, const std::string &name, Error &e, std::shared_ptr<TokenStore> tokens)
+    : store(tokens ? std::move(tokens) : std::make_shared<TokenStore>()), lineNo(1), source(text), loggedError(e)
+{
+    end = false;
+    buffer.reset(source);
+    pathToFile = name;
+    currentToken = tokenEnd();
+}
+
+Scanner::Scanner(std::shared_ptr<TokenStore> tokens, uint32_t first, uint32_t last, Error &e)
+    : store(std::move(tokens)), symbolTable(*store), windowBegin(first), windowEnd(last), loggedError(e)
+{
+    lineNo = symbolTable[last - 1].lineNo;
+    end = true;
+    currentToken = tokenEnd();
+}
+
+void Scanner::lexAll()
+{
+    while (!end)
+        appendList(symbolTable);
+}
+
+std::shared_ptr<TokenStore> Scanner::takeTokens()
+{
+    lexAll();
+    return store;
+}
+
+void Scanner::rewind()
+{
+    inputFile.clear();
+    buffer.reset(source);
+    symbolTable.clear();
+    definedMacro.clear();
+    currentToken = tokenEnd();
+    lineNo = 1;
     end = false;
-    std::string buffer;
-    inputFile.open(path, std::ifstream::in);
-    TokenToString tokenToString;
-    currentToken = symbolTable.end();
 }
 
-void Scanner::appendList(std::list<Token> &list)
+std::size_t Scanner::tokenStart()
+{
+    // the token starts after any blanks and comments in front of it
+    std::size_t start = buffer.position();
+    while (start < source.size())
+    {
+        if (isspace(source[start]) || source[start] == '\\')
+            start++;
+        else if (source.compare(start, 2, "//") == 0)
+            start = std::min(source.find('\n', start), source.size());
+        else if (source.compare(start, 2, "/*") == 0)
+            start = std::min(source.find("*/", start + 2), source.size() - 2) + 2;
+        else
+            break;
+    }
+    return start;
+}
+
+void Scanner::appendList(TokenStore &tokens)
+{
+    std::size_t start = tokenStart();
+    uint32_t first = tokens.size();
+    // lexToken writes #include tokens to the store directly, and may read
+    // further tokens into it, before it returns what it read into the list
+    TokenList read(&listNodes);
+    lexToken(read);
+    for (auto &t : read)
+        tokens.push_back(std::move(t));
+    for (uint32_t i = first; i < tokens.size(); i++)
+        if (tokens[i].offset < 0 && tokens[i].type != TokenType::END)
+            tokens[i].offset = sourceOffset + start;
+    if (budgeted && !end)
+    {
+        if (cutPending)
+            exceed(Budget::MacroTokens, false);
+        else if (budget.tokens && tokens.size() >= budget.tokens)
+            exceed(Budget::Tokens, false);
+    }
+}
+
+void Scanner::appendList(TokenList &list)
+{
+    std::size_t start = tokenStart();
+    auto last = list.empty() ? list.end() : std::prev(list.end());
+    lexToken(list);
+    // tokens a nested call (after a comment) already stamped keep their offset
+    for (auto itr = last == list.end() ? list.begin() : std::next(last); itr != list.end(); ++itr)
+        if (itr->offset < 0 && itr->type != TokenType::END)
+            itr->offset = sourceOffset + start;
+}
+
+void Scanner::lexToken(TokenList &list)
 {
     char ch;
     Operator op;
@@ -23,7 +132,8 @@ void Scanner::appendList(std::list<Token> &list)
     Symbol s;
     if (end)
         return;
-    if (inputFile.eof())
+    // peeking catches the end of an empty source on the first call too
+    if (inputFile.peek() == std::char_traits<char>::eof())
     {
         list.push_back(Token(TokenType::END, "", lineNo));
         end = true;
@@ -309,6 +419,9 @@ void Scanner::appendList(std::list<Token> &list)
                             if (isDefinedMacro(temp) && (op.beginOperator(peeked) || s.isSymbol(peeked) || isspace(peeked)))
                             {
                                 auto macro = getDefinedMacro(temp);
+                                expandedTokens += macro->second.tokens.size();
+                                if (budget.macroTokens && expandedTokens > budget.macroTokens)
+                                    cutPending = true;
                                 while (isspace(ch))
                                 {
                                     if (ch == '\n')
@@ -319,7 +432,7 @@ void Scanner::appendList(std::list<Token> &list)
                                     list.insert(list.end(), macro->second.tokens.begin(), macro->second.tokens.end());
                                 else
                                 {
-                                    std::list<Token> parameter;
+                                    TokenList parameter;
                                     while (char checkChar = inputFile.get())
                                     {
                                         if (checkChar == ')')
@@ -372,7 +485,7 @@ void Scanner::appendList(std::list<Token> &list)
         }
     }
 }
-void Scanner::appendMacro(std::list<Token> &list)
+void Scanner::appendMacro(TokenList &list)
 {
     char ch;
     Operator op;
@@ -679,68 +792,150 @@ void Scanner::appendMacro(std::list<Token> &list)
     }
 }
 
-std::list<Token>::iterator Scanner::getNextToken()
+const char *budgetName(Budget budget)
 {
+    switch (budget)
+    {
+    case Budget::Tokens:
+        return "tokens";
+    case Budget::Depth:
+        return "nesting depth";
+    case Budget::Nodes:
+        return "tree nodes";
+    case Budget::MacroTokens:
+        return "macro expansion";
+    case Budget::Time:
+        return "time";
+    default:
+        return "none";
+    }
+}
 
+void Scanner::setBudget(const ParseBudget &limits)
+{
+    budget = limits;
+    budgeted = limits.limited();
+    deadline = std::chrono::steady_clock::now() + limits.time;
+}
+
+void Scanner::exceed(Budget which, bool immediately)
+{
+    if (stopped.budget != Budget::None)
+        return;
+    stopped.budget = which;
+    if (immediately && currentToken != tokenEnd())
+    {
+        stopped.line = currentToken->lineNo;
+        stopped.token = currentToken.index();
+    }
+    else
+    {
+        stopped.line = lineNo;
+        stopped.token = symbolTable.empty() ? TokenStore::npos : symbolTable.size() - 1;
+    }
+    loggedError.addGrammarError(stopped.line, std::string("Budget exceeded: ") + budgetName(which));
     if (!end)
+    {
+        symbolTable.push_back(Token(TokenType::END, "", lineNo));
+        end = true;
+    }
+    haltToken = (windowEnd == TokenStore::npos ? symbolTable.size() : windowEnd) - 1;
+    if (immediately)
+    {
+        frozen = true;
+        currentToken = symbolTable.at(haltToken);
+        loggedError.close();
+    }
+}
+
+TokenStore::iterator Scanner::watch(TokenStore::iterator itr)
+{
+    if (!frozen && (++handedOut & 255) == 0 && pastDeadline())
+    {
+        exceed(Budget::Time, true);
+        return currentToken;
+    }
+    if (haltToken != TokenStore::npos && itr.index() == haltToken)
+        loggedError.close();
+    return itr;
+}
+
+TokenStore::iterator Scanner::nextToken()
+{
+    // a parser that resynchronizes on an iterator it held before the stop
+    // still reads END
+    if (frozen)
+        return currentToken = symbolTable.at(haltToken);
+    if (!end && lexAhead)
         appendList(symbolTable);
-    if (symbolTable.empty())
-        return symbolTable.end();
+    else
+        while (!end && tokenBegin() == tokenEnd())
+            appendList(symbolTable);
+    if (tokenBegin() == tokenEnd())
+        return tokenEnd();
 
-    if (currentToken == symbolTable.end())
+    if (currentToken == tokenEnd())
     {
-        currentToken = symbolTable.begin();
+        currentToken = tokenBegin();
         return currentToken;
     }
 
     auto next = std::next(currentToken);
-    while (next == symbolTable.end() && !end)
+    while (next == tokenEnd() && !end)
     {
         appendList(symbolTable);
         next = std::next(currentToken);
     }
 
-    if (next == symbolTable.end())
+    if (next == tokenEnd())
         return currentToken;
 
     currentToken = next;
     return currentToken;
 }
-std::list<Token>::iterator Scanner::peekNextToken()
+TokenStore::iterator Scanner::peekToken()
 {
-    if (!end)
+    if (frozen)
+        return symbolTable.at(haltToken);
+    if (!end && lexAhead)
         appendList(symbolTable);
-    if (symbolTable.empty())
-        return symbolTable.end();
+    else
+        while (!end && tokenBegin() == tokenEnd())
+            appendList(symbolTable);
+    if (tokenBegin() == tokenEnd())
+        return tokenEnd();
 
-    if (currentToken == symbolTable.end())
-        return symbolTable.begin();
+    if (currentToken == tokenEnd())
+        return tokenBegin();
 
     auto next = std::next(currentToken);
-    while (next == symbolTable.end() && !end)
+    while (next == tokenEnd() && !end)
     {
         appendList(symbolTable);
         next = std::next(currentToken);
     }
+    // past the END token there is only END
+    if (next == tokenEnd())
+        return currentToken;
 
     return next;
 }
-std::list<Token>::iterator Scanner::peekPrevToken()
+TokenStore::iterator Scanner::peekPrevToken()
 {
-    if (currentToken == symbolTable.begin())
+    if (frozen || currentToken == tokenBegin())
         return currentToken;
     return std::prev(currentToken);
 }
 
-std::list<Token>::iterator Scanner::ungetToken()
+TokenStore::iterator Scanner::ungetToken()
 {
-    if (currentToken == symbolTable.begin())
+    if (frozen || currentToken == tokenBegin())
         return currentToken;
     currentToken = std::prev(currentToken);
     return currentToken;
 }
 
-void Scanner::handleStr(std::list<Token> &list)
+void Scanner::handleStr(TokenList &list)
 {
 
     Token t;
@@ -789,7 +984,7 @@ void Scanner::handleStr(std::list<Token> &list)
     if (inputFile.eof())
         loggedError.addError(lineNo, STRING_ERROR);
 }
-void Scanner::handleChar(std::list<Token> &list)
+void Scanner::handleChar(TokenList &list)
 {
 
     Token t;
@@ -971,8 +1166,9 @@ void Scanner::handleDirective()
                 temp.push_back(ch);
                 inputFile.get(ch);
             }
-            definedMacro.insert({temp, {}});
-            auto itr = getDefinedMacro(temp);
+            auto [itr, added] = definedMacro.insert({temp, {}});
+            if (added)
+                itr->second.lineNo = lineNo;
             temp.clear();
             if (ch == '\n')
             {
@@ -4,31 +4,112 @@
 #include <fstream>
 #include <sstream>
 #include <list>
+#include <memory_resource>
+#include <memory>
 #include <cstdint>
 #include <cstring>
 #include <cstdbool>
 #include <cstdlib>
 #include <stack>
+#include <chrono>
 #include "Token.hpp"
 #include "Error.hpp"
 #include <queue>
+#include <string_view>
 #define EXTENSION ".c"
 
+// whether path names a C source file; the path constructor of Scanner reports
+// an error and reads nothing otherwise
+inline bool hasSourceExtension(std::string_view path)
+{
+    return path.ends_with(EXTENSION);
+}
+
+// A streambuf over source text that is already in memory. The Scanner reads
+// through it, so the byte offset of a token is just the read position.
+class SourceBuffer : public std::streambuf
+{
+public:
+    void reset(std::string_view text)
+    {
+        char *data = const_cast<char *>(text.data());
+        setg(data, data, data + text.size());
+    }
+    inline std::size_t position() const { return gptr() - eback(); }
+};
+
+// Limits on the work one file may cost, for input that cannot be trusted; 0 is
+// no limit. A parse that runs out of one stops where it is: the rest of the
+// file reads as END, a grammar error names the budget, later diagnostics
+// (which would only be about the file ending there) are dropped, and the tree
+// built so far is kept.
+struct ParseBudget
+{
+    uint32_t tokens = 0;      // tokens lexed
+    uint32_t depth = 0;       // nesting of the recursive-descent functions, or LALR stack size
+    uint32_t nodes = 0;       // tree nodes built
+    uint32_t macroTokens = 0; // tokens produced by macro expansion
+    std::chrono::milliseconds time{0}; // wall clock from the start of the parse
+    inline bool limited() const { return tokens || depth || nodes || macroTokens || time.count(); }
+};
+
+enum class Budget
+{
+    None,
+    Tokens,
+    Depth,
+    Nodes,
+    MacroTokens,
+    Time
+};
+const char *budgetName(Budget budget);
+
+// which budget stopped a parse, and where
+struct BudgetStop
+{
+    Budget budget = Budget::None;
+    int line = 0;
+    // the last token read before the stop, or TokenStore::npos
+    uint32_t token = TokenStore::npos;
+};
+
+// the tokens the lexer reads before they are stored, and the body of a macro
+using TokenList = std::pmr::list<Token>;
+
 class Scanner
 {
 protected:
-    std::list<Token> symbolTable;
+    // shared with the tree and with the parsers of single declarations
+    std::shared_ptr<TokenStore> store = std::make_shared<TokenStore>();
+    TokenStore &symbolTable = *store;
+    // the tokens [windowBegin, windowEnd) of the store are the ones handed out
+    uint32_t windowBegin = 0;
+    uint32_t windowEnd = TokenStore::npos;
+    inline TokenStore::iterator tokenBegin() { return symbolTable.at(windowBegin); }
+    inline TokenStore::iterator tokenEnd() { return symbolTable.at(windowEnd); }
     std::string pathToFile;
     int32_t lineNo; // Line No. of the source code file
-    std::ifstream inputFile;
-    std::list<Token>::iterator currentToken;
+    std::string fileText; // the whole file, when the source is a path
+    std::string_view source;
+    int sourceOffset = 0; // byte offset of source within the file
+    SourceBuffer buffer;
+    std::istream inputFile{&buffer};
+    TokenStore::iterator currentToken;
+    // the nodes of the list each token is read into, handed back and reused
+    // for the next token instead of going through malloc every time
+    std::pmr::unsynchronized_pool_resource listNodes;
 
+public:
+    // a macro as its #define gave it
     struct Macro
     {
         std::vector<std::string> parameters;
-        std::list<Token> tokens;
+        TokenList tokens;
+        int lineNo = 0; // of its first #define
         Macro() : parameters(), tokens() {};
     };
+
+protected:
     std::map<std::string, Macro> definedMacro;
     inline void addParameter(const std::string &para, Macro &m)
     {
@@ -37,8 +118,8 @@ protected:
     void addToken(Macro &m);
     Error &loggedError;
 
-    void handleStr(std::list<Token> &list);
-    void handleChar(std::list<Token> &list);
+    void handleStr(TokenList &list);
+    void handleChar(TokenList &list);
     void handleDirective();
     void handleComment();
 
@@ -158,47 +239,107 @@ protected:
         return ret;
     }
 
-    void appendList(std::list<Token> &list);
-    void appendMacro(std::list<Token> &list);
+    // budgets; see ParseBudget
+    ParseBudget budget;
+    bool budgeted = false;
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t expandedTokens = 0;
+    uint32_t handedOut = 0;
+    BudgetStop stopped;
+    // the END that ends the stream after a stop, npos before one
+    uint32_t haltToken = TokenStore::npos;
+    // the parser is stopped: every token from now on is END
+    bool frozen = false;
+    // the lexer ran out of a budget inside lexToken; the stream is cut after
+    // what it read
+    bool cutPending = false;
+    // records the stop and ends the token stream; a stop from the parser
+    // (immediately) also skips the tokens already read ahead
+    void exceed(Budget which, bool immediately);
+    // the token getNextToken or peekNextToken is about to hand out, once the
+    // time budget has been checked; the sink is closed when it is the END a
+    // stop put there
+    TokenStore::iterator watch(TokenStore::iterator itr);
+    inline bool pastDeadline() const { return budget.time.count() && std::chrono::steady_clock::now() > deadline; }
+    // every read lexes one more token, which keeps the lexer well ahead of
+    // the parser and its line number where the token listing expects it; a
+    // parse that releases the tokens behind it lexes only as far as it reads
+    bool lexAhead = true;
+    TokenStore::iterator nextToken();
+    TokenStore::iterator peekToken();
+
+    // lexes the next token into list and stamps the byte offsets of what it added
+    void appendList(TokenList &list);
+    void appendList(TokenStore &tokens);
+    // where the next token starts in source, after blanks and comments
+    std::size_t tokenStart();
+    void lexToken(TokenList &list);
+    void appendMacro(TokenList &list);
     bool end;
+    // lex the whole file up front
+    void lexAll();
+    // forget every token and macro and start again from the top of the file
+    void rewind();
 
 public:
     Scanner(const std::string &path, Error &e);
+    // hands out tokens [first, last) of a store that is already complete; the
+    // last of them must be END
+    Scanner(std::shared_ptr<TokenStore> tokens, uint32_t first, uint32_t last, Error &e);
+    // lexes text in memory, which must outlive the Scanner; firstLine and
+    // firstOffset place it within a larger file
+    Scanner(std::string_view text, Error &e, int firstLine = 1, int firstOffset = 0);
+    // lexes a whole file that is already in memory, under a name that need
+    // not exist on disk, into tokens when given (a store to reuse, which must
+    // be empty); text is not copied and must outlive the Scanner
+    Scanner(std::string_view text, const std::string &name, Error &e, std::shared_ptr<TokenStore> tokens = nullptr);
     Scanner() = delete;
     Scanner(Scanner &s) = delete;
     Scanner(Scanner &&s) = delete;
     Scanner &operator=(Scanner s) = delete;
     Scanner &operator=(Scanner &s) = delete;
     Scanner &operator=(Scanner &&s) = delete;
-    ~Scanner() { inputFile.close(); };
+    ~Scanner() = default;
 
-    inline std::list<Token>::iterator lastItr() { return symbolTable.end(); };
+    inline TokenStore::iterator lastItr() { return tokenEnd(); };
+    // lexes the rest of the source and returns the store, END included
+    std::shared_ptr<TokenStore> takeTokens();
 
     inline int getlineNo() { return lineNo; }
     inline bool isEnd() { return inputFile.eof(); }
-    std::list<Token>::iterator getNextToken();
-    std::list<Token>::iterator peekNextToken();
-    std::list<Token>::iterator peekPrevToken();
-    std::list<Token>::iterator ungetToken();
-    void printMacro(std::ostream &os)
+    inline TokenStore::iterator getNextToken() { return budgeted ? watch(nextToken()) : nextToken(); }
+    inline TokenStore::iterator peekNextToken() { return budgeted ? watch(peekToken()) : peekToken(); }
+    // limits the work from here on; see ParseBudget
+    void setBudget(const ParseBudget &limits);
+    // the budget that stopped the parse, Budget::None when none did
+    inline const BudgetStop &budgetStop() const { return stopped; }
+    TokenStore::iterator peekPrevToken();
+    TokenStore::iterator ungetToken();
+    // the macros defined so far, by name
+    inline const std::map<std::string, Macro> &macros() const { return definedMacro; }
+    void printMacro(DumpWriter &out)
     {
-        for (auto macro : definedMacro)
+        for (const auto &macro : definedMacro)
         {
-            os << macro.first << '\t' << std::endl;
-            os << "Tokens:" << std::endl;
+            out << macro.first << '\t' << '\n';
+            out << "Tokens:" << '\n';
 
-            for (auto token : macro.second.tokens)
+            for (const auto &token : macro.second.tokens)
             {
-                TokenToString t;
-                os << "Type:\t" << t(token.type) << "\tLexme:\t" << token.lexeme << std::endl;
+                out << "Type:\t" << TokenToString::name(token.type) << "\tLexme:\t" << token.lexeme << '\n';
             }
-            os << "Parameters:" << std::endl;
-            for (auto para : macro.second.parameters)
+            out << "Parameters:" << '\n';
+            for (const auto &para : macro.second.parameters)
             {
-                os << "parameter:\t" << para << std::endl;
+                out << "parameter:\t" << para << '\n';
             }
         }
     }
+    void printMacro(std::ostream &os)
+    {
+        DumpWriter out(os);
+        printMacro(out);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,402 @@
+#include "SymbolIndex.hpp"
+#include "Hash.hpp"
+#include "ThreadPool.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+static constexpr char SYMBOL_SHARD_MAGIC[8] = {'C', 'S', 'Y', 'M', 'S', '\0', '\r', '\n'};
+static constexpr uint16_t SYMBOL_SHARD_BYTE_ORDER = 0x0102;
+static constexpr const char *MANIFEST = "manifest";
+static constexpr const char *MANIFEST_HEADING = "symbol-index 1";
+
+static inline uint64_t aligned(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+static std::string shardPath(const std::string &directory, uint64_t hash)
+{
+    return directory + "/" + hexHash(hash) + ".sym";
+}
+
+void writeSymbolShard(const DeclarationIndex &index, const TokenStore &tokens, uint64_t contentHash, DumpWriter &out)
+{
+    // every occurrence with the name it is of; the declarations first, so that
+    // a stable grouping by name puts them before the references
+    struct Found
+    {
+        uint32_t symbol;
+        SymbolOccurrence occurrence;
+    };
+    std::vector<Found> found;
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, uint32_t> symbolOf;
+    auto symbol = [&](std::string_view name)
+    {
+        auto [at, added] = symbolOf.try_emplace(name, static_cast<uint32_t>(names.size()));
+        if (added)
+            names.push_back(name);
+        return at->second;
+    };
+    std::unordered_set<uint32_t> declaring;
+    for (uint32_t i = 0; i < index.size(); i++)
+    {
+        const Declaration &declaration = index[i];
+        int32_t offset = -1;
+        if (declaration.token != Node::NO_TOKEN)
+        {
+            declaring.insert(declaration.token);
+            offset = tokens[declaration.token].offset;
+        }
+        found.push_back({symbol(index.name(declaration)), {declaration.line, offset, static_cast<uint8_t>(declaration.kind), declaration.definition, 0}});
+    }
+    for (uint32_t t = 0; t < tokens.size(); t++)
+    {
+        const Token &token = tokens[t];
+        if ((token.type == TokenType::ID || token.type == TokenType::MAIN) && !declaring.count(t))
+            found.push_back({symbol(token.lexeme), {token.lineNo, token.offset, SymbolOccurrence::REFERENCE, false, 0}});
+    }
+
+    // a counting sort by symbol, stable
+    uint32_t count = static_cast<uint32_t>(names.size());
+    std::vector<SymbolShardSymbol> symbols(count);
+    for (const auto &entry : found)
+        symbols[entry.symbol].count++;
+    std::string strings;
+    for (uint32_t s = 0, first = 0; s < count; s++)
+    {
+        symbols[s].name = static_cast<uint32_t>(strings.size());
+        symbols[s].length = static_cast<uint32_t>(names[s].size());
+        symbols[s].first = first;
+        first += symbols[s].count;
+        strings.append(names[s]);
+    }
+    std::vector<SymbolOccurrence> occurrences(found.size());
+    std::vector<uint32_t> next(count);
+    for (uint32_t s = 0; s < count; s++)
+        next[s] = symbols[s].first;
+    for (const auto &entry : found)
+        occurrences[next[entry.symbol]++] = entry.occurrence;
+
+    // a table at most half full
+    uint32_t slotCount = 16;
+    while (slotCount < 2 * count)
+        slotCount *= 2;
+    std::vector<uint32_t> slots(slotCount, 0);
+    for (uint32_t s = 0; s < count; s++)
+    {
+        uint32_t at = hashBytes(names[s]) & (slotCount - 1);
+        while (slots[at])
+            at = (at + 1) & (slotCount - 1);
+        slots[at] = s + 1;
+    }
+
+    SymbolShardHeader header{};
+    std::memcpy(header.magic, SYMBOL_SHARD_MAGIC, sizeof(header.magic));
+    header.version = SYMBOL_SHARD_VERSION;
+    header.byteOrder = SYMBOL_SHARD_BYTE_ORDER;
+    header.contentHash = contentHash;
+    header.symbolCount = count;
+    header.occurrenceCount = static_cast<uint32_t>(occurrences.size());
+    header.slotCount = slotCount;
+    header.stringBytes = strings.size();
+    header.symbols = aligned(sizeof(SymbolShardHeader));
+    header.occurrences = aligned(header.symbols + symbols.size() * sizeof(SymbolShardSymbol));
+    header.slots = aligned(header.occurrences + occurrences.size() * sizeof(SymbolOccurrence));
+    header.strings = aligned(header.slots + slots.size() * sizeof(uint32_t));
+
+    uint64_t written = 0;
+    auto bytes = [&](uint64_t at, const void *data, std::size_t size)
+    {
+        for (; written < at; written++)
+            out << '\0';
+        out << std::string_view(static_cast<const char *>(data), size);
+        written += size;
+    };
+    bytes(0, &header, sizeof(header));
+    bytes(header.symbols, symbols.data(), symbols.size() * sizeof(SymbolShardSymbol));
+    bytes(header.occurrences, occurrences.data(), occurrences.size() * sizeof(SymbolOccurrence));
+    bytes(header.slots, slots.data(), slots.size() * sizeof(uint32_t));
+    bytes(header.strings, strings.data(), strings.size());
+}
+
+void SymbolShard::unmap()
+{
+    if (base)
+        munmap(const_cast<char *>(base), length);
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+}
+
+bool SymbolShard::open(const std::string &path, std::string &why)
+{
+    unmap();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        why = "cannot open " + path;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(SymbolShardHeader))
+    {
+        ::close(fd);
+        why = path + " is too short to be a symbol shard";
+        return false;
+    }
+    void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        why = "cannot map " + path;
+        return false;
+    }
+    base = static_cast<const char *>(mapped);
+    length = status.st_size;
+
+    const auto *candidate = reinterpret_cast<const SymbolShardHeader *>(base);
+    auto fail = [&](const std::string &reason)
+    {
+        unmap();
+        why = path + ": " + reason;
+        return false;
+    };
+    if (std::memcmp(candidate->magic, SYMBOL_SHARD_MAGIC, sizeof(candidate->magic)) != 0)
+        return fail("not a symbol shard");
+    if (candidate->byteOrder != SYMBOL_SHARD_BYTE_ORDER)
+        return fail("written with another byte order");
+    if (candidate->version != SYMBOL_SHARD_VERSION)
+        return fail("symbol shard version " + std::to_string(candidate->version) + ", this reader reads " + std::to_string(SYMBOL_SHARD_VERSION));
+    auto inside = [&](uint64_t at, uint64_t bytes)
+    {
+        return at % 8 == 0 && at <= length && bytes <= length - at;
+    };
+    uint32_t slotCount = candidate->slotCount;
+    if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || slotCount < candidate->symbolCount ||
+        !inside(candidate->symbols, uint64_t(candidate->symbolCount) * sizeof(SymbolShardSymbol)) ||
+        !inside(candidate->occurrences, uint64_t(candidate->occurrenceCount) * sizeof(SymbolOccurrence)) ||
+        !inside(candidate->slots, uint64_t(slotCount) * sizeof(uint32_t)) ||
+        !inside(candidate->strings, candidate->stringBytes))
+        return fail("truncated or damaged");
+
+    header = candidate;
+    symbols = reinterpret_cast<const SymbolShardSymbol *>(base + header->symbols);
+    occurrences = reinterpret_cast<const SymbolOccurrence *>(base + header->occurrences);
+    slots = reinterpret_cast<const uint32_t *>(base + header->slots);
+    strings = base + header->strings;
+    return true;
+}
+
+std::span<const SymbolOccurrence> SymbolShard::lookup(std::string_view name) const
+{
+    uint32_t mask = header->slotCount - 1;
+    // a table that is full to the last slot is damaged; stop after one round
+    for (uint32_t at = hashBytes(name) & mask, tried = 0; tried <= mask; at = (at + 1) & mask, tried++)
+    {
+        uint32_t slot = slots[at];
+        if (slot == 0 || slot > header->symbolCount)
+            break;
+        const SymbolShardSymbol &symbol = symbols[slot - 1];
+        if (uint64_t(symbol.name) + symbol.length > header->stringBytes ||
+            uint64_t(symbol.first) + symbol.count > header->occurrenceCount)
+            break;
+        if (std::string_view(strings + symbol.name, symbol.length) == name)
+            return {occurrences + symbol.first, symbol.count};
+    }
+    return {};
+}
+
+bool readSymbolManifest(const std::string &directory, std::vector<SymbolIndex::File> &files)
+{
+    std::ifstream manifest(directory + "/" + MANIFEST);
+    std::string line;
+    if (!manifest || !std::getline(manifest, line) || line != MANIFEST_HEADING)
+        return false;
+    files.clear();
+    while (std::getline(manifest, line))
+    {
+        // hash size modified path; the path is the rest of the line
+        SymbolIndex::File file;
+        std::size_t a = line.find('\t'), b = line.find('\t', a + 1), c = line.find('\t', b + 1);
+        if (c == std::string::npos)
+            continue;
+        file.hash = std::stoull(line.substr(0, a), nullptr, 16);
+        file.size = std::stoull(line.substr(a + 1, b - a - 1));
+        file.modified = std::stoll(line.substr(b + 1, c - b - 1));
+        file.path = line.substr(c + 1);
+        files.push_back(std::move(file));
+    }
+    return true;
+}
+
+// the size and modification time of path, false when it cannot be read
+static bool fileStamp(const std::string &path, uint64_t &size, int64_t &modified)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return false;
+    size = status.st_size;
+    modified = int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+    return true;
+}
+
+bool updateSymbolIndex(const std::string &directory, const std::vector<std::string> &paths, const ParseOptions &options,
+                       unsigned threads, IndexUpdate &update, std::string &why)
+{
+    std::error_code failed;
+    std::filesystem::create_directories(directory, failed);
+    if (failed)
+    {
+        why = "cannot create " + directory;
+        return false;
+    }
+    std::vector<SymbolIndex::File> old;
+    readSymbolManifest(directory, old);
+    std::unordered_map<std::string, const SymbolIndex::File *> known;
+    for (const auto &file : old)
+        known[file.path] = &file;
+
+    // the files whose stamp is the one the manifest has keep their hash; the
+    // rest are read on the pool
+    std::vector<SymbolIndex::File> files(paths.size());
+    std::vector<char> readable(paths.size(), true);
+    std::vector<std::size_t> changed;
+    for (std::size_t i = 0; i < paths.size(); i++)
+    {
+        SymbolIndex::File &file = files[i];
+        file.path = paths[i];
+        if (!fileStamp(file.path, file.size, file.modified))
+        {
+            readable[i] = false;
+            continue;
+        }
+        auto at = known.find(file.path);
+        if (at != known.end() && at->second->size == file.size && at->second->modified == file.modified &&
+            std::filesystem::exists(shardPath(directory, at->second->hash)))
+        {
+            file.hash = at->second->hash;
+            update.unchanged++;
+        }
+        else
+            changed.push_back(i);
+    }
+
+    ParseOptions parse = options;
+    parse.threads = 1;
+    std::atomic<std::size_t> claimed = 0, parsed = 0, unchanged = 0;
+    // two files with one content must not write its shard at once
+    std::mutex lock;
+    std::set<uint64_t> writing;
+    ThreadPool pool(threads);
+    for (std::size_t worker = 0; worker < pool.size(); worker++)
+        pool.submit([&]()
+                    {
+            ParserContext context;
+            for (std::size_t next; (next = claimed++) < changed.size();)
+            {
+                std::size_t i = changed[next];
+                SymbolIndex::File &file = files[i];
+                context.reset();
+                std::string_view text = context.load(file.path);
+                if (context.error().hasErrors())
+                {
+                    readable[i] = false;
+                    continue;
+                }
+                file.hash = hashBytes(text);
+                std::string shard = shardPath(directory, file.hash);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (std::filesystem::exists(shard) || !writing.insert(file.hash).second)
+                    {
+                        unchanged++;
+                        continue;
+                    }
+                }
+                AST tree(context, text, file.path, parse);
+                DeclarationIndex declarations(SyntaxTree(*tree.getRoot(), tree.getTokens()), &tree);
+                if (replaceFile(shard, [&](DumpWriter &out)
+                                { writeSymbolShard(declarations, *tree.getTokens(), file.hash, out); }))
+                    parsed++;
+                else
+                    readable[i] = false;
+            } });
+    pool.wait();
+    update.parsed += parsed;
+    update.unchanged += unchanged;
+
+    std::set<std::string> kept;
+    std::vector<SymbolIndex::File> listed;
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        if (!readable[i])
+        {
+            update.failed.push_back(files[i].path);
+            continue;
+        }
+        kept.insert(hexHash(files[i].hash) + ".sym");
+        listed.push_back(files[i]);
+    }
+    if (!replaceFile(directory + "/" + MANIFEST, [&](DumpWriter &out)
+                     {
+            out << MANIFEST_HEADING << '\n';
+            for (const auto &file : listed)
+                out << hexHash(file.hash) << '\t' << std::to_string(file.size) << '\t' << std::to_string(file.modified) << '\t' << file.path << '\n'; }))
+    {
+        why = "cannot write the manifest in " + directory;
+        return false;
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(directory, failed))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() == 20 && name.ends_with(".sym") && !kept.count(name) && std::filesystem::remove(entry.path(), failed))
+            update.removed++;
+    }
+    return true;
+}
+
+bool SymbolIndex::open(const std::string &at, std::string &why)
+{
+    directory = at;
+    shards.clear();
+    mapped = false;
+    if (!readSymbolManifest(directory, files))
+    {
+        why = "no symbol index in " + directory;
+        return false;
+    }
+    return true;
+}
+
+std::vector<SymbolIndex::Location> SymbolIndex::find(std::string_view name) const
+{
+    if (!mapped)
+    {
+        // files with one content share their shard
+        for (const auto &file : files)
+        {
+            auto [at, added] = shards.try_emplace(file.hash);
+            std::string why;
+            if (added && !(at->second = std::make_unique<SymbolShard>())->open(shardPath(directory, file.hash), why))
+                at->second.reset();
+        }
+        mapped = true;
+    }
+    std::vector<Location> found;
+    for (const auto &file : files)
+    {
+        const auto &shard = shards.at(file.hash);
+        if (!shard)
+            continue;
+        for (const auto &occurrence : shard->lookup(name))
+            found.push_back({&file.path, occurrence});
+    }
+    return found;
+}
@@ -0,0 +1,156 @@
+#ifndef SYMBOL_INDEX_HPP
+#define SYMBOL_INDEX_HPP
+#include "DeclarationIndex.hpp"
+#include <span>
+
+// The definitions, declarations and references of every name across many
+// files, kept on disk so that a query reads the index instead of parsing the
+// files again. An index is a directory:
+//
+//   manifest          one line per file, in the order they were given:
+//                     content hash, size, modification time, path
+//   <hash>.sym        the shard of each distinct file content, named by the
+//                     hashBytes of the content in 16 hex digits
+//
+// A shard holds one file's names, each with its occurrences, and a hash table
+// from name to symbol, and is read through mmap where it lies. Every section
+// starts on an 8-byte boundary, in this order:
+//
+//   SymbolShardHeader
+//   symbols     SymbolShardSymbol[symbolCount]   sorted by nothing
+//   occurrences SymbolOccurrence[occurrenceCount] a symbol's are contiguous:
+//                                                its declarations, then its
+//                                                references, in source order
+//   slots       uint32_t[slotCount]              symbol + 1, 0 when free; open
+//                                                addressing on hashBytes(name)
+//   strings     char[stringBytes]                each name once
+//
+// Shards are written to a temporary name and renamed, so a reader never sees
+// half of one. Like a tree file, a shard is refused by a reader of another
+// version or byte order.
+constexpr uint32_t SYMBOL_SHARD_VERSION = 1;
+
+struct SymbolShardHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint16_t byteOrder; // 0x0102 as the writer stored it
+    uint16_t reserved;
+    uint64_t contentHash;
+    uint32_t symbolCount;
+    uint32_t occurrenceCount;
+    uint32_t slotCount; // a power of two
+    uint32_t reserved2;
+    uint64_t stringBytes;
+    // byte offsets of the sections from the start of the file
+    uint64_t symbols;
+    uint64_t occurrences;
+    uint64_t slots;
+    uint64_t strings;
+};
+
+struct SymbolShardSymbol
+{
+    uint32_t name; // offset within strings
+    uint32_t length;
+    uint32_t first; // its first occurrence
+    uint32_t count;
+};
+
+struct SymbolOccurrence
+{
+    static constexpr uint8_t REFERENCE = 0xff;
+    int32_t line;
+    int32_t offset; // byte offset in the source, -1 when not read from there
+    uint8_t kind;   // a DeclarationKind, or REFERENCE for a use of the name
+    uint8_t definition;
+    uint16_t reserved;
+};
+
+// writes the shard of one parsed file: the declarations in index, and as
+// references every other identifier token of tokens
+void writeSymbolShard(const DeclarationIndex &index, const TokenStore &tokens, uint64_t contentHash, DumpWriter &out);
+
+// one shard mapped read-only; opening checks the header and that the sections
+// lie inside the file
+class SymbolShard
+{
+private:
+    const char *base = nullptr;
+    std::size_t length = 0;
+    const SymbolShardHeader *header = nullptr;
+    const SymbolShardSymbol *symbols = nullptr;
+    const SymbolOccurrence *occurrences = nullptr;
+    const uint32_t *slots = nullptr;
+    const char *strings = nullptr;
+
+    void unmap();
+
+public:
+    SymbolShard() = default;
+    SymbolShard(const SymbolShard &) = delete;
+    SymbolShard &operator=(const SymbolShard &) = delete;
+    ~SymbolShard() { unmap(); }
+
+    bool open(const std::string &path, std::string &why);
+    inline uint64_t contentHash() const { return header->contentHash; }
+    // the occurrences of name in the file; empty when it has none
+    std::span<const SymbolOccurrence> lookup(std::string_view name) const;
+};
+
+// what updateSymbolIndex did
+struct IndexUpdate
+{
+    std::size_t parsed = 0;    // files whose content had no shard yet
+    std::size_t unchanged = 0; // files whose shard was there already
+    std::size_t removed = 0;   // shards no file has any more
+    std::vector<std::string> failed; // files that could not be read
+};
+
+// Brings the index in directory, created when missing, up to date with paths:
+// a file whose size and modification time are those in the manifest is taken
+// as it is, any other is read and hashed, and only content without a shard is
+// parsed, on threads workers (0: one per core), each in a ParserContext of its
+// own. The manifest then lists exactly paths, and shards no file of it uses
+// are deleted. False, with the reason in why, when the directory or the
+// manifest cannot be written.
+bool updateSymbolIndex(const std::string &directory, const std::vector<std::string> &paths, const ParseOptions &options,
+                       unsigned threads, IndexUpdate &update, std::string &why);
+
+// an index opened for queries; shards are mapped on the first query
+class SymbolIndex
+{
+public:
+    struct File
+    {
+        std::string path;
+        uint64_t hash;
+        uint64_t size;
+        int64_t modified; // nanoseconds since the epoch
+    };
+    struct Location
+    {
+        const std::string *path;
+        SymbolOccurrence occurrence;
+    };
+
+private:
+    std::string directory;
+    std::vector<File> files;
+    // by content hash, nullptr for one that cannot be read
+    mutable std::unordered_map<uint64_t, std::unique_ptr<SymbolShard>> shards;
+    mutable bool mapped = false;
+
+public:
+    // reads the manifest in directory; false, with the reason in why, when
+    // there is none
+    bool open(const std::string &directory, std::string &why);
+    inline const std::vector<File> &getFiles() const { return files; }
+    // every occurrence of name, file by file in the order of the manifest; a
+    // shard that cannot be read is skipped
+    std::vector<Location> find(std::string_view name) const;
+};
+
+// the manifest of directory, or false when it has none
+bool readSymbolManifest(const std::string &directory, std::vector<SymbolIndex::File> &files);
+#endif
@@ -0,0 +1,988 @@
+#include "Syntax.hpp"
+#include "TreeWalk.hpp"
+
+SyntaxNode::~SyntaxNode()
+{
+    releaseChildren<SyntaxNode>(children);
+}
+
+const std::string &syntaxKindName(SyntaxKind kind)
+{
+    static const std::string names[] = {
+        "TranslationUnit", "Include",
+        "FunctionDecl", "ParamDecl", "VarDecl", "TypedefDecl", "RecordDecl", "FieldDecl", "EnumDecl",
+        "EnumConstantDecl", "StaticAssertDecl",
+        "CompoundStmt", "DeclStmt", "ExprStmt", "NullStmt", "IfStmt", "SwitchStmt", "WhileStmt", "DoStmt",
+        "ForStmt", "GotoStmt", "ContinueStmt", "BreakStmt", "ReturnStmt", "LabelStmt", "CaseStmt",
+        "DefaultStmt", "UnparsedBody",
+        "Identifier", "Literal", "BinaryOp", "AssignOp", "UnaryOp", "PostfixOp", "ConditionalOp", "CastExpr",
+        "SizeofExpr", "CallExpr", "IndexExpr", "MemberExpr", "CompoundLiteral", "InitList", "DesignatedInit",
+        "FieldDesignator", "IndexDesignator", "GenericSelection", "GenericAssociation",
+        "Invalid"};
+    static_assert(std::size(names) == static_cast<std::size_t>(SyntaxKind::Invalid) + 1);
+    return names[static_cast<std::size_t>(kind)];
+}
+
+// the child at index, or nullptr past the last one
+static const Node *childAt(const Node &node, std::size_t index)
+{
+    return index < node.children.size() ? node.children[index].get() : nullptr;
+}
+
+// the first child of the given type, or nullptr
+static const Node *childOf(const Node &node, TokenType type)
+{
+    for (const auto &child : node.children)
+        if (child->type == type)
+            return child.get();
+    return nullptr;
+}
+
+static inline bool isLeaf(const Node &node)
+{
+    return !isNonterminal(node.type) && node.token != Node::NO_TOKEN;
+}
+
+// the identifier a declarator declares, as in LALR.cpp; a loop, since
+// declarators nest as deep as their parentheses
+static const Node *declaredName(const Node &declarator)
+{
+    const Node *current = &declarator;
+    while (current)
+    {
+        const Node *inner = nullptr;
+        for (const auto &child : current->children)
+        {
+            // the scanner reads main as a token of its own
+            if (child->type == TokenType::ID || child->type == TokenType::MAIN)
+                return child.get();
+            if (child->type == TokenType::DECLARATOR || child->type == TokenType::DIRECT_DECLARATOR)
+            {
+                inner = child.get();
+                break;
+            }
+        }
+        current = inner;
+    }
+    return nullptr;
+}
+
+// the DIRECT_DECLARATOR that holds the name, when it is followed right away by
+// a parameter list, so that the declarator declares a function
+static const Node *functionDeclarator(const Node &declarator)
+{
+    const Node *direct = childOf(declarator, TokenType::DIRECT_DECLARATOR);
+    if (!direct)
+        return nullptr;
+    const Node *name = childAt(*direct, 0);
+    const Node *open = childAt(*direct, 1);
+    if (name && open && name->type == TokenType::ID && open->type == TokenType::L_BR)
+        return direct;
+    return nullptr;
+}
+
+static bool isStatement(TokenType type)
+{
+    switch (type)
+    {
+    case TokenType::STATEMENT:
+    case TokenType::BLOCK_ITEM:
+    case TokenType::COMPOUND_STATEMENT:
+    case TokenType::UNPARSED_BODY:
+    case TokenType::EXPRESSION_STATEMENT:
+    case TokenType::LABELED_STATEMENT:
+    case TokenType::SELECTION_STATEMENT:
+    case TokenType::ITERATION_STATEMENT:
+    case TokenType::JUMP_STATEMENT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isBinary(TokenType type)
+{
+    switch (type)
+    {
+    case TokenType::EXPRESSION:
+    case TokenType::MULTIPLICATIVE_EXPRESSION:
+    case TokenType::ADDITIVE_EXPRESSION:
+    case TokenType::SHIFT_EXPRESSION:
+    case TokenType::RELATIONAL_EXPRESSION:
+    case TokenType::EQUALITY_EXPRESSION:
+    case TokenType::AND_EXPRESSION:
+    case TokenType::EXCLUSIVE_OR_EXPRESSION:
+    case TokenType::INCLUSIVE_OR_EXPRESSION:
+    case TokenType::LOGICAL_AND_EXPRESSION:
+    case TokenType::LOGICAL_OR_EXPRESSION:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool isExpression(TokenType type)
+{
+    switch (type)
+    {
+    case TokenType::UNARY_EXPRESSION:
+    case TokenType::POSTFIX_EXPRESSION:
+    case TokenType::PRIMARY_EXPRESSION:
+    case TokenType::CONSTANT_EXPRESSION:
+    case TokenType::ASSIGNMENT_EXPRESSION:
+    case TokenType::CONDITIONAL_EXPRESSION:
+    case TokenType::CAST_EXPRESSION:
+    case TokenType::GENERIC_SELECTION:
+        return true;
+    default:
+        return isBinary(type);
+    }
+}
+
+// Lowers in one walk on an explicit stack, so that neither the depth of the
+// tree nor a long else-if chain costs call stack: each node is lowered when
+// the walk leaves it, from what its children lowered to, and its token range
+// comes from theirs.
+SyntaxTree::SyntaxTree(const Node &root, std::shared_ptr<const TokenStore> tokens) : tokens(std::move(tokens))
+{
+    std::vector<Lowered> lowered;
+    auto enter = [](const Node &, std::size_t, bool) { return true; };
+    auto leave = [&](const Node &node)
+    {
+        std::size_t count = node.children.size();
+        Lowered *kids = lowered.data() + lowered.size() - count;
+        Lowered out;
+        out.range = rangeOf(node, kids);
+        if (&node == &root)
+        {
+            out.node = make(SyntaxKind::TranslationUnit, out.range);
+            for (std::size_t i = 0; i < count; i++)
+                lowerExternal(*node.children[i], kids[i], out.node->children);
+        }
+        else
+            lower(node, kids, out);
+        lowered.erase(lowered.end() - count, lowered.end());
+        lowered.push_back(std::move(out));
+    };
+    walkTree(root, enter, leave);
+    this->root = std::move(lowered.back().node);
+}
+
+// a node that names a token (UNPARSED_BODY names its '{') is that token;
+// any other spans its children
+SourceRange SyntaxTree::rangeOf(const Node &node, const Lowered *kids)
+{
+    if (node.token != Node::NO_TOKEN)
+        return {node.token, node.token};
+    SourceRange range;
+    std::size_t count = node.children.size();
+    for (std::size_t i = 0; i < count && range.first == Node::NO_TOKEN; i++)
+        range.first = kids[i].range.first;
+    for (std::size_t i = count; i > 0 && range.last == Node::NO_TOKEN; i--)
+        range.last = kids[i - 1].range.last;
+    return range;
+}
+
+// what the first child of the given type lowered to, or nullptr
+SyntaxTree::Lowered *SyntaxTree::kidOf(const Node &node, Lowered *kids, TokenType type)
+{
+    for (std::size_t i = 0; i < node.children.size(); i++)
+        if (node.children[i]->type == type)
+            return &kids[i];
+    return nullptr;
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::make(SyntaxKind kind, SourceRange range) const
+{
+    return std::make_shared<SyntaxNode>(kind, range);
+}
+
+void SyntaxTree::spell(const Node &node, std::string &out) const
+{
+    // an explicit stack, as a declarator nests as deep as its parentheses
+    std::vector<const Node *> pending{&node};
+    while (!pending.empty())
+    {
+        const Node &next = *pending.back();
+        pending.pop_back();
+        if (isLeaf(next))
+        {
+            const std::string &word = (*tokens)[next.token].lexeme;
+            if (word.empty())
+                continue;
+            // a space between tokens, except just inside brackets, before a ','
+            // and between two '*'
+            if (!out.empty())
+            {
+                char last = out.back();
+                char first = word.front();
+                bool tight = last == '(' || last == '[' || first == ')' || first == ']' || first == ',' || first == '[' ||
+                             (last == '*' && first == '*') || (last == ')' && first == '(');
+                if (!tight)
+                    out.push_back(' ');
+            }
+            out += word;
+            continue;
+        }
+        std::size_t first = 0;
+        // the name a declarator declares is not part of its type
+        if (next.type == TokenType::DIRECT_DECLARATOR && !next.children.empty() && next.children[0]->type == TokenType::ID)
+            first = 1;
+        std::size_t end = first;
+        // a struct, union or enum body is lowered on its own
+        bool tagged = next.type == TokenType::STRUCT_UNION_SPECIFIER || next.type == TokenType::ENUM_SPECIFIER;
+        while (end < next.children.size() && !(tagged && next.children[end]->type == TokenType::L_CUR))
+            end++;
+        for (std::size_t i = end; i > first; i--)
+            pending.push_back(next.children[i - 1].get());
+    }
+}
+
+std::string SyntaxTree::spellType(const Node &specifiers, const Node *declarator) const
+{
+    std::string out;
+    for (const auto &child : specifiers.children)
+        if (!firstSet(TokenType::STORAGE_CLASS_SPECIFIER).contains(child->type))
+            spell(*child, out);
+    if (declarator)
+        spell(*declarator, out);
+    return out;
+}
+
+TokenType SyntaxTree::storageClass(const Node &specifiers) const
+{
+    for (const auto &child : specifiers.children)
+        if (firstSet(TokenType::STORAGE_CLASS_SPECIFIER).contains(child->type))
+            return child->type;
+    return TokenType::END;
+}
+
+// a child lowered in the place of an expression; leaves are lowered here, as
+// most of them are punctuation nothing asks for
+std::shared_ptr<SyntaxNode> SyntaxTree::expression(const Node &node, Lowered &lowered) const
+{
+    if (isLeaf(node))
+    {
+        SyntaxKind kind = node.type == TokenType::ID ? SyntaxKind::Identifier : node.type == TokenType::CONSTANT || node.type == TokenType::STRING_LITERAL || node.type == TokenType::FUNC_NAME ? SyntaxKind::Literal
+                                                                                                                                                                                           : SyntaxKind::Invalid;
+        auto leaf = make(kind, lowered.range);
+        if (kind != SyntaxKind::Invalid)
+            leaf->name = node.token;
+        if (kind == SyntaxKind::Literal)
+            leaf->op = node.type;
+        return leaf;
+    }
+    if (isExpression(node.type) && lowered.node)
+        return std::move(lowered.node);
+    return make(SyntaxKind::Invalid, lowered.range);
+}
+
+// a child lowered in the place of a statement
+std::shared_ptr<SyntaxNode> SyntaxTree::statement(const Node &node, Lowered &lowered) const
+{
+    if (node.type == TokenType::DECLARATION)
+    {
+        auto statement = make(SyntaxKind::DeclStmt, lowered.range);
+        statement->children = std::move(lowered.list);
+        return statement;
+    }
+    if (isStatement(node.type) && lowered.node)
+        return std::move(lowered.node);
+    return make(SyntaxKind::Invalid, lowered.range);
+}
+
+void SyntaxTree::lower(const Node &node, Lowered *kids, Lowered &out) const
+{
+    std::size_t count = node.children.size();
+    if (isStatement(node.type))
+    {
+        out.node = lowerStatement(node, kids, out);
+        return;
+    }
+    if (isExpression(node.type))
+    {
+        out.node = lowerExpression(node, kids, out);
+        return;
+    }
+    switch (node.type)
+    {
+    case TokenType::INCLUDE_STMT:
+        out.node = make(SyntaxKind::Include, out.range);
+        if (const Node *path = childOf(node, TokenType::INCLUDE_PATH))
+            out.node->name = path->token;
+        break;
+    case TokenType::EXTERNAL_DECLARATION:
+        for (std::size_t i = 0; i < count; i++)
+            lowerExternal(*node.children[i], kids[i], out.list);
+        break;
+    case TokenType::FUNCTION_DEFINITION:
+        out.node = lowerFunction(node, kids, out);
+        break;
+    case TokenType::DECLARATION:
+        lowerDeclaration(node, kids, out);
+        break;
+    case TokenType::DECLARATION_LIST:
+        // K&R parameter declarations
+        for (std::size_t i = 0; i < count; i++)
+            if (node.children[i]->type == TokenType::DECLARATION)
+                for (auto &declaration : kids[i].list)
+                    out.list.push_back(std::move(declaration));
+        break;
+    case TokenType::STATIC_ASSERT_DECLARATION:
+        out.node = make(SyntaxKind::StaticAssertDecl, out.range);
+        if (Lowered *condition = kidOf(node, kids, TokenType::CONSTANT_EXPRESSION))
+            out.node->children.push_back(expression(*childOf(node, TokenType::CONSTANT_EXPRESSION), *condition));
+        if (Lowered *message = kidOf(node, kids, TokenType::STRING_LITERAL))
+            out.node->children.push_back(expression(*childOf(node, TokenType::STRING_LITERAL), *message));
+        break;
+    case TokenType::DECLARATION_SPECIFIERS:
+    case TokenType::SPECIFIER_QUALIFIER_LIST:
+        lowerTags(node, kids, out);
+        break;
+    case TokenType::STRUCT_UNION_SPECIFIER:
+        if (childOf(node, TokenType::L_CUR))
+            out.node = lowerRecord(node, kids, out);
+        break;
+    case TokenType::ENUM_SPECIFIER:
+        if (childOf(node, TokenType::L_CUR))
+            out.node = lowerEnum(node, kids, out);
+        break;
+    case TokenType::STRUCT_DECLARATION_LIST:
+        for (std::size_t i = 0; i < count; i++)
+            if (node.children[i]->type == TokenType::STRUCT_DECLARATION)
+                for (auto &member : kids[i].list)
+                    out.list.push_back(std::move(member));
+        break;
+    case TokenType::STRUCT_DECLARATION:
+        lowerMember(node, kids, out);
+        break;
+    case TokenType::STRUCT_DECLARATOR:
+        // the width follows the ':'
+        for (std::size_t i = 0; i + 1 < count; i++)
+            if (node.children[i]->type == TokenType::COLON)
+                out.list.push_back(expression(*node.children[i + 1], kids[i + 1]));
+        break;
+    case TokenType::INIT_DECLARATOR_LIST:
+    case TokenType::STRUCT_DECLARATOR_LIST:
+        out.parts.assign(std::make_move_iterator(kids), std::make_move_iterator(kids + count));
+        break;
+    case TokenType::INIT_DECLARATOR:
+        if (Lowered *declarator = kidOf(node, kids, TokenType::DECLARATOR))
+            out.list = std::move(declarator->list);
+        if (Lowered *initializer = kidOf(node, kids, TokenType::INITIALIZER))
+            out.node = std::move(initializer->node);
+        break;
+    case TokenType::ENUMERATOR_LIST:
+    case TokenType::PARAMETER_LIST:
+    case TokenType::DESIGNATOR_LIST:
+    case TokenType::GENERIC_ASSOC_LIST:
+    {
+        TokenType element = node.type == TokenType::ENUMERATOR_LIST  ? TokenType::ENUMERATOR
+                            : node.type == TokenType::PARAMETER_LIST ? TokenType::PARAMETER_DECLARATION
+                            : node.type == TokenType::DESIGNATOR_LIST ? TokenType::DESIGNATOR
+                                                                      : TokenType::GENERIC_ASSOCIATION;
+        for (std::size_t i = 0; i < count; i++)
+            if (node.children[i]->type == element)
+                out.list.push_back(std::move(kids[i].node));
+        break;
+    }
+    case TokenType::ENUMERATOR:
+        out.node = make(SyntaxKind::EnumConstantDecl, out.range);
+        if (count > 0)
+            out.node->name = node.children[0]->token;
+        if (count > 2)
+            out.node->children.push_back(expression(*node.children[2], kids[2]));
+        break;
+    case TokenType::DECLARATOR:
+        // the parameters, should the declaration turn out to declare a function
+        if (functionDeclarator(node))
+            out.list = std::move(kidOf(node, kids, TokenType::DIRECT_DECLARATOR)->list);
+        break;
+    case TokenType::DIRECT_DECLARATOR:
+        if (Lowered *types = kidOf(node, kids, TokenType::PARAMETER_TYPE_LIST))
+            out.list = std::move(types->list);
+        break;
+    case TokenType::PARAMETER_TYPE_LIST:
+        if (Lowered *list = kidOf(node, kids, TokenType::PARAMETER_LIST))
+            out.list = std::move(list->list);
+        break;
+    case TokenType::PARAMETER_DECLARATION:
+        // only the range: lowerParameters spells the parameters a function has
+        out.node = make(SyntaxKind::ParamDecl, out.range);
+        break;
+    case TokenType::INITIALIZER:
+        if (Lowered *list = kidOf(node, kids, TokenType::INITIALIZER_LIST))
+            out.node = lowerInitList(*list, out.range);
+        else if (count > 0)
+            out.node = expression(*node.children[0], kids[0]);
+        else
+            out.node = make(SyntaxKind::Invalid, out.range);
+        break;
+    case TokenType::INITIALIZER_LIST:
+        lowerInitItems(node, kids, out);
+        break;
+    case TokenType::DESIGNATION:
+        out.node = make(SyntaxKind::DesignatedInit, out.range);
+        if (Lowered *designators = kidOf(node, kids, TokenType::DESIGNATOR_LIST))
+            out.node->children = std::move(designators->list);
+        break;
+    case TokenType::DESIGNATOR:
+    {
+        const Node *field = childOf(node, TokenType::ID);
+        out.node = make(field ? SyntaxKind::FieldDesignator : SyntaxKind::IndexDesignator, out.range);
+        if (field)
+            out.node->name = field->token;
+        else if (Lowered *index = kidOf(node, kids, TokenType::CONSTANT_EXPRESSION))
+            out.node->children.push_back(expression(*childOf(node, TokenType::CONSTANT_EXPRESSION), *index));
+        break;
+    }
+    case TokenType::BLOCK_ITEM_LIST:
+        for (std::size_t i = 0; i < count; i++)
+            out.list.push_back(statement(*node.children[i], kids[i]));
+        break;
+    case TokenType::ARGUMENT_EXPRESSION_LIST:
+        for (std::size_t i = 0; i < count; i++)
+            if (node.children[i]->type != TokenType::COMMA)
+                out.list.push_back(expression(*node.children[i], kids[i]));
+        break;
+    case TokenType::GENERIC_ASSOCIATION:
+        out.node = make(SyntaxKind::GenericAssociation, out.range);
+        if (const Node *type = childOf(node, TokenType::TYPE_NAME))
+            spell(*type, out.node->type);
+        if (Lowered *value = kidOf(node, kids, TokenType::ASSIGNMENT_EXPRESSION))
+            out.node->children.push_back(expression(*childOf(node, TokenType::ASSIGNMENT_EXPRESSION), *value));
+        break;
+    default:
+        break;
+    }
+}
+
+void SyntaxTree::lowerExternal(const Node &node, Lowered &lowered, std::vector<std::shared_ptr<SyntaxNode>> &out) const
+{
+    switch (node.type)
+    {
+    case TokenType::INCLUDE_STMT:
+    case TokenType::FUNCTION_DEFINITION:
+        out.push_back(std::move(lowered.node));
+        break;
+    case TokenType::EXTERNAL_DECLARATION:
+    case TokenType::DECLARATION:
+        for (auto &declaration : lowered.list)
+            out.push_back(std::move(declaration));
+        break;
+    default:
+        out.push_back(make(SyntaxKind::Invalid, lowered.range));
+    }
+}
+
+void SyntaxTree::lowerDeclaration(const Node &node, Lowered *kids, Lowered &out) const
+{
+    if (Lowered *assertion = kidOf(node, kids, TokenType::STATIC_ASSERT_DECLARATION))
+    {
+        out.list.push_back(std::move(assertion->node));
+        return;
+    }
+    const Node *specifiers = childOf(node, TokenType::DECLARATION_SPECIFIERS);
+    if (!specifiers)
+    {
+        out.list.push_back(make(SyntaxKind::Invalid, out.range));
+        return;
+    }
+    out.list = std::move(kidOf(node, kids, TokenType::DECLARATION_SPECIFIERS)->list);
+    const Node *list = childOf(node, TokenType::INIT_DECLARATOR_LIST);
+    if (!list)
+        return;
+    std::vector<Lowered> &parts = kidOf(node, kids, TokenType::INIT_DECLARATOR_LIST)->parts;
+    for (std::size_t i = 0; i < list->children.size(); i++)
+    {
+        const Node &initDeclarator = *list->children[i];
+        if (initDeclarator.type != TokenType::INIT_DECLARATOR)
+            continue;
+        const Node *declarator = childOf(initDeclarator, TokenType::DECLARATOR);
+        if (!declarator)
+            continue;
+        auto decl = lowerDeclarator(out.range, specifiers, *declarator, parts[i].list);
+        decl->range.last = parts[i].range.last;
+        if (parts[i].node)
+            decl->children.push_back(std::move(parts[i].node));
+        out.list.push_back(decl);
+    }
+}
+
+// the structs, unions and enums with a body that the specifiers define
+void SyntaxTree::lowerTags(const Node &specifiers, Lowered *kids, Lowered &out) const
+{
+    for (std::size_t i = 0; i < specifiers.children.size(); i++)
+    {
+        TokenType type = specifiers.children[i]->type;
+        if ((type == TokenType::STRUCT_UNION_SPECIFIER || type == TokenType::ENUM_SPECIFIER) && kids[i].node)
+            out.list.push_back(std::move(kids[i].node));
+    }
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerRecord(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    auto record = make(SyntaxKind::RecordDecl, out.range);
+    record->op = node.children[0]->type;
+    if (const Node *tag = childOf(node, TokenType::ID))
+        record->name = tag->token;
+    if (Lowered *list = kidOf(node, kids, TokenType::STRUCT_DECLARATION_LIST))
+        record->children = std::move(list->list);
+    return record;
+}
+
+// the tags and the fields of one member declaration
+void SyntaxTree::lowerMember(const Node &node, Lowered *kids, Lowered &out) const
+{
+    const Node *specifiers = childOf(node, TokenType::SPECIFIER_QUALIFIER_LIST);
+    if (!specifiers)
+        return;
+    out.list = std::move(kidOf(node, kids, TokenType::SPECIFIER_QUALIFIER_LIST)->list);
+    const Node *declarators = childOf(node, TokenType::STRUCT_DECLARATOR_LIST);
+    if (!declarators)
+        return;
+    std::vector<Lowered> &parts = kidOf(node, kids, TokenType::STRUCT_DECLARATOR_LIST)->parts;
+    for (std::size_t i = 0; i < declarators->children.size(); i++)
+    {
+        const Node &declarator = *declarators->children[i];
+        if (declarator.type != TokenType::STRUCT_DECLARATOR)
+            continue;
+        auto field = make(SyntaxKind::FieldDecl, {out.range.first, parts[i].range.last});
+        const Node *inner = childOf(declarator, TokenType::DECLARATOR);
+        if (inner)
+            if (const Node *name = declaredName(*inner))
+                field->name = name->token;
+        field->type = spellType(*specifiers, inner);
+        field->children = std::move(parts[i].list);
+        out.list.push_back(field);
+    }
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerEnum(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    auto decl = make(SyntaxKind::EnumDecl, out.range);
+    if (const Node *tag = childOf(node, TokenType::ID))
+        decl->name = tag->token;
+    if (Lowered *list = kidOf(node, kids, TokenType::ENUMERATOR_LIST))
+        decl->children = std::move(list->list);
+    return decl;
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerDeclarator(SourceRange range, const Node *specifiers, const Node &declarator,
+                                                        std::vector<std::shared_ptr<SyntaxNode>> &parameters) const
+{
+    TokenType storage = specifiers ? storageClass(*specifiers) : TokenType::END;
+    SyntaxKind kind = SyntaxKind::VarDecl;
+    if (storage == TokenType::TYPEDEF)
+        kind = SyntaxKind::TypedefDecl;
+    else if (functionDeclarator(declarator))
+        kind = SyntaxKind::FunctionDecl;
+    auto decl = make(kind, range);
+    decl->op = storage;
+    if (const Node *name = declaredName(declarator))
+        decl->name = name->token;
+    if (specifiers)
+        decl->type = spellType(*specifiers, &declarator);
+    else
+        spell(declarator, decl->type);
+    if (kind == SyntaxKind::FunctionDecl)
+        lowerParameters(declarator, parameters, *decl);
+    return decl;
+}
+
+// parameters holds a ParamDecl with its range for each parameter declaration
+void SyntaxTree::lowerParameters(const Node &declarator, std::vector<std::shared_ptr<SyntaxNode>> &parameters, SyntaxNode &function) const
+{
+    const Node *direct = functionDeclarator(declarator);
+    if (!direct)
+        return;
+    if (const Node *identifiers = childOf(*direct, TokenType::IDENTIFIER_LIST))
+    {
+        // K&R: the types come from the declaration list after the declarator
+        for (const auto &name : identifiers->children)
+        {
+            if (name->type != TokenType::ID)
+                continue;
+            auto parameter = make(SyntaxKind::ParamDecl, {name->token, name->token});
+            parameter->name = name->token;
+            function.children.push_back(parameter);
+        }
+        return;
+    }
+    const Node *types = childOf(*direct, TokenType::PARAMETER_TYPE_LIST);
+    const Node *list = types ? childOf(*types, TokenType::PARAMETER_LIST) : nullptr;
+    if (!list)
+        return;
+    std::size_t next = 0;
+    for (const auto &declaration : list->children)
+    {
+        if (declaration->type != TokenType::PARAMETER_DECLARATION)
+            continue;
+        auto parameter = std::move(parameters[next++]);
+        const Node *specifiers = childOf(*declaration, TokenType::DECLARATION_SPECIFIERS);
+        const Node *inner = childOf(*declaration, TokenType::DECLARATOR);
+        if (!inner)
+            inner = childOf(*declaration, TokenType::ABSTRACT_DECLARATOR);
+        if (inner && inner->type == TokenType::DECLARATOR)
+            if (const Node *name = declaredName(*inner))
+                parameter->name = name->token;
+        if (specifiers)
+        {
+            parameter->op = storageClass(*specifiers);
+            parameter->type = spellType(*specifiers, inner);
+        }
+        function.children.push_back(parameter);
+    }
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerFunction(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    const Node *specifiers = childOf(node, TokenType::DECLARATION_SPECIFIERS);
+    const Node *declarator = childOf(node, TokenType::DECLARATOR);
+    if (!declarator)
+        return make(SyntaxKind::Invalid, out.range);
+    auto function = lowerDeclarator(out.range, specifiers, *declarator, kidOf(node, kids, TokenType::DECLARATOR)->list);
+    function->kind = SyntaxKind::FunctionDecl;
+    if (Lowered *list = kidOf(node, kids, TokenType::DECLARATION_LIST))
+    {
+        // K&R parameter declarations give the parameters their types
+        for (const auto &declaration : list->list)
+            for (const auto &parameter : function->children)
+                if (declaration->kind == SyntaxKind::VarDecl && name(*parameter) == name(*declaration))
+                    parameter->type = declaration->type;
+    }
+    TokenType body = childOf(node, TokenType::COMPOUND_STATEMENT) ? TokenType::COMPOUND_STATEMENT : TokenType::UNPARSED_BODY;
+    if (Lowered *lowered = kidOf(node, kids, body))
+        function->children.push_back(statement(*childOf(node, body), *lowered));
+    return function;
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerInitList(Lowered &list, SourceRange range) const
+{
+    auto init = make(SyntaxKind::InitList, range);
+    init->children = std::move(list.list);
+    return init;
+}
+
+// the elements of an initializer list, each designation folded into the
+// initializer after it
+void SyntaxTree::lowerInitItems(const Node &node, Lowered *kids, Lowered &out) const
+{
+    std::shared_ptr<SyntaxNode> designated;
+    for (std::size_t i = 0; i < node.children.size(); i++)
+    {
+        TokenType type = node.children[i]->type;
+        if (type == TokenType::DESIGNATION)
+            designated = std::move(kids[i].node);
+        else if (type == TokenType::INITIALIZER)
+        {
+            auto value = std::move(kids[i].node);
+            if (designated)
+            {
+                designated->range.last = value->range.last;
+                designated->children.push_back(value);
+                value = std::move(designated);
+            }
+            out.list.push_back(value);
+        }
+    }
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerStatement(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    const Node *first = childAt(node, 0);
+    TokenType keyword = first ? first->type : TokenType::END;
+    switch (node.type)
+    {
+    case TokenType::STATEMENT:
+    case TokenType::BLOCK_ITEM:
+        if (first)
+            return statement(*first, kids[0]);
+        break;
+    case TokenType::COMPOUND_STATEMENT:
+    {
+        auto block = make(SyntaxKind::CompoundStmt, out.range);
+        if (Lowered *items = kidOf(node, kids, TokenType::BLOCK_ITEM_LIST))
+            block->children = std::move(items->list);
+        return block;
+    }
+    case TokenType::UNPARSED_BODY:
+    {
+        auto body = make(SyntaxKind::UnparsedBody, out.range);
+        body->name = node.token;
+        return body;
+    }
+    case TokenType::EXPRESSION_STATEMENT:
+    {
+        Lowered *expression = kidOf(node, kids, TokenType::EXPRESSION);
+        auto statement = make(expression ? SyntaxKind::ExprStmt : SyntaxKind::NullStmt, out.range);
+        if (expression)
+            statement->children.push_back(this->expression(*childOf(node, TokenType::EXPRESSION), *expression));
+        return statement;
+    }
+    case TokenType::LABELED_STATEMENT:
+    {
+        SyntaxKind kind = keyword == TokenType::CASE ? SyntaxKind::CaseStmt : keyword == TokenType::DEFAULT ? SyntaxKind::DefaultStmt
+                                                                                                           : SyntaxKind::LabelStmt;
+        auto statement = make(kind, out.range);
+        if (kind == SyntaxKind::LabelStmt)
+            statement->name = first->token;
+        if (Lowered *value = kidOf(node, kids, TokenType::CONSTANT_EXPRESSION))
+            statement->children.push_back(expression(*childOf(node, TokenType::CONSTANT_EXPRESSION), *value));
+        if (Lowered *body = kidOf(node, kids, TokenType::STATEMENT))
+            statement->children.push_back(this->statement(*childOf(node, TokenType::STATEMENT), *body));
+        return statement;
+    }
+    case TokenType::SELECTION_STATEMENT:
+    case TokenType::ITERATION_STATEMENT:
+    {
+        SyntaxKind kind = keyword == TokenType::IF ? SyntaxKind::IfStmt : keyword == TokenType::SWITCH ? SyntaxKind::SwitchStmt
+                                                                      : keyword == TokenType::WHILE    ? SyntaxKind::WhileStmt
+                                                                      : keyword == TokenType::DO       ? SyntaxKind::DoStmt
+                                                                                                       : SyntaxKind::ForStmt;
+        auto statement = make(kind, out.range);
+        if (kind == SyntaxKind::ForStmt)
+        {
+            // init, condition and step may each be missing
+            std::shared_ptr<SyntaxNode> parts[4];
+            int clauses = 0;
+            for (std::size_t i = 0; i < node.children.size(); i++)
+            {
+                const Node &child = *node.children[i];
+                if (child.type == TokenType::DECLARATION)
+                    parts[clauses++] = this->statement(child, kids[i]);
+                else if (child.type == TokenType::EXPRESSION_STATEMENT && clauses < 2)
+                {
+                    // the expression of an ExprStmt, and nothing for a NullStmt
+                    if (kids[i].node->kind == SyntaxKind::ExprStmt)
+                        parts[clauses] = kids[i].node->children[0];
+                    clauses++;
+                }
+                else if (child.type == TokenType::EXPRESSION)
+                    parts[2] = expression(child, kids[i]);
+                else if (child.type == TokenType::STATEMENT)
+                    parts[3] = this->statement(child, kids[i]);
+            }
+            statement->children.assign(std::begin(parts), std::end(parts));
+            return statement;
+        }
+        // the children are in source order for every other kind: do puts the
+        // body before the condition
+        for (std::size_t i = 0; i < node.children.size(); i++)
+        {
+            const Node &child = *node.children[i];
+            if (child.type == TokenType::EXPRESSION)
+                statement->children.push_back(expression(child, kids[i]));
+            else if (child.type == TokenType::STATEMENT)
+                statement->children.push_back(this->statement(child, kids[i]));
+        }
+        return statement;
+    }
+    case TokenType::JUMP_STATEMENT:
+    {
+        SyntaxKind kind = keyword == TokenType::GOTO ? SyntaxKind::GotoStmt : keyword == TokenType::CONT ? SyntaxKind::ContinueStmt
+                                                                          : keyword == TokenType::BRK    ? SyntaxKind::BreakStmt
+                                                                                                         : SyntaxKind::ReturnStmt;
+        auto statement = make(kind, out.range);
+        if (const Node *label = childOf(node, TokenType::ID))
+            statement->name = label->token;
+        if (Lowered *value = kidOf(node, kids, TokenType::EXPRESSION))
+            statement->children.push_back(expression(*childOf(node, TokenType::EXPRESSION), *value));
+        return statement;
+    }
+    default:
+        break;
+    }
+    return make(SyntaxKind::Invalid, out.range);
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerExpression(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    const Node *first = childAt(node, 0);
+    if (!first)
+        return make(SyntaxKind::Invalid, out.range);
+    switch (node.type)
+    {
+    case TokenType::UNARY_EXPRESSION:
+        return lowerUnary(node, kids, out);
+    case TokenType::POSTFIX_EXPRESSION:
+        return lowerPostfix(node, kids, out);
+    case TokenType::PRIMARY_EXPRESSION:
+        // a parenthesized expression is its inner expression
+        if (Lowered *inner = kidOf(node, kids, TokenType::EXPRESSION))
+            return expression(*childOf(node, TokenType::EXPRESSION), *inner);
+        return expression(*first, kids[0]);
+    case TokenType::CONSTANT_EXPRESSION:
+        return expression(*first, kids[0]);
+    case TokenType::ASSIGNMENT_EXPRESSION:
+    case TokenType::CONDITIONAL_EXPRESSION:
+    {
+        if (node.children.size() == 1)
+            return expression(*first, kids[0]);
+        auto expression = make(node.type == TokenType::ASSIGNMENT_EXPRESSION ? SyntaxKind::AssignOp : SyntaxKind::ConditionalOp, out.range);
+        expression->op = node.children[1]->type;
+        for (std::size_t i = 0; i < node.children.size(); i++)
+            if (isNonterminal(node.children[i]->type))
+                expression->children.push_back(this->expression(*node.children[i], kids[i]));
+        return expression;
+    }
+    case TokenType::CAST_EXPRESSION:
+    {
+        if (first->type != TokenType::L_BR)
+            return expression(*first, kids[0]);
+        auto cast = make(SyntaxKind::CastExpr, out.range);
+        if (const Node *type = childOf(node, TokenType::TYPE_NAME))
+            spell(*type, cast->type);
+        if (Lowered *operand = kidOf(node, kids, TokenType::CAST_EXPRESSION))
+            cast->children.push_back(expression(*childOf(node, TokenType::CAST_EXPRESSION), *operand));
+        return cast;
+    }
+    case TokenType::GENERIC_SELECTION:
+    {
+        auto selection = make(SyntaxKind::GenericSelection, out.range);
+        if (Lowered *controlling = kidOf(node, kids, TokenType::ASSIGNMENT_EXPRESSION))
+            selection->children.push_back(expression(*childOf(node, TokenType::ASSIGNMENT_EXPRESSION), *controlling));
+        if (Lowered *list = kidOf(node, kids, TokenType::GENERIC_ASSOC_LIST))
+            for (auto &association : list->list)
+                selection->children.push_back(std::move(association));
+        return selection;
+    }
+    default:
+    {
+        // operand (operator operand)*, folded to the left
+        auto left = expression(*first, kids[0]);
+        for (std::size_t i = 1; i + 1 < node.children.size(); i += 2)
+        {
+            auto right = expression(*node.children[i + 1], kids[i + 1]);
+            auto binary = make(SyntaxKind::BinaryOp, {left->range.first, right->range.last});
+            binary->op = node.children[i]->type;
+            binary->children = {left, right};
+            left = binary;
+        }
+        return left;
+    }
+    }
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerUnary(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    const Node *first = node.children[0].get();
+    if (isNonterminal(first->type))
+        return expression(*first, kids[0]);
+    bool sizeofOperator = first->type == TokenType::SIZEOF || first->type == TokenType::ALIGNOF;
+    auto unary = make(sizeofOperator ? SyntaxKind::SizeofExpr : SyntaxKind::UnaryOp, out.range);
+    unary->op = first->type;
+    if (const Node *type = childOf(node, TokenType::TYPE_NAME))
+        spell(*type, unary->type);
+    else if (node.children.size() > 1)
+        unary->children.push_back(expression(*node.children[1], kids[1]));
+    return unary;
+}
+
+std::shared_ptr<SyntaxNode> SyntaxTree::lowerPostfix(const Node &node, Lowered *kids, const Lowered &out) const
+{
+    const auto &children = node.children;
+    std::shared_ptr<SyntaxNode> base;
+    std::size_t i = 1;
+    if (children[0]->type == TokenType::L_BR)
+    {
+        // ( type_name ) { initializer_list } with the operators after it
+        i = 0;
+        while (i < children.size() && children[i]->type != TokenType::R_CUR)
+            i++;
+        base = make(SyntaxKind::CompoundLiteral, {children[0]->token, i < children.size() ? children[i]->token : out.range.last});
+        if (const Node *type = childOf(node, TokenType::TYPE_NAME))
+            spell(*type, base->type);
+        if (Lowered *list = kidOf(node, kids, TokenType::INITIALIZER_LIST))
+            base->children.push_back(lowerInitList(*list, list->range));
+        i++;
+    }
+    else
+        base = expression(*children[0], kids[0]);
+
+    // each operator takes the expression so far as its first child
+    while (i < children.size())
+    {
+        TokenType op = children[i]->type;
+        std::size_t end = i + 1; // one past the last child the operator takes
+        SyntaxKind kind;
+        if (op == TokenType::L_SQR)
+        {
+            kind = SyntaxKind::IndexExpr;
+            end = std::min(i + 3, children.size());
+        }
+        else if (op == TokenType::L_BR)
+        {
+            kind = SyntaxKind::CallExpr;
+            while (end < children.size() && children[end - 1]->type != TokenType::R_BR)
+                end++;
+        }
+        else if (op == TokenType::DOT || op == TokenType::ARRORW)
+        {
+            kind = SyntaxKind::MemberExpr;
+            end = std::min(i + 2, children.size());
+        }
+        else if (op == TokenType::INC || op == TokenType::DEC)
+            kind = SyntaxKind::PostfixOp;
+        else
+        {
+            i++;
+            continue;
+        }
+        auto expression = make(kind, {base->range.first, kids[end - 1].range.last});
+        if (kind == SyntaxKind::MemberExpr || kind == SyntaxKind::PostfixOp)
+            expression->op = op;
+        expression->children.push_back(base);
+        for (std::size_t j = i + 1; j < end; j++)
+        {
+            const Node &operand = *children[j];
+            if (operand.type == TokenType::ARGUMENT_EXPRESSION_LIST)
+            {
+                for (auto &argument : kids[j].list)
+                    expression->children.push_back(std::move(argument));
+            }
+            else if (operand.type == TokenType::ID)
+                expression->name = operand.token;
+            else if (isNonterminal(operand.type))
+                expression->children.push_back(this->expression(operand, kids[j]));
+        }
+        base = expression;
+        i = end;
+    }
+    return base;
+}
+
+void SyntaxTree::print(DumpWriter &out) const
+{
+    std::vector<std::pair<const SyntaxNode *, int>> pending{{root.get(), 0}};
+    while (!pending.empty())
+    {
+        auto [node, depth] = pending.back();
+        pending.pop_back();
+        for (int indent = 0; indent < depth; indent++)
+            out << "  ";
+        if (!node)
+        {
+            out << "-\n";
+            continue;
+        }
+        out << syntaxKindName(node->kind);
+        if (node->op != TokenType::END)
+            out << " " << TokenToString::name(node->op);
+        if (node->name != Node::NO_TOKEN)
+            out << " " << name(*node);
+        if (!node->type.empty())
+            out << " '" << node->type << "'";
+        if (int first = line(*node))
+            out << " line " << first;
+        out << "\n";
+        for (auto child = node->children.rbegin(); child != node->children.rend(); ++child)
+            pending.push_back({child->get(), depth + 1});
+    }
+}
+
+void SyntaxTree::print(std::ostream &os) const
+{
+    DumpWriter out(os);
+    print(out);
+}
@@ -0,0 +1,157 @@
+#ifndef SYNTAX_HPP
+#define SYNTAX_HPP
+#include "AST.hpp"
+
+// The abstract syntax tree that a parse tree lowers to: one node per
+// declaration, statement and operation, without the punctuation, the
+// single-child grammar wrappers or the list non-terminals of the parse tree.
+enum class SyntaxKind
+{
+    TranslationUnit,
+    Include,
+    // Declarations
+    FunctionDecl, // ParamDecl..., then the body (CompoundStmt or UnparsedBody) when it has one
+    ParamDecl,
+    VarDecl, // the initializer, when it has one
+    TypedefDecl,
+    RecordDecl, // a struct or union with a body: FieldDecl...
+    FieldDecl,  // the bit-field width, when it has one
+    EnumDecl,   // EnumConstantDecl...
+    EnumConstantDecl, // the value, when it has one
+    StaticAssertDecl, // the condition, then the message Literal
+
+    // Statements
+    CompoundStmt,
+    DeclStmt, // the declarations of one declaration in a block
+    ExprStmt,
+    NullStmt,
+    IfStmt,     // condition, then, else when it has one
+    SwitchStmt, // condition, body
+    WhileStmt,  // condition, body
+    DoStmt,     // body, condition
+    ForStmt,    // init, condition, step, body; an absent part is nullptr
+    GotoStmt,
+    ContinueStmt,
+    BreakStmt,
+    ReturnStmt, // the value, when it has one
+    LabelStmt,  // the statement
+    CaseStmt,   // value, statement
+    DefaultStmt, // the statement
+    UnparsedBody, // a body a lazy parse skipped; name is its '{'
+
+    // Expressions
+    Identifier,
+    Literal, // op is CONSTANT, STRING_LITERAL or FUNC_NAME
+    BinaryOp, // left, right; op COMMA for the comma operator
+    AssignOp, // target, value
+    UnaryOp,  // operand; op INC and DEC are the prefix forms
+    PostfixOp, // operand; op INC or DEC
+    ConditionalOp, // condition, then, else
+    CastExpr, // operand
+    SizeofExpr, // op SIZEOF or ALIGNOF; the operand, or nothing when it names a type
+    CallExpr, // callee, arguments...
+    IndexExpr, // base, index
+    MemberExpr, // base; op DOT or ARRORW
+    CompoundLiteral, // the InitList
+    InitList, // elements, each an expression, InitList or DesignatedInit
+    DesignatedInit, // designators, then the value
+    FieldDesignator,
+    IndexDesignator, // the index
+    GenericSelection, // the controlling expression, then GenericAssociation...
+    GenericAssociation, // the value; type is empty for default
+
+    // what is left of a construct a syntax error cut short
+    Invalid
+};
+
+struct SyntaxNode
+{
+    SyntaxKind kind;
+    // the operator of an expression, the storage class of a declaration
+    // (END when it has none), or STRUCT or UNION for a RecordDecl
+    TokenType op = TokenType::END;
+    // the token of the declared name, the identifier, the member, the label,
+    // the designated field or the literal; NO_TOKEN when there is none
+    uint32_t name = Node::NO_TOKEN;
+    // the declared type without the name, as in "char *[4]", of declarations,
+    // casts, sizeof, compound literals and generic associations
+    std::string type;
+    SourceRange range;
+    std::vector<std::shared_ptr<SyntaxNode>> children;
+    SyntaxNode(SyntaxKind kind, SourceRange range) : kind(kind), range(range) {};
+    SyntaxNode(const SyntaxNode &) = default;
+    SyntaxNode(SyntaxNode &&) = default;
+    SyntaxNode &operator=(const SyntaxNode &) = default;
+    SyntaxNode &operator=(SyntaxNode &&) = default;
+    // frees the nodes that die with this one without recursing
+    ~SyntaxNode();
+};
+
+const std::string &syntaxKindName(SyntaxKind kind);
+
+// Lowers a parse tree, built by either engine and possibly cut short by
+// syntax errors, to SyntaxNodes. Only the token store is kept, so the parse
+// tree can be dropped as soon as the SyntaxTree is built.
+class SyntaxTree
+{
+private:
+    std::shared_ptr<SyntaxNode> root;
+    std::shared_ptr<const TokenStore> tokens;
+
+    // what the walk lowered a parse tree node to, kept on a stack until the
+    // walk leaves the node's parent
+    struct Lowered
+    {
+        SourceRange range; // the first and last token under the node
+        std::shared_ptr<SyntaxNode> node;
+        // the declarations, parameters, elements or arguments a node lowers to
+        std::vector<std::shared_ptr<SyntaxNode>> list;
+        // what the children of a declarator list lowered to, for the declaration
+        std::vector<Lowered> parts;
+    };
+
+    static SourceRange rangeOf(const Node &node, const Lowered *kids);
+    static Lowered *kidOf(const Node &node, Lowered *kids, TokenType type);
+    std::shared_ptr<SyntaxNode> make(SyntaxKind kind, SourceRange range) const;
+    void spell(const Node &node, std::string &out) const;
+    std::string spellType(const Node &specifiers, const Node *declarator) const;
+    TokenType storageClass(const Node &specifiers) const;
+    std::shared_ptr<SyntaxNode> expression(const Node &node, Lowered &lowered) const;
+    std::shared_ptr<SyntaxNode> statement(const Node &node, Lowered &lowered) const;
+
+    // kids holds what the children of node lowered to, in order
+    void lower(const Node &node, Lowered *kids, Lowered &out) const;
+    void lowerExternal(const Node &node, Lowered &lowered, std::vector<std::shared_ptr<SyntaxNode>> &out) const;
+    void lowerDeclaration(const Node &node, Lowered *kids, Lowered &out) const;
+    void lowerTags(const Node &specifiers, Lowered *kids, Lowered &out) const;
+    void lowerMember(const Node &node, Lowered *kids, Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerRecord(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerEnum(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerFunction(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerDeclarator(SourceRange range, const Node *specifiers, const Node &declarator,
+                                                std::vector<std::shared_ptr<SyntaxNode>> &parameters) const;
+    void lowerParameters(const Node &declarator, std::vector<std::shared_ptr<SyntaxNode>> &parameters, SyntaxNode &function) const;
+    std::shared_ptr<SyntaxNode> lowerInitList(Lowered &list, SourceRange range) const;
+    void lowerInitItems(const Node &node, Lowered *kids, Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerStatement(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerExpression(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerPostfix(const Node &node, Lowered *kids, const Lowered &out) const;
+    std::shared_ptr<SyntaxNode> lowerUnary(const Node &node, Lowered *kids, const Lowered &out) const;
+
+public:
+    // tokens is the store the leaves of root index
+    SyntaxTree(const Node &root, std::shared_ptr<const TokenStore> tokens);
+
+    inline const std::shared_ptr<SyntaxNode> &getRoot() const { return root; }
+    inline const std::shared_ptr<const TokenStore> &getTokens() const { return tokens; }
+    // the lexeme of the name of a node, or nothing
+    inline std::string_view name(const SyntaxNode &node) const
+    {
+        return node.name == Node::NO_TOKEN ? std::string_view() : std::string_view((*tokens)[node.name].lexeme);
+    }
+    // the line of the first token of a node, 0 when it has none
+    inline int line(const SyntaxNode &node) const { return node.range.first == Node::NO_TOKEN ? 0 : (*tokens)[node.range.first].lineNo; }
+    void print(DumpWriter &out) const;
+    void print(std::ostream &os) const;
+};
+#endif
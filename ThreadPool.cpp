@@ -0,0 +1,111 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned count)
+{
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < count; i++)
+        workers.push_back(std::make_unique<Worker>());
+    for (unsigned i = 0; i < count; i++)
+        threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+// the pool and worker the calling thread runs tasks for, if any
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local std::size_t currentWorker = 0;
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    std::size_t target = currentPool == this ? currentWorker : nextWorker++ % workers.size();
+    {
+        // counted while the deque is held, so that no worker can take the
+        // task, or find its deque empty, before queued says it is there
+        std::lock_guard<std::mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(std::move(task));
+        std::lock_guard<std::mutex> state(stateLock);
+        pending++;
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(stateLock);
+    idle.wait(guard, [this]
+              { return pending == 0; });
+}
+
+bool ThreadPool::take(std::size_t self, std::function<void()> &task)
+{
+    // with the deque's lock held, like the push
+    auto taken = [this]
+    {
+        std::lock_guard<std::mutex> state(stateLock);
+        queued--;
+        return true;
+    };
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return taken();
+        }
+    }
+    for (std::size_t i = 1; i < workers.size(); i++)
+    {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return taken();
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t self)
+{
+    currentPool = this;
+    currentWorker = self;
+    while (true)
+    {
+        std::function<void()> task;
+        if (!take(self, task))
+        {
+            // every deque was empty as it was looked at; queued is counted
+            // under their locks, so it is above zero only once one is not
+            std::unique_lock<std::mutex> guard(stateLock);
+            wake.wait(guard, [this]
+                      { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+            continue;
+        }
+        task();
+        bool finished;
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            finished = --pending == 0;
+        }
+        if (finished)
+            idle.notify_all();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: it takes its own
+// tasks from the back and, when that runs dry, steals from the front of the
+// others, so long and short tasks balance out without a central queue. Tasks
+// submitted from outside go round the deques in turn; a task that submits
+// more puts them on its own worker's deque, where that worker finds them
+// first.
+class ThreadPool
+{
+private:
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex stateLock;
+    std::condition_variable wake; // a task was queued or the pool is stopping
+    std::condition_variable idle; // pending dropped to zero
+    std::size_t queued = 0;       // tasks sitting in a deque, counted with its lock held
+    std::size_t pending = 0;      // tasks queued or running
+    std::atomic<std::size_t> nextWorker = 0;
+    bool stopping = false;
+
+    bool take(std::size_t self, std::function<void()> &task);
+    void run(std::size_t self);
+
+public:
+    // threads == 0 uses one thread per hardware core
+    explicit ThreadPool(unsigned threads = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    inline std::size_t size() const { return threads.size(); }
+    void submit(std::function<void()> task);
+    // blocks until every submitted task has finished
+    void wait();
+};
+#endif
@@ -1,4 +1,5 @@
 #include "Token.hpp"
+#include <array>
 
 const std::map<TokenType, std::string> TokenToString::table = {
 
@@ -51,6 +52,7 @@ const std::map<TokenType, std::string> TokenToString::table = {
     {TokenType::TYPE_QUALIFIER_LIST, "TYPE_QUALIFIER_LIST"},
     {TokenType::ELLIPSIS, "ELLIPSIS"},
     {TokenType::ID, "ID"},
+    {TokenType::TYPEDEF_NAME, "TYPEDEF_NAME"},
     {TokenType::INITIALIZER, "INITIALIZER"},
     {TokenType::BACKSLASH, "BACKSLASH"},
     {TokenType::GOTO, "GOTO"},
@@ -228,7 +230,11 @@ const std::map<TokenType, std::string> TokenToString::table = {
     {TokenType::FUNCTION_SPECIFIER, "FUNCTION_SPECIFIER"},
     {TokenType::STORAGE_CLASS_SPECIFIER, "STORAGE_CLASS_SPECIFIER"},
     {TokenType::TYPE_SPECIFIER, "TYPE_SPECIFIER"},
-    {TokenType::TYPE_QUALIFIER, "TYPE_QUALIFIER"}};
+    {TokenType::TYPE_QUALIFIER, "TYPE_QUALIFIER"},
+    {TokenType::ASSIGNMENT_OPERATOR, "ASSIGNMENT_OPERATOR"},
+    {TokenType::UNARY_OPERATOR, "UNARY_OPERATOR"},
+    {TokenType::STRUCT_OR_UNION, "STRUCT_OR_UNION"},
+    {TokenType::UNPARSED_BODY, "UNPARSED_BODY"}};
 
 std::string
 TokenToString::operator()(const TokenType &t)
@@ -241,6 +247,18 @@ std::string TokenToString::operator()(const TokenType &&t)
     auto itr = table.find(t);
     return itr->second;
 }
+std::string_view TokenToString::name(TokenType t)
+{
+    // indexed by TokenType, built once from table
+    static const std::array<std::string_view, TOKEN_TYPE_COUNT> names = []
+    {
+        std::array<std::string_view, TOKEN_TYPE_COUNT> names{};
+        for (const auto &entry : table)
+            names[static_cast<std::size_t>(entry.first)] = entry.second;
+        return names;
+    }();
+    return names[static_cast<std::size_t>(t)];
+}
 
 Token::Token() : type(TokenType::END), lineNo(1), lexeme("")
 {
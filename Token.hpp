@@ -1,7 +1,14 @@
 #ifndef TOKEN_HPP
 #define TOKEN_HPP
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 enum class TokenType
 { // operators: +-*/ %<><=>====...
     PLUS,
@@ -40,6 +47,7 @@ enum class TokenType
     RIGHT_SHIFT,
 
     ID, // for names of function, variable, array
+    TYPEDEF_NAME, // an ID declared by typedef; only used by the grammar, never produced by Scanner
 
     // keyword
     AUTO,
@@ -220,8 +228,23 @@ enum class TokenType
     FUNCTION_SPECIFIER,
     STORAGE_CLASS_SPECIFIER,
     TYPE_SPECIFIER,
-    TYPE_QUALIFIER
+    TYPE_QUALIFIER,
+
+    // grammar.y non-terminals the parse tree folds into their parent
+    ASSIGNMENT_OPERATOR,
+    UNARY_OPERATOR,
+    STRUCT_OR_UNION,
+
+    // a function body a lazy parse skipped; see AST::expandBody
+    UNPARSED_BODY
 };
+// number of TokenType values; keep in sync with the last enumerator
+constexpr std::size_t TOKEN_TYPE_COUNT = static_cast<std::size_t>(TokenType::UNPARSED_BODY) + 1;
+// every TokenType after END is a non-terminal of the grammar
+constexpr bool isNonterminal(TokenType t)
+{
+    return static_cast<std::size_t>(t) > static_cast<std::size_t>(TokenType::END);
+}
 
 // convert TokenType to std::string
 class TokenToString
@@ -235,6 +258,8 @@ public:
     TokenToString(TokenToString &t) = delete;
     std::string operator()(const TokenType &t);
     std::string operator()(const TokenType &&t);
+    // the same names without the map lookup or a copy, for the dumps
+    static std::string_view name(TokenType t);
     ~TokenToString() {};
 };
 struct Token
@@ -242,93 +267,129 @@ struct Token
     Token();
     Token(TokenType type, const std::string &lexeme, int lineNo = 1);
     Token(TokenType type, const std::string &&lexeme, int lineNo = 1);
-    inline bool isStmt(TokenType t)
-    {
-        switch (t)
-        {
-        case TokenType::TRANSLATION_UNIT:
-        case TokenType::EXTERNAL_DECLARATION:
-        case TokenType::FUNCTION_DEFINITION:
-        case TokenType::DECLARATION:
-        case TokenType::DECLARATION_LIST:
-        case TokenType::INCLUDE_STMT:
-        case TokenType::PRIMARY_EXPRESSION:
-        case TokenType::POSTFIX_EXPRESSION:
-        case TokenType::ARGUMENT_EXPRESSION_LIST:
-        case TokenType::UNARY_EXPRESSION:
-        case TokenType::CAST_EXPRESSION:
-        case TokenType::MULTIPLICATIVE_EXPRESSION:
-        case TokenType::ADDITIVE_EXPRESSION:
-        case TokenType::SHIFT_EXPRESSION:
-        case TokenType::RELATIONAL_EXPRESSION:
-        case TokenType::EQUALITY_EXPRESSION:
-        case TokenType::AND_EXPRESSION:
-        case TokenType::EXCLUSIVE_OR_EXPRESSION:
-        case TokenType::INCLUSIVE_OR_EXPRESSION:
-        case TokenType::LOGICAL_AND_EXPRESSION:
-        case TokenType::LOGICAL_OR_EXPRESSION:
-        case TokenType::CONDITIONAL_EXPRESSION:
-        case TokenType::ASSIGNMENT_EXPRESSION:
-        case TokenType::EXPRESSION:
-        case TokenType::CONSTANT_EXPRESSION:
-        case TokenType::STRUCT_UNION_SPECIFIER:
-        case TokenType::STRUCT_DECLARATION_LIST:
-        case TokenType::SPECIFIER_QUALIFIER_LIST:
-        case TokenType::STRUCT_DECLARATION:
-        case TokenType::STRUCT_DECLARATOR:
-        case TokenType::STRUCT_DECLARATOR_LIST:
-        case TokenType::DECLARATOR:
-        case TokenType::DIRECT_DECLARATOR:
-        case TokenType::POINTER:
-        case TokenType::PARAMETER_TYPE_LIST:
-        case TokenType::PARAMETER_LIST:
-        case TokenType::PARAMETER_DECLARATION:
-        case TokenType::DECLARATION_SPECIFIERS:
-        case TokenType::INIT_DECLARATOR:
-        case TokenType::INIT_DECLARATOR_LIST:
-        case TokenType::ABSTRACT_DECLARATOR:
-        case TokenType::IDENTIFIER_LIST:
-        case TokenType::DIRECT_ABSTRACT_DECLARATOR:
-        case TokenType::TYPE_QUALIFIER_LIST:
-        case TokenType::TYPE_NAME:
-        case TokenType::INITIALIZER:
-        case TokenType::INITIALIZER_LIST:
-        case TokenType::DESIGNATION:
-        case TokenType::DESIGNATOR_LIST:
-        case TokenType::DESIGNATOR:
-        case TokenType::ENUM_SPECIFIER:
-        case TokenType::ENUMERATOR_LIST:
-        case TokenType::ENUMERATOR:
-        case TokenType::STATEMENT:
-        case TokenType::LABELED_STATEMENT:
-        case TokenType::COMPOUND_STATEMENT:
-        case TokenType::BLOCK_ITEM_LIST:
-        case TokenType::BLOCK_ITEM:
-        case TokenType::EXPRESSION_STATEMENT:
-        case TokenType::SELECTION_STATEMENT:
-        case TokenType::ITERATION_STATEMENT:
-        case TokenType::JUMP_STATEMENT:
-        case TokenType::GENERIC_SELECTION:
-        case TokenType::GENERIC_ASSOC_LIST:
-        case TokenType::GENERIC_ASSOCIATION:
-        case TokenType::STATIC_ASSERT_DECLARATION:
-        case TokenType::ALIGNMENT_SPECIFIER:
-        case TokenType::ATOMIC_TYPE_SPECIFIER:
-        case TokenType::FUNCTION_SPECIFIER:
-        case TokenType::STORAGE_CLASS_SPECIFIER:
-        case TokenType::TYPE_SPECIFIER:
-        case TokenType::TYPE_QUALIFIER:
-            return true;
-        default:
-            return false;
-        }
-    }
+    inline bool isStmt(TokenType t) { return isNonterminal(t); }
     TokenType type;
     int lineNo;
+    // byte offset of the token in the source; -1 when it was not read from there
+    int offset = -1;
     ~Token() = default;
     std::string lexeme;
 };
 
+// Every token of a file in the order the Scanner read it. Tokens are only
+// ever appended and never move, so a 32-bit index names one for the life of
+// the store; the parse tree, diagnostics and tools all refer to tokens that
+// way and can share one store. The tokens sit in fixed blocks that clear()
+// keeps, so a store that is reused for the next file does not allocate again
+// until it outgrows the last. A reader that is done with the start of the
+// file can release() it, and its blocks are used again for the tokens to come.
+class TokenStore
+{
+public:
+    // tokens per block
+    static constexpr uint32_t BLOCK = 256;
+
+private:
+    std::vector<std::unique_ptr<Token[]>> blocks;
+    uint32_t count = 0;
+    // blocks [0, released) were given back to spare by release()
+    uint32_t released = 0;
+    std::vector<std::unique_ptr<Token[]>> spare;
+
+    inline Token &slot(uint32_t index) const { return blocks[index / BLOCK][index % BLOCK]; }
+    inline std::unique_ptr<Token[]> takeBlock()
+    {
+        if (spare.empty())
+            return std::make_unique<Token[]>(BLOCK);
+        auto block = std::move(spare.back());
+        spare.pop_back();
+        return block;
+    }
+
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    // An index into the store. It stays valid while tokens are appended;
+    // stepping past the last token gives end().
+    class iterator
+    {
+    private:
+        TokenStore *store = nullptr;
+        uint32_t position = npos;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Token *;
+        using reference = Token &;
+
+        iterator() = default;
+        iterator(TokenStore *store, uint32_t position) : store(store), position(position) {}
+        inline uint32_t index() const { return position; }
+        inline Token &operator*() const { return store->slot(position); }
+        inline Token *operator->() const { return &store->slot(position); }
+        inline iterator &operator++()
+        {
+            position = position + 1 < store->size() ? position + 1 : npos;
+            return *this;
+        }
+        inline iterator &operator--()
+        {
+            position = position == npos ? store->size() - 1 : position - 1;
+            return *this;
+        }
+        inline iterator operator++(int)
+        {
+            iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        inline iterator operator--(int)
+        {
+            iterator ret = *this;
+            --*this;
+            return ret;
+        }
+        inline bool operator==(const iterator &other) const { return position == other.position; }
+        inline bool operator!=(const iterator &other) const { return position != other.position; }
+    };
+
+    inline Token &operator[](uint32_t index) { return slot(index); }
+    inline const Token &operator[](uint32_t index) const { return slot(index); }
+    inline uint32_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    inline Token &back() { return slot(count - 1); }
+    inline void push_back(Token &&t)
+    {
+        if (count == blocks.size() * BLOCK)
+            blocks.push_back(takeBlock());
+        slot(count++) = std::move(t);
+    }
+    inline void push_back(const Token &t) { push_back(Token(t)); }
+    // the blocks, and the lexeme buffers in them, are kept for reuse
+    inline void clear()
+    {
+        for (uint32_t b = 0; b < released; b++)
+            blocks[b] = takeBlock();
+        released = 0;
+        count = 0;
+    }
+    // drops every token from index on; index is not below a release()
+    inline void truncate(uint32_t index) { count = std::min(index, count); }
+    // gives back the blocks that hold only tokens before index, which must
+    // not be read again; indices stay as they are
+    inline void release(uint32_t index)
+    {
+        for (; released < blocks.size() && (released + 1) * BLOCK <= std::min(index, count); released++)
+            spare.push_back(std::move(blocks[released]));
+    }
+    // the token at index, or end() past the last one
+    inline iterator at(uint32_t index) { return iterator(this, index < size() ? index : npos); }
+    inline iterator begin() { return at(0); }
+    inline iterator end() { return iterator(this, npos); }
+};
+
 class Directive
 {
 private:
@@ -0,0 +1,101 @@
+#include "TokenCache.hpp"
+#include <sys/stat.h>
+#include <fstream>
+
+// the file at path lexed, or nullptr when it cannot be read
+static std::shared_ptr<const TokenCache::Lexed> lexFile(const std::string &path)
+{
+    std::ifstream file(path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+    if (!file)
+        return nullptr;
+    std::string text(file.tellg(), '\0');
+    file.seekg(0);
+    file.read(text.data(), text.size());
+    text.resize(file.gcount());
+    auto lexed = std::make_shared<TokenCache::Lexed>();
+    Scanner scanner(text, path, lexed->errors);
+    lexed->tokens = scanner.takeTokens();
+    lexed->macros = scanner.macros();
+    lexed->bytes = text.size() + uint64_t(lexed->tokens->size()) * sizeof(Token);
+    return lexed;
+}
+
+std::shared_ptr<const TokenCache::Lexed> TokenCache::lex(const std::string &path)
+{
+    struct stat status;
+    if (!hasSourceExtension(path) || stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+        return nullptr;
+    uint64_t size = status.st_size;
+    int64_t modified = int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+    Shard &shard = shardOf(path);
+    std::shared_future<std::shared_ptr<const Lexed>> found;
+    {
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        auto itr = shard.slots.find(path);
+        if (itr != shard.slots.end() && itr->second.size == size && itr->second.modified == modified)
+            found = itr->second.lexed;
+    }
+    // on a miss the first thread to take the slot lexes the file, and any
+    // other that comes for it meanwhile waits for that
+    std::promise<std::shared_ptr<const Lexed>> promise;
+    bool lexing = false;
+    if (!found.valid())
+    {
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        auto [itr, added] = shard.slots.try_emplace(path);
+        if (!added && itr->second.size == size && itr->second.modified == modified)
+            found = itr->second.lexed;
+        else
+        {
+            // new, or the file changed since
+            itr->second = {size, modified, promise.get_future().share()};
+            found = itr->second.lexed;
+            lexing = true;
+        }
+    }
+    if (!lexing)
+    {
+        hits++;
+        return found.get();
+    }
+    misses++;
+    std::shared_ptr<const Lexed> lexed = lexFile(path);
+    promise.set_value(lexed);
+    if (lexed)
+        account(path, modified, lexed->bytes);
+    else
+    {
+        // so that the next one tries again
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        auto itr = shard.slots.find(path);
+        if (itr != shard.slots.end() && itr->second.modified == modified)
+            shard.slots.erase(itr);
+    }
+    return lexed;
+}
+
+void TokenCache::account(const std::string &path, int64_t modified, uint64_t bytes)
+{
+    std::vector<Added> dropped;
+    {
+        std::lock_guard<std::mutex> guard(orderLock);
+        order.push_back({path, modified, bytes});
+        total += bytes;
+        // the newest stays, however large
+        while (total > capacity && order.size() > 1)
+        {
+            total -= order.front().bytes;
+            dropped.push_back(std::move(order.front()));
+            order.pop_front();
+        }
+    }
+    for (const auto &entry : dropped)
+    {
+        Shard &shard = shardOf(entry.path);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        auto itr = shard.slots.find(entry.path);
+        // unless the file changed and its slot is a newer entry
+        if (itr != shard.slots.end() && itr->second.modified == entry.modified)
+            shard.slots.erase(itr);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef TOKEN_CACHE_HPP
+#define TOKEN_CACHE_HPP
+#include "AST.hpp"
+#include <deque>
+#include <future>
+#include <shared_mutex>
+
+// Files lexed once and kept for the life of the process, so that a file
+// parsed again, by a later request of a worker or by another file's worker of
+// a batch that lists it twice, is neither read nor lexed again: the parse
+// replays the frozen tokens (see the AST constructor that takes them). An
+// entry is found by path and stands for the file while its size and
+// modification time stay the same; a file always starts lexing with no macro
+// defined, since #include lines are kept, not read, so nothing else decides
+// what it lexes to.
+//
+// Any number of threads share one cache. The entries are spread over shards,
+// each behind a reader-writer lock, so lookups only ever wait for a thread
+// that is adding to the same shard. The first thread to miss a file lexes it
+// while the others that want it wait for its result instead of lexing it as
+// well. The oldest entries are dropped once the tokens add up to more than
+// the capacity; parses still holding them keep them alive.
+class TokenCache
+{
+public:
+    // one file lexed: its tokens up to END, with the errors and macros the
+    // lexing left
+    struct Lexed
+    {
+        std::shared_ptr<TokenStore> tokens;
+        std::map<std::string, Scanner::Macro> macros;
+        Error errors;
+        uint64_t bytes = 0; // roughly what it holds in memory
+    };
+
+private:
+    struct Slot
+    {
+        uint64_t size;
+        int64_t modified;
+        std::shared_future<std::shared_ptr<const Lexed>> lexed;
+    };
+    struct Added
+    {
+        std::string path;
+        int64_t modified;
+        uint64_t bytes;
+    };
+    struct Shard
+    {
+        std::shared_mutex lock;
+        std::unordered_map<std::string, Slot> slots;
+    };
+    static constexpr std::size_t SHARDS = 16;
+    Shard shards[SHARDS];
+    uint64_t capacity;
+    // the entries in the order they were added, for dropping the oldest
+    std::mutex orderLock;
+    std::deque<Added> order;
+    uint64_t total = 0;
+    std::atomic<uint64_t> hits = 0, misses = 0;
+
+    inline Shard &shardOf(const std::string &path) { return shards[std::hash<std::string>()(path) % SHARDS]; }
+    // counts a new entry of bytes and drops the oldest past the capacity
+    void account(const std::string &path, int64_t modified, uint64_t bytes);
+
+public:
+    static constexpr uint64_t DEFAULT_CAPACITY = uint64_t(256) << 20;
+
+    explicit TokenCache(uint64_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+    TokenCache(const TokenCache &) = delete;
+    TokenCache &operator=(const TokenCache &) = delete;
+
+    // whether a parse with options can replay cached tokens: not when a
+    // budget can stop the lexing, or the parse, at a different place
+    static inline bool replayable(const ParseOptions &options) { return !options.budget.limited(); }
+
+    // the file at path lexed, from the cache or lexed now and added; nullptr
+    // when it is not a source file or cannot be read
+    std::shared_ptr<const Lexed> lex(const std::string &path);
+
+    inline uint64_t hitCount() const { return hits; }
+    inline uint64_t missCount() const { return misses; }
+};
+#endif
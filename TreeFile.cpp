@@ -0,0 +1,276 @@
+#include "TreeFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <unordered_map>
+
+static constexpr char TREE_FILE_MAGIC[8] = {'C', 'T', 'R', 'E', 'E', '\0', '\r', '\n'};
+static constexpr uint16_t TREE_FILE_BYTE_ORDER = 0x0102;
+
+static inline uint64_t aligned(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+void writeTreeFile(const FlatTree &tree, std::string_view name, const Error *errors, DumpWriter &out)
+{
+    const TokenStore &store = *tree.getTokens();
+    uint32_t nodes = tree.nodeCount();
+
+    // intern the lexemes while the token table is built; the store outlives
+    // both, so the keys can point into it
+    std::string strings;
+    std::unordered_map<std::string_view, uint32_t> interned;
+    auto intern = [&](std::string_view text)
+    {
+        auto [found, added] = interned.try_emplace(text, static_cast<uint32_t>(strings.size()));
+        if (added)
+        {
+            strings.append(text);
+            strings.push_back('\0');
+        }
+        return found->second;
+    };
+    std::vector<TreeFileToken> table(store.size());
+    for (uint32_t t = 0; t < store.size(); t++)
+    {
+        const Token &token = store[t];
+        table[t] = {intern(token.lexeme), static_cast<uint32_t>(token.lexeme.size()), token.lineNo, token.offset, static_cast<uint16_t>(token.type), 0};
+    }
+    uint32_t nameAt = intern(name);
+    std::vector<TreeFileError> errorTable;
+    auto error = [&](int line, uint8_t kind, const std::string &message)
+    {
+        errorTable.push_back({line, intern(message), static_cast<uint32_t>(message.size()), kind, {}});
+    };
+    if (errors)
+    {
+        for (const auto &entry : errors->errors)
+            error(entry.first, TreeFileError::LEXICAL, entry.second);
+        for (const auto &entry : errors->grammarErrors)
+            error(entry.first, TreeFileError::GRAMMAR, entry.second);
+    }
+
+    TreeFileHeader header{};
+    std::memcpy(header.magic, TREE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TREE_FILE_VERSION;
+    header.byteOrder = TREE_FILE_BYTE_ORDER;
+    header.kindCount = TOKEN_TYPE_COUNT;
+    header.nodeCount = nodes;
+    header.tokenCount = store.size();
+    header.stringBytes = strings.size();
+    header.kinds = aligned(sizeof(TreeFileHeader));
+    header.tokens = aligned(header.kinds + nodes * sizeof(uint16_t));
+    header.sizes = aligned(header.tokens + nodes * sizeof(uint32_t));
+    header.parents = aligned(header.sizes + nodes * sizeof(uint32_t));
+    header.tokenTable = aligned(header.parents + nodes * sizeof(uint32_t));
+    header.errors = aligned(header.tokenTable + table.size() * sizeof(TreeFileToken));
+    header.strings = aligned(header.errors + errorTable.size() * sizeof(TreeFileError));
+    header.name = nameAt;
+    header.nameLength = static_cast<uint32_t>(name.size());
+    header.errorCount = static_cast<uint32_t>(errorTable.size());
+
+    uint64_t written = 0;
+    auto bytes = [&](const void *data, std::size_t size)
+    {
+        out << std::string_view(static_cast<const char *>(data), size);
+        written += size;
+    };
+    auto pad = [&](uint64_t to)
+    {
+        for (; written < to; written++)
+            out << '\0';
+    };
+    // each array straight from the tree, a section at a time
+    auto section = [&](uint64_t at, auto read, auto type)
+    {
+        pad(at);
+        for (uint32_t i = 0; i < nodes; i++)
+        {
+            decltype(type) value = read(i);
+            bytes(&value, sizeof(value));
+        }
+    };
+    bytes(&header, sizeof(header));
+    section(header.kinds, [&](uint32_t i) { return static_cast<uint16_t>(tree.kind(i)); }, uint16_t());
+    section(header.tokens, [&](uint32_t i) { return tree.token(i); }, uint32_t());
+    section(header.sizes, [&](uint32_t i) { return tree.subtreeSize(i); }, uint32_t());
+    section(header.parents, [&](uint32_t i) { return tree.parent(i); }, uint32_t());
+    pad(header.tokenTable);
+    bytes(table.data(), table.size() * sizeof(TreeFileToken));
+    pad(header.errors);
+    bytes(errorTable.data(), errorTable.size() * sizeof(TreeFileError));
+    pad(header.strings);
+    bytes(strings.data(), strings.size());
+}
+
+bool saveTreeFile(const FlatTree &tree, std::string_view name, const Error *errors, const std::string &path)
+{
+    return replaceFile(path, [&](DumpWriter &out)
+                       { writeTreeFile(tree, name, errors, out); });
+}
+
+void TreeFile::unmap()
+{
+    if (base)
+        munmap(const_cast<char *>(base), length);
+    base = nullptr;
+    length = 0;
+    header = nullptr;
+}
+
+bool TreeFile::open(const std::string &path, std::string &why)
+{
+    unmap();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        why = "cannot open " + path;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(TreeFileHeader))
+    {
+        ::close(fd);
+        why = path + " is too short to be a tree file";
+        return false;
+    }
+    void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        why = "cannot map " + path;
+        return false;
+    }
+    base = static_cast<const char *>(mapped);
+    length = status.st_size;
+
+    const auto *candidate = reinterpret_cast<const TreeFileHeader *>(base);
+    auto fail = [&](const std::string &reason)
+    {
+        unmap();
+        why = path + ": " + reason;
+        return false;
+    };
+    if (std::memcmp(candidate->magic, TREE_FILE_MAGIC, sizeof(candidate->magic)) != 0)
+        return fail("not a tree file");
+    if (candidate->byteOrder != TREE_FILE_BYTE_ORDER)
+        return fail("written with another byte order");
+    if (candidate->version != TREE_FILE_VERSION || candidate->kindCount != TOKEN_TYPE_COUNT)
+        return fail("tree file version " + std::to_string(candidate->version) + ", this reader reads " + std::to_string(TREE_FILE_VERSION));
+    // every section aligned and inside the file
+    auto inside = [&](uint64_t at, uint64_t bytes)
+    {
+        return at % 8 == 0 && at <= length && bytes <= length - at;
+    };
+    uint64_t nodes = candidate->nodeCount;
+    if (nodes == 0 ||
+        !inside(candidate->kinds, nodes * sizeof(uint16_t)) ||
+        !inside(candidate->tokens, nodes * sizeof(uint32_t)) ||
+        !inside(candidate->sizes, nodes * sizeof(uint32_t)) ||
+        !inside(candidate->parents, nodes * sizeof(uint32_t)) ||
+        !inside(candidate->tokenTable, uint64_t(candidate->tokenCount) * sizeof(TreeFileToken)) ||
+        !inside(candidate->errors, uint64_t(candidate->errorCount) * sizeof(TreeFileError)) ||
+        !inside(candidate->strings, candidate->stringBytes) ||
+        uint64_t(candidate->name) + candidate->nameLength > candidate->stringBytes)
+        return fail("truncated or damaged");
+
+    header = candidate;
+    kinds = reinterpret_cast<const uint16_t *>(base + header->kinds);
+    tokens = reinterpret_cast<const uint32_t *>(base + header->tokens);
+    sizes = reinterpret_cast<const uint32_t *>(base + header->sizes);
+    parents = reinterpret_cast<const uint32_t *>(base + header->parents);
+    tokenTable = reinterpret_cast<const TreeFileToken *>(base + header->tokenTable);
+    errorTable = reinterpret_cast<const TreeFileError *>(base + header->errors);
+    strings = base + header->strings;
+    if (!validate())
+        return fail("truncated or damaged");
+    return true;
+}
+
+bool TreeFile::validate() const
+{
+    uint64_t stringBytes = header->stringBytes;
+    auto inStrings = [&](uint32_t at, uint32_t bytes)
+    {
+        return uint64_t(at) + bytes <= stringBytes;
+    };
+    for (uint32_t t = 0; t < header->tokenCount; t++)
+        if (tokenTable[t].type >= TOKEN_TYPE_COUNT || !inStrings(tokenTable[t].lexeme, tokenTable[t].length))
+            return false;
+    for (uint32_t e = 0; e < header->errorCount; e++)
+        if (errorTable[e].kind > TreeFileError::GRAMMAR || !inStrings(errorTable[e].message, errorTable[e].length))
+            return false;
+
+    // one pass in preorder, with the nodes whose subtrees i is inside: each
+    // subtree has to end within its parent's, and the parent has to be the
+    // innermost of them, so that every walk by sizes stays inside the arrays
+    uint32_t nodes = header->nodeCount;
+    if (sizes[0] != nodes || parents[0] != FlatTree::NO_PARENT)
+        return false;
+    std::vector<uint32_t> open;
+    for (uint32_t i = 0; i < nodes; i++)
+    {
+        if (kinds[i] >= TOKEN_TYPE_COUNT || (tokens[i] != Node::NO_TOKEN && tokens[i] >= header->tokenCount))
+            return false;
+        if (sizes[i] == 0 || sizes[i] > nodes - i)
+            return false;
+        while (!open.empty() && subtreeEnd(open.back()) <= i)
+            open.pop_back();
+        if (i > 0 && (open.empty() || parents[i] != open.back() || subtreeEnd(i) > subtreeEnd(open.back())))
+            return false;
+        open.push_back(i);
+    }
+    return true;
+}
+
+void TreeFile::loadErrors(Error &errors) const
+{
+    for (uint32_t e = 0; e < errorCount(); e++)
+    {
+        const TreeFileError &error = errorTable[e];
+        if (error.kind == TreeFileError::LEXICAL)
+            errors.errors.emplace(error.line, std::string(errorMessage(e)));
+        else
+            errors.grammarErrors.emplace_back(error.line, std::string(errorMessage(e)));
+    }
+}
+
+uint32_t TreeFile::childCount(uint32_t i) const
+{
+    uint32_t count = 0;
+    for (auto child = i + 1, end = subtreeEnd(i); child < end; child += sizes[child])
+        count++;
+    return count;
+}
+
+void TreeFile::print(DumpWriter &out) const
+{
+    // the nodes whose children are being printed, with the length the prefix
+    // had before each; a node is done once i reaches the end of its subtree
+    struct Open
+    {
+        uint32_t end;
+        std::size_t length;
+    };
+    std::vector<Open> open;
+    std::string prefix;
+    for (uint32_t i = 0; i < nodeCount(); i++)
+    {
+        while (!open.empty() && open.back().end <= i)
+        {
+            prefix.resize(open.back().length);
+            open.pop_back();
+        }
+        bool last = open.empty() || subtreeEnd(i) == open.back().end;
+        bool nested = !open.empty();
+        if (nested)
+            out << prefix << (last ? "└── " : "├── ");
+        out << "Token: " << TokenToString::name(kind(i)) << " ";
+        out << "lexeme: " << lexeme(i) << '\n';
+        if (isLeaf(i))
+            continue;
+        open.push_back({subtreeEnd(i), prefix.size()});
+        if (nested)
+            prefix += last ? "    " : "│   ";
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef TREE_FILE_HPP
+#define TREE_FILE_HPP
+#include "FlatTree.hpp"
+#include "DumpWriter.hpp"
+#include "Error.hpp"
+
+// A FlatTree on disk, for the tools that run after the parser: they map the
+// file and read the tree where it lies instead of parsing the source again.
+// Every section starts on an 8-byte boundary, in this order:
+//
+//   TreeFileHeader
+//   kinds       uint16_t[nodeCount]      TokenType of each node, in preorder
+//   tokens      uint32_t[nodeCount]      index into the token table, or Node::NO_TOKEN
+//   sizes       uint32_t[nodeCount]      subtree sizes, as in FlatTree
+//   parents     uint32_t[nodeCount]      FlatTree::NO_PARENT for the root
+//   tokenTable  TreeFileToken[tokenCount] every token of the file, in order
+//   errors      TreeFileError[errorCount] the lexical errors by line, then the
+//                                        grammar errors in the order found
+//   strings     char[stringBytes]        each distinct lexeme and message once,
+//                                        NUL-terminated
+//
+// Numbers are in the byte order of the machine that wrote the file, and kinds
+// are TokenType values, so TREE_FILE_VERSION goes up whenever TokenType or the
+// layout changes; a reader refuses a file of another version, byte order or
+// kind count.
+constexpr uint32_t TREE_FILE_VERSION = 2;
+
+struct TreeFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint16_t byteOrder; // 0x0102 as the writer stored it
+    uint16_t kindCount; // TOKEN_TYPE_COUNT of the writer
+    uint32_t nodeCount;
+    uint32_t tokenCount;
+    uint64_t stringBytes;
+    // byte offsets of the sections from the start of the file
+    uint64_t kinds;
+    uint64_t tokens;
+    uint64_t sizes;
+    uint64_t parents;
+    uint64_t tokenTable;
+    uint64_t errors;
+    uint64_t strings;
+    // the name of the source, within strings
+    uint32_t name;
+    uint32_t nameLength;
+    uint32_t errorCount;
+    uint32_t reserved;
+};
+
+struct TreeFileToken
+{
+    uint32_t lexeme; // offset within strings
+    uint32_t length;
+    int32_t line;
+    int32_t offset; // byte offset in the source, -1 when not read from there
+    uint16_t type;
+    uint16_t reserved;
+};
+
+struct TreeFileError
+{
+    static constexpr uint8_t LEXICAL = 0;
+    static constexpr uint8_t GRAMMAR = 1;
+    int32_t line;
+    uint32_t message; // offset within strings
+    uint32_t length;
+    uint8_t kind;
+    uint8_t reserved[3];
+};
+
+// writes tree, whose leaves index its token store, in one pass; name is
+// what the root's lexeme reads back as, and errors, when given, what the
+// parse reported
+void writeTreeFile(const FlatTree &tree, std::string_view name, const Error *errors, DumpWriter &out);
+// the same into the file at path, written under a temporary name and renamed
+// (see replaceFile); false when it cannot be written
+bool saveTreeFile(const FlatTree &tree, std::string_view name, const Error *errors, const std::string &path);
+
+// A tree file mapped read-only. Opening checks the header, that the sections
+// lie inside the file, and in one pass over the arrays that every kind, token
+// index, subtree size, parent and string offset points where it may, so that
+// a damaged file is refused rather than read out of bounds. The arrays are
+// then read in place; the accessors are FlatTree's.
+class TreeFile
+{
+private:
+    const char *base = nullptr;
+    std::size_t length = 0;
+    const TreeFileHeader *header = nullptr;
+    const uint16_t *kinds = nullptr;
+    const uint32_t *tokens = nullptr;
+    const uint32_t *sizes = nullptr;
+    const uint32_t *parents = nullptr;
+    const TreeFileToken *tokenTable = nullptr;
+    const TreeFileError *errorTable = nullptr;
+    const char *strings = nullptr;
+
+    void unmap();
+    // the arrays of the mapped header, as open() describes
+    bool validate() const;
+
+public:
+    class ChildIterator
+    {
+    private:
+        const uint32_t *sizes;
+        uint32_t position;
+
+    public:
+        ChildIterator(const uint32_t *sizes, uint32_t position) : sizes(sizes), position(position) {}
+        inline uint32_t operator*() const { return position; }
+        inline ChildIterator &operator++()
+        {
+            position += sizes[position];
+            return *this;
+        }
+        inline bool operator==(const ChildIterator &other) const { return position == other.position; }
+        inline bool operator!=(const ChildIterator &other) const { return position != other.position; }
+    };
+    struct ChildRange
+    {
+        ChildIterator first;
+        ChildIterator last;
+        inline ChildIterator begin() const { return first; }
+        inline ChildIterator end() const { return last; }
+    };
+
+    TreeFile() = default;
+    TreeFile(const TreeFile &) = delete;
+    TreeFile &operator=(const TreeFile &) = delete;
+    ~TreeFile() { unmap(); }
+
+    // maps the file at path, dropping any file mapped before; false, with the
+    // reason in why, when it cannot be read or is not a tree file this reader
+    // understands
+    bool open(const std::string &path, std::string &why);
+    inline bool isOpen() const { return header != nullptr; }
+
+    inline uint32_t nodeCount() const { return header->nodeCount; }
+    inline TokenType kind(uint32_t i) const { return static_cast<TokenType>(kinds[i]); }
+    inline uint32_t token(uint32_t i) const { return tokens[i]; }
+    inline uint32_t subtreeSize(uint32_t i) const { return sizes[i]; }
+    inline uint32_t subtreeEnd(uint32_t i) const { return i + sizes[i]; }
+    inline uint32_t parent(uint32_t i) const { return parents[i]; }
+    inline bool isLeaf(uint32_t i) const { return sizes[i] == 1; }
+    inline ChildRange children(uint32_t i) const { return {ChildIterator(sizes, i + 1), ChildIterator(sizes, i + sizes[i])}; }
+    uint32_t childCount(uint32_t i) const;
+    template <typename Visit>
+    void walk(uint32_t root, Visit &&visit) const
+    {
+        for (uint32_t i = root, end = subtreeEnd(root); i < end;)
+            i = visit(i) ? i + 1 : subtreeEnd(i);
+    }
+
+    // the token table
+    inline uint32_t tokenCount() const { return header->tokenCount; }
+    inline const TreeFileToken &tokenAt(uint32_t t) const { return tokenTable[t]; }
+    inline std::string_view tokenLexeme(uint32_t t) const { return {strings + tokenTable[t].lexeme, tokenTable[t].length}; }
+
+    // the errors
+    inline uint32_t errorCount() const { return header->errorCount; }
+    inline const TreeFileError &errorAt(uint32_t e) const { return errorTable[e]; }
+    inline std::string_view errorMessage(uint32_t e) const { return {strings + errorTable[e].message, errorTable[e].length}; }
+    // adds the errors to errors as the parse reported them
+    void loadErrors(Error &errors) const;
+
+    inline std::string_view sourceName() const { return {strings + header->name, header->nameLength}; }
+    // what AST::lexeme gives for the node: the source name for the root, the
+    // token text for a terminal, empty otherwise
+    inline std::string_view lexeme(uint32_t i) const
+    {
+        if (kind(i) == TokenType::TRANSLATION_UNIT)
+            return sourceName();
+        if (tokens[i] == Node::NO_TOKEN || isNonterminal(kind(i)))
+            return {};
+        return tokenLexeme(tokens[i]);
+    }
+    // the tree as AST::printAST prints it
+    void print(DumpWriter &out) const;
+};
+#endif
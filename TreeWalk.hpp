@@ -0,0 +1,77 @@
+#ifndef TREE_WALK_HPP
+#define TREE_WALK_HPP
+#include "AST.hpp"
+
+// Depth-first walk of a Node tree on an explicit stack, so that the depth of
+// the tree never costs call stack. enter(node, depth, last) is called in
+// preorder, with last telling whether the node is the last child of its
+// parent; when it returns false the children of the node are skipped. Every
+// entered node is then passed to leave(node) in postorder. NodeT is Node, or
+// const Node for a walk that only reads.
+template <typename NodeT, typename Enter, typename Leave>
+void walkTree(NodeT &root, Enter &&enter, Leave &&leave)
+{
+    struct Frame
+    {
+        NodeT *node;
+        std::size_t next; // the child to enter next
+    };
+    std::vector<Frame> stack;
+    if (!enter(root, std::size_t(0), true))
+    {
+        leave(root);
+        return;
+    }
+    stack.push_back({&root, 0});
+    while (!stack.empty())
+    {
+        Frame &top = stack.back();
+        if (top.next == top.node->children.size())
+        {
+            NodeT *done = top.node;
+            stack.pop_back();
+            leave(*done);
+            continue;
+        }
+        NodeT &child = *top.node->children[top.next++];
+        bool last = top.next == top.node->children.size();
+        if (enter(child, stack.size(), last))
+            stack.push_back({&child, 0});
+        else
+            leave(child);
+    }
+}
+
+// preorder only
+template <typename NodeT, typename Enter>
+void walkTree(NodeT &root, Enter &&enter)
+{
+    walkTree(root, std::forward<Enter>(enter), [](NodeT &) {});
+}
+
+// Lets go of a dying node's children, a list of shared_ptr<NodeT>, without
+// recursing, for the destructor of NodeT: freeing them through their
+// shared_ptrs would take a stack frame per level of the tree. The outermost
+// node to die on a thread releases the others one at a time, and each of
+// them only hands its children over to it.
+template <typename NodeT, typename List>
+void releaseChildren(List &children)
+{
+    if (children.empty())
+        return;
+    thread_local std::vector<std::shared_ptr<NodeT>> pending;
+    thread_local bool draining = false;
+    for (auto &child : children)
+        pending.push_back(std::move(child));
+    children.clear();
+    if (draining)
+        return;
+    draining = true;
+    while (!pending.empty())
+    {
+        std::shared_ptr<NodeT> node = std::move(pending.back());
+        pending.pop_back();
+    }
+    draining = false;
+}
+#endif
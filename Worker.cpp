@@ -0,0 +1,265 @@
+#include "Worker.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// The requests of one stream, read in large blocks however they arrive
+class RequestReader
+{
+private:
+    int fd;
+    std::string buffer;
+    std::size_t start = 0; // the first byte not handed out yet
+
+    // appends what the next read(2) gives; false at the end of the input
+    bool fill()
+    {
+        // drop what has been handed out, keeping the capacity
+        buffer.erase(0, start);
+        start = 0;
+        constexpr std::size_t BLOCK = 1 << 16;
+        std::size_t used = buffer.size();
+        buffer.resize(used + BLOCK);
+        ssize_t got;
+        do
+            got = read(fd, buffer.data() + used, BLOCK);
+        while (got < 0 && errno == EINTR);
+        buffer.resize(used + (got > 0 ? got : 0));
+        return got > 0;
+    }
+
+public:
+    explicit RequestReader(int fd) : fd(fd) {}
+
+    // the next line without its line break; false at the end of the input
+    bool line(std::string &out)
+    {
+        // the bytes after start already searched; fill() moves start
+        std::size_t searched = 0;
+        std::size_t end;
+        while ((end = buffer.find('\n', start + searched)) == std::string::npos)
+        {
+            searched = buffer.size() - start;
+            if (!fill())
+            {
+                // a last line with no line break
+                if (start == buffer.size())
+                    return false;
+                end = buffer.size();
+                break;
+            }
+        }
+        out.assign(buffer, start, end - start);
+        if (!out.empty() && out.back() == '\r')
+            out.pop_back();
+        start = std::min(end + 1, buffer.size());
+        return true;
+    }
+
+    // the next n bytes; false when the input ends first
+    bool bytes(std::size_t n, std::string &out)
+    {
+        while (buffer.size() - start < n)
+            if (!fill())
+                return false;
+        out.assign(buffer, start, n);
+        start += n;
+        return true;
+    }
+};
+
+// text as a number; false when it is not one
+static bool readNumber(std::string_view text, std::size_t &value)
+{
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// the words of line, each a view into it
+static std::vector<std::string_view> splitWords(std::string_view line)
+{
+    std::vector<std::string_view> words;
+    for (std::size_t at = 0; at < line.size();)
+    {
+        if (line[at] == ' ' || line[at] == '\t')
+        {
+            at++;
+            continue;
+        }
+        std::size_t end = line.find_first_of(" \t", at);
+        if (end == std::string_view::npos)
+            end = line.size();
+        words.push_back(line.substr(at, end - at));
+        at = end;
+    }
+    return words;
+}
+
+// answers the request in line to out, reading its text from reader when it
+// has any; false, with why in out, when it is refused
+static bool answer(RequestReader &reader, std::string_view line, std::string &text, ParserContext &context,
+                   const WorkerOptions &options, DumpWriter &out)
+{
+    ParseOptions parse = options.parse;
+    DumpFormat format = options.format;
+    std::vector<std::string_view> words = splitWords(line);
+    bool fromText = false;
+    std::size_t i = 0;
+    for (; i < words.size(); i++)
+    {
+        if (readDumpOption(words, i, parse, format))
+            continue;
+        std::size_t value;
+        bool valued = i + 1 < words.size() && readNumber(words[i + 1], value);
+        if (words[i] == "-j" && valued)
+        {
+            parse.threads = value == 0 ? std::max(1u, std::thread::hardware_concurrency()) : static_cast<unsigned>(value);
+            i++;
+        }
+        else if (words[i] == "--text" && valued)
+        {
+            if (!reader.bytes(value, text))
+            {
+                out << "the input ends inside the text\n";
+                return false;
+            }
+            fromText = true;
+            i += 2;
+            break;
+        }
+        else if (words[i].starts_with('-'))
+        {
+            out << "unknown option " << words[i] << '\n';
+            // the text of a refused request is read all the same, or the
+            // next request would be looked for inside it
+            for (std::size_t j = i + 1; j + 1 < words.size(); j++)
+                if (words[j] == "--text" && readNumber(words[j + 1], value))
+                {
+                    reader.bytes(value, text);
+                    break;
+                }
+            return false;
+        }
+        else
+            break;
+    }
+    // the rest of the line, from the first word that is not an option
+    std::string name = i < words.size() ? std::string(line.substr(words[i].data() - line.data())) : std::string();
+    context.reset();
+    if (fromText)
+    {
+        if (name.empty())
+            name = "<text>";
+        dumpText(context, text, name, parse, format, out, options.cache);
+        return true;
+    }
+    if (name.empty())
+    {
+        out << "no path to parse\n";
+        return false;
+    }
+    dumpFile(context, name, parse, format, out, options.cache, options.tokens);
+    return true;
+}
+
+void serveRequests(int in, int out, ParserContext &context, const WorkerOptions &options)
+{
+    RequestReader reader(in);
+    DumpWriter answers(out);
+    // the answer is gathered first, for its length; the buffers keep their
+    // capacity from request to request
+    std::string line, text, body;
+    DumpWriter writer(body, 1 << 16);
+    while (reader.line(line))
+    {
+        if (line.empty())
+            continue;
+        bool ok = answer(reader, line, text, context, options, writer);
+        writer.flush();
+        answers << (ok ? "ok " : "error ") << body.size() << '\n'
+                << body;
+        answers.flush();
+        body.clear();
+        if (!answers.good())
+            return;
+    }
+}
+
+// contexts not serving a connection, warm from the ones they served
+struct ContextPool
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<ParserContext>> idle;
+
+    std::unique_ptr<ParserContext> take()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (idle.empty())
+            return std::make_unique<ParserContext>();
+        std::unique_ptr<ParserContext> context = std::move(idle.back());
+        idle.pop_back();
+        return context;
+    }
+    void give(std::unique_ptr<ParserContext> context)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(std::move(context));
+    }
+};
+
+bool serveSocket(const std::string &path, const WorkerOptions &options, std::string &why)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        why = "The socket path is too long: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+    {
+        why = std::string("Cannot create a socket: ") + std::strerror(errno);
+        return false;
+    }
+    // one an earlier worker left behind; anything else is not ours to remove
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+        unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        why = "Cannot listen on " + path + ": " + std::strerror(errno);
+        close(listener);
+        return false;
+    }
+    // a client that goes away before its answer must not end the worker
+    std::signal(SIGPIPE, SIG_IGN);
+    auto contexts = std::make_shared<ContextPool>();
+    for (;;)
+    {
+        int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            why = "Cannot accept on " + path + ": " + std::strerror(errno);
+            close(listener);
+            return false;
+        }
+        std::thread([contexts, connection, options]()
+                    {
+            std::unique_ptr<ParserContext> context = contexts->take();
+            serveRequests(connection, connection, *context, options);
+            close(connection);
+            contexts->give(std::move(context)); })
+            .detach();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef WORKER_HPP
+#define WORKER_HPP
+#include "Batch.hpp"
+
+// A long-running process that answers one parse request after another, so a
+// file costs only its parse: the keyword and operator tables are built once,
+// and the ParserContext that serves a stream of requests keeps its arena,
+// token stores and source buffer warm from request to request. A request is
+// one line,
+//
+//   [options] path                parses the file at path
+//   [options] --text N [name]     parses the N bytes that follow the line,
+//                                 named name (default: <text>)
+//
+// where the options are those of the command line that set how a file is
+// parsed or what is printed for it (--lalr, --lazy, --syntax, --json, the
+// budgets, ...), plus -j N for the threads of the one parse, on top of those
+// the worker was started with. The path or name is the rest of the line,
+// spaces and all. Each request is answered with a line "ok N" followed by N
+// bytes, the dump the command line would print, or "error N" followed by why
+// the request was refused.
+struct WorkerOptions
+{
+    // what every request starts from
+    ParseOptions parse;
+    DumpFormat format = DumpFormat::Tree;
+    // shared by every stream when set
+    ParseCache *cache = nullptr;
+    TokenCache *tokens = nullptr;
+};
+
+// answers the requests read from the file descriptor in on out until in ends
+// or out is closed, parsing in context
+void serveRequests(int in, int out, ParserContext &context, const WorkerOptions &options);
+
+// listens on a Unix domain socket at path, replacing any socket there, and
+// answers the requests of each connection on a thread of its own; a context
+// goes back to a pool when its connection ends, for the next one. Returns
+// only when the socket cannot be set up or accept fails, with the reason in
+// why.
+bool serveSocket(const std::string &path, const WorkerOptions &options, std::string &why);
+#endif
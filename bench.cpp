@@ -0,0 +1,342 @@
+// Times the recursive-descent and table-driven LALR engines, and the
+// recursive-descent engine on a thread pool, on the same files. Every column
+// includes lexing, so the lexer alone is timed as well. The last two columns
+// time a walk over every node of the recursive-descent tree, through the
+// shared_ptr children and as a scan of its FlatTree, and the last the same
+// query, the jump statements in each function definition, answered from the
+// FlatTree's kind index.
+// With -p it instead parses generated malformed inputs of doubling size and
+// prints how the time grows; error recovery should keep every ratio near 2.
+// With -e it instead times edits to each file through an IncrementalParser
+// against a parse of the whole file, and checks that the tree and errors after
+// an edit are those of a parse of the edited text. With -l it times a lazy
+// parse and the expansion of every body, with each engine, and checks that
+// the expanded tree and errors are those of an eager parse.
+// usage: bench [-n rounds] [-j threads] file.c ...
+//        bench -p [-n rounds]
+//        bench -e [-n rounds] file.c ...
+//        bench -l [-n rounds] file.c ...
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <thread>
+#include "AST.hpp"
+#include "FlatTree.hpp"
+#include "Incremental.hpp"
+#include "JsonWriter.hpp"
+
+static double timeRounds(int rounds, const std::function<void()> &run)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+        run();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / rounds;
+}
+
+// malformed inputs: prefix, then fragment repeated, then suffix
+struct Pathological
+{
+    const char *name;
+    const char *prefix;
+    const char *fragment;
+    const char *suffix;
+};
+static const Pathological PATHOLOGICAL[] = {
+    {"missing ';'", "", "int a ", ""},
+    {"unclosed '('", "", "int f(int a; ", ""},
+    {"stray ')'", "", "int a) ", ""},
+    {"stray '}'", "", "} ", ""},
+    {"bad struct members", "", "struct S { int a int ( } ", ""},
+    {"typedef names", "typedef int T;\n", "T T T ", ""},
+    {"bad statements", "void f(void)\n{\n", "x = = ; if ( ; ", "}\n"},
+    {"missing ';' in body", "void f(void)\n{\n", "x = 1 ", "}\n"},
+    {"else without if", "void f(void)\n{\n", "else ", "}\n"},
+    {"bad declarations", "void f(void)\n{\n", "int 5 = ; ", "}\n"},
+};
+
+static int pathological(int rounds)
+{
+    const int sizes[] = {1000, 2000, 4000, 8000};
+    std::string file = (std::filesystem::temp_directory_path() / "bench_pathological.c").string();
+    std::cout << std::left << std::setw(24) << "input" << std::right;
+    for (int size : sizes)
+        std::cout << std::setw(10) << (std::to_string(size) + "x");
+    std::cout << std::setw(10) << "growth" << std::endl;
+    for (const auto &input : PATHOLOGICAL)
+    {
+        std::cout << std::left << std::setw(24) << input.name << std::right << std::fixed << std::setprecision(2);
+        double first = 0, last = 0;
+        for (int size : sizes)
+        {
+            {
+                std::ofstream out(file);
+                out << input.prefix;
+                for (int i = 0; i < size; i++)
+                    out << input.fragment << (i % 16 == 15 ? "\n" : "");
+                out << input.suffix;
+            }
+            last = timeRounds(rounds, [&]()
+                              {
+                Error e;
+                AST tree(file, e); });
+            if (first == 0)
+                first = last;
+            std::cout << std::setw(10) << last;
+        }
+        // time per doubling of the input; 2 is linear
+        std::cout << std::setw(10) << std::pow(last / first, 1.0 / 3) << std::endl;
+    }
+    std::filesystem::remove(file);
+    return 0;
+}
+
+// the tree and errors as text, to compare two parses
+static std::string dump(const Node &root, const TokenStore &tokens, Error errors)
+{
+    std::string text;
+    {
+        DumpWriter out(text);
+        writeJsonTree(root, tokens, "", JsonOptions(), out);
+        out << '\n';
+        errors.printError(out);
+    }
+    return text;
+}
+
+static int incremental(int rounds, const std::vector<std::string> &files)
+{
+    const std::string inserted = "int bench_edit;\n";
+    std::cout << std::left << std::setw(32) << "file" << std::right << std::setw(12) << "parse ms"
+              << std::setw(12) << "edit ms" << std::setw(12) << "units" << std::setw(12) << "reparsed" << std::endl;
+    for (const auto &file : files)
+    {
+        std::ifstream in(file, std::ifstream::binary);
+        if (!in)
+        {
+            std::cerr << file << ": " << OPEN_ERROR << std::endl;
+            continue;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        // the edits go at the start of lines spread over the file
+        std::vector<std::size_t> lines{0};
+        for (std::size_t i = text.find('\n'); i != std::string::npos && i + 1 < text.size(); i = text.find('\n', i + 1))
+            lines.push_back(i + 1);
+        IncrementalParser parser(file, text);
+        double parse = timeRounds(rounds, [&]()
+                                  {
+            Error e;
+            AST tree(std::string_view(parser.getText()), file, e); });
+        std::size_t reparsed = 0;
+        int round = 0;
+        // an edit and the edit that takes it back, so the file stays the same
+        double edit = timeRounds(rounds, [&]()
+                                 {
+            std::size_t at = lines[round++ * lines.size() / rounds];
+            parser.edit(at, 0, inserted);
+            reparsed += parser.reparsedUnits();
+            parser.edit(at, inserted.size(), "");
+            reparsed += parser.reparsedUnits(); }) / 2;
+
+        for (std::size_t at : {lines[0], lines[lines.size() / 3], lines[lines.size() / 2], lines.back()})
+        {
+            parser.edit(at, 0, inserted);
+            IncrementalParser::Snapshot edited = parser.snapshot();
+            Error e;
+            AST tree(std::string_view(parser.getText()), file, e);
+            if (dump(*edited.root, *edited.tokens, parser.errors()) != dump(*tree.getRoot(), *tree.getTokens(), e))
+                std::cerr << file << ": after an edit at byte " << at << " the tree differs from a parse of the text" << std::endl;
+            parser.edit(at, inserted.size(), "");
+        }
+        std::cout << std::left << std::setw(32) << file << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << parse << std::setw(12) << edit << std::setw(12) << parser.unitCount()
+                  << std::setw(12) << std::setprecision(1) << double(reparsed) / (2 * rounds) << std::endl;
+    }
+    return 0;
+}
+
+// the function definitions of tree, whose bodies a lazy parse skipped
+static std::vector<std::shared_ptr<Node>> functions(const AST &tree)
+{
+    std::vector<std::shared_ptr<Node>> found;
+    std::vector<std::shared_ptr<Node>> pending{tree.getRoot()};
+    while (!pending.empty())
+    {
+        std::shared_ptr<Node> node = std::move(pending.back());
+        pending.pop_back();
+        if (node->type == TokenType::FUNCTION_DEFINITION)
+            found.push_back(node);
+        else
+            pending.insert(pending.end(), node->children.rbegin(), node->children.rend());
+    }
+    return found;
+}
+
+static int lazy(int rounds, const std::vector<std::string> &files)
+{
+    std::cout << std::left << std::setw(32) << "file" << std::right << std::setw(8) << "engine" << std::setw(12) << "eager ms"
+              << std::setw(12) << "lazy ms" << std::setw(12) << "expand ms" << std::setw(10) << "bodies" << std::endl;
+    for (const auto &file : files)
+        for (ParserEngine engine : {ParserEngine::RecursiveDescent, ParserEngine::LALR})
+        {
+            ParseOptions eager;
+            eager.engine = engine;
+            ParseOptions skipping = eager;
+            skipping.lazyBodies = true;
+            double parse = timeRounds(rounds, [&]()
+                                      {
+                Error e;
+                AST tree(file, e, eager); });
+            double skip = timeRounds(rounds, [&]()
+                                     {
+                Error e;
+                AST tree(file, e, skipping); });
+            std::size_t bodies = 0;
+            double expand = std::max(0.0, timeRounds(rounds, [&]()
+                                       {
+                Error e;
+                AST tree(file, e, skipping);
+                std::vector<std::shared_ptr<Node>> found = functions(tree);
+                bodies = found.size();
+                for (const auto &function : found)
+                    tree.expandBody(function); }) - skip);
+
+            // the errors of the bodies come last from a lazy parse, so they
+            // are compared in order of line
+            auto errorLines = [](const Error &e)
+            {
+                std::vector<std::pair<int, std::string>> lines(e.errors.begin(), e.errors.end());
+                lines.insert(lines.end(), e.grammarErrors.begin(), e.grammarErrors.end());
+                std::stable_sort(lines.begin(), lines.end(), [](const auto &a, const auto &b)
+                                 { return a.first < b.first; });
+                return lines;
+            };
+            Error eagerErrors, lazyErrors;
+            AST full(file, eagerErrors, eager);
+            AST expanded(file, lazyErrors, skipping);
+            for (const auto &function : functions(expanded))
+                expanded.expandBody(function);
+            if (dump(*expanded.getRoot(), *expanded.getTokens(), Error()) != dump(*full.getRoot(), *full.getTokens(), Error()) ||
+                errorLines(lazyErrors) != errorLines(eagerErrors))
+                std::cerr << file << ": the expanded lazy tree differs from the eager one" << std::endl;
+            std::cout << std::left << std::setw(32) << file << std::right << std::setw(8)
+                      << (engine == ParserEngine::LALR ? "lalr" : "rd") << std::fixed << std::setprecision(3)
+                      << std::setw(12) << parse << std::setw(12) << skip << std::setw(12) << expand << std::setw(10) << bodies << std::endl;
+        }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = 20;
+    unsigned threads = 0;
+    bool stress = false;
+    bool edits = false;
+    bool expand = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc)
+            rounds = std::max(1, atoi(argv[++i]));
+        else if (arg == "-j" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (arg == "-p")
+            stress = true;
+        else if (arg == "-e")
+            edits = true;
+        else if (arg == "-l")
+            expand = true;
+        else
+            files.push_back(arg);
+    }
+    if (stress)
+        return pathological(rounds);
+    if (files.empty())
+    {
+        std::cerr << "usage: bench [-n rounds] [-j threads] file.c ...\n"
+                  << "       bench -p [-n rounds]\n"
+                  << "       bench -e [-n rounds] file.c ...\n"
+                  << "       bench -l [-n rounds] file.c ..." << std::endl;
+        return 1;
+    }
+    if (edits)
+        return incremental(rounds, files);
+    if (expand)
+        return lazy(rounds, files);
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    ParseOptions recursiveDescent;
+    ParseOptions lalr;
+    lalr.engine = ParserEngine::LALR;
+    ParseOptions parallel;
+    parallel.threads = threads;
+
+    std::cout << std::left << std::setw(32) << "file" << std::right << std::setw(12) << "lex ms"
+              << std::setw(12) << "rd ms" << std::setw(12) << "lalr ms" << std::setw(12) << ("rd -j" + std::to_string(threads))
+              << std::setw(8) << "errors" << std::setw(12) << "walk ms" << std::setw(12) << "flat ms" << std::setw(12) << "index ms" << std::endl;
+    for (const auto &file : files)
+    {
+        std::size_t errors[3] = {};
+        auto parse = [&](const ParseOptions &options, std::size_t &errorCount)
+        {
+            return timeRounds(rounds, [&]()
+                              {
+                Error e;
+                AST tree(file, e, options);
+                errorCount = e.grammarErrors.size(); });
+        };
+        double lex = timeRounds(rounds, [&]()
+                                {
+            Error e;
+            Scanner scanner(file, e);
+            while (scanner.getNextToken()->type != TokenType::END)
+                ; });
+        double rd = parse(recursiveDescent, errors[0]);
+        double table = parse(lalr, errors[1]);
+        double split = parse(parallel, errors[2]);
+
+        Error e;
+        AST tree(file, e);
+        FlatTree flat(*tree.getRoot(), tree.getTokens());
+        std::size_t leaves[2] = {};
+        double walk = timeRounds(rounds, [&]()
+                                 {
+            leaves[0] = 0;
+            std::vector<const Node *> pending{tree.getRoot().get()};
+            while (!pending.empty())
+            {
+                const Node *node = pending.back();
+                pending.pop_back();
+                leaves[0] += node->children.empty();
+                for (const auto &child : node->children)
+                    pending.push_back(child.get());
+            } });
+        double scan = timeRounds(rounds, [&]()
+                                 {
+            leaves[1] = 0;
+            for (uint32_t i = 0; i < flat.nodeCount(); i++)
+                leaves[1] += flat.isLeaf(i); });
+        if (leaves[0] != leaves[1])
+            std::cerr << file << ": the flat tree has " << leaves[1] << " leaves, the tree " << leaves[0] << std::endl;
+        std::size_t jumps[2] = {};
+        for (uint32_t i = 0; i < flat.nodeCount(); i++)
+            jumps[0] += flat.kind(i) == TokenType::JUMP_STATEMENT && flat.enclosing(i, TokenType::FUNCTION_DEFINITION) != FlatTree::NO_PARENT;
+        double query = timeRounds(rounds, [&]()
+                                  {
+            jumps[1] = 0;
+            for (uint32_t function : flat.ofKind(TokenType::FUNCTION_DEFINITION))
+                jumps[1] += flat.ofKind(TokenType::JUMP_STATEMENT, function).size(); });
+        if (jumps[0] != jumps[1])
+            std::cerr << file << ": the kind index finds " << jumps[1] << " jump statements, a scan " << jumps[0] << std::endl;
+        std::cout << std::left << std::setw(32) << file << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << lex << std::setw(12) << rd << std::setw(12) << table << std::setw(12) << split
+                  << std::setw(8) << (std::to_string(errors[0]) + "/" + std::to_string(errors[1]) + "/" + std::to_string(errors[2]))
+                  << std::setw(12) << walk << std::setw(12) << scan << std::setw(12) << query << std::endl;
+    }
+    return 0;
+}
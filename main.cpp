@@ -2,36 +2,218 @@
 #include "Token.hpp"
 #include "Error.hpp"
 #include "AST.hpp"
+#include "Batch.hpp"
+#include "TreeFile.hpp"
+#include "SymbolIndex.hpp"
+#include "Worker.hpp"
+#include <thread>
+#include <unistd.h>
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    // --lalr parses with the table-driven engine instead of recursive descent,
+    // -j N parses the top-level declarations on N threads (0: one per core),
+    // --lazy leaves function bodies unparsed, --syntax prints the lowered
+    // abstract syntax tree instead of the parse tree, --json prints a line of
+    // JSON with the errors and the parse tree instead of the dump,
+    // --json-compact the same without punctuation and wrapper nodes, and
+    // --count the number of nodes of each kind from a parse that builds no
+    // tree (see ParseEvents.hpp), and --declarations every name the file
+    // declares (see DeclarationIndex.hpp). More than one path, or @list
+    // naming a file of paths, dumps them all in batch mode, where -j N is the
+    // number of files parsed at once (default: one per core).
+    // --max-tokens, --max-depth, --max-nodes, --max-macro-tokens N and
+    // --time-limit MS set the budgets of every parse (see ParseBudget).
+    // --save-tree OUT writes the parse tree of the one file to OUT as a tree
+    // file instead of dumping it, printing only the errors; --load-tree FILE
+    // prints the errors and the tree in a tree file without parsing anything.
+    // --index DIR brings the symbol index in DIR up to date with the paths
+    // given, parsing only the files that changed (see SymbolIndex.hpp), and
+    // with --symbol NAME and no paths prints where NAME is declared, defined
+    // and used instead.
+    // --cache DIR keeps the parse results of --json, --json-compact and
+    // --count in DIR and reads them back for files parsed before (see
+    // ParseCache.hpp); --cache-size MB caps it (default: 1024).
+    // --token-cache MB keeps the tokens of up to MB megabytes of files lexed
+    // in this process, for --json, --json-compact and --declarations to parse
+    // a file seen before without lexing it again (see TokenCache.hpp).
+    // --worker answers parse requests read from stdin, one per line, until it
+    // ends, and --worker-socket PATH those of every client of a Unix domain
+    // socket at PATH, each parsed with the options given here plus its own
+    // (see Worker.hpp).
+    ParseOptions options;
+    std::string saveTree, loadTree, indexDirectory, symbol, cacheDirectory, workerSocket;
+    uint64_t cacheSize = ParseCache::DEFAULT_CAPACITY, tokenCacheSize = 0;
+    DumpFormat format = DumpFormat::Tree;
+    std::vector<std::string> paths;
+    bool batch = false, worker = false;
+    int jobs = -1;
+    // views of argv, so each data() is a C string
+    std::vector<std::string_view> args(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < args.size(); i++)
     {
-        std::cerr << "Requires exact 1 arguemnt: path to file" << std::endl;
+        std::string arg(args[i]);
+        bool valued = i + 1 < args.size();
+        if (readDumpOption(args, i, options, format))
+            continue;
+        if (arg == "-j" && valued)
+            jobs = atoi(args[++i].data());
+        else if (arg == "--save-tree" && valued)
+            saveTree = args[++i];
+        else if (arg == "--load-tree" && valued)
+            loadTree = args[++i];
+        else if (arg == "--index" && valued)
+            indexDirectory = args[++i];
+        else if (arg == "--symbol" && valued)
+            symbol = args[++i];
+        else if (arg == "--cache" && valued)
+            cacheDirectory = args[++i];
+        else if (arg == "--cache-size" && valued)
+            cacheSize = uint64_t(std::max(0, atoi(args[++i].data()))) << 20;
+        else if (arg == "--token-cache" && valued)
+            tokenCacheSize = uint64_t(std::max(0, atoi(args[++i].data()))) << 20;
+        else if (arg == "--worker")
+            worker = true;
+        else if (arg == "--worker-socket" && valued)
+            workerSocket = args[++i];
+        else if (arg.size() > 1 && arg[0] == '@')
+        {
+            batch = true;
+            if (!readResponseFile(arg.substr(1), paths))
+            {
+                std::cerr << "Cannot read the list of files " << arg.substr(1) << std::endl;
+                return 1;
+            }
+        }
+        else
+            paths.push_back(arg);
+    }
+    batch = batch || paths.size() > 1;
+    if (!loadTree.empty())
+    {
+        TreeFile tree;
+        std::string why;
+        if (!tree.open(loadTree, why))
+        {
+            std::cerr << why << std::endl;
+            return 1;
+        }
+        DumpWriter out(STDOUT_FILENO);
+        Error errors;
+        tree.loadErrors(errors);
+        errors.printError(out);
+        tree.print(out);
         return 0;
     }
-    Error error;
-    Scanner scanner(std::string(argv[1]), error);
-    int i = 0;
-    TokenToString t;
-    auto itr = scanner.getNextToken();
-    std::cout << t(itr->type) << std::endl;
-    int thisline = scanner.getlineNo();
-
-    for (auto itr = scanner.getNextToken(); itr->type != TokenType::END; itr = scanner.getNextToken())
+    if (!indexDirectory.empty() && paths.empty())
+    {
+        SymbolIndex index;
+        std::string why;
+        if (!index.open(indexDirectory, why))
+        {
+            std::cerr << why << std::endl;
+            return 1;
+        }
+        DumpWriter out(STDOUT_FILENO);
+        for (const auto &found : index.find(symbol))
+        {
+            const SymbolOccurrence &occurrence = found.occurrence;
+            out << *found.path << ':' << occurrence.line << ": ";
+            if (occurrence.kind == SymbolOccurrence::REFERENCE)
+                out << "reference\n";
+            else
+                out << declarationKindName(static_cast<DeclarationKind>(occurrence.kind)) << (occurrence.definition ? " definition\n" : " declaration\n");
+        }
+        return 0;
+    }
+    if (!indexDirectory.empty())
+    {
+        IndexUpdate update;
+        std::string why;
+        if (!updateSymbolIndex(indexDirectory, paths, options, jobs < 0 ? 0 : jobs, update, why))
+        {
+            std::cerr << why << std::endl;
+            return 1;
+        }
+        for (const auto &path : update.failed)
+            std::cerr << "Cannot read " << path << std::endl;
+        std::cout << update.parsed << " parsed, " << update.unchanged << " unchanged, " << update.removed << " removed" << std::endl;
+        return update.failed.empty() ? 0 : 1;
+    }
+    ParseCache cache;
+    if (!cacheDirectory.empty())
     {
-        if (thisline != scanner.getlineNo())
+        std::string why;
+        if (!cache.open(cacheDirectory, cacheSize, why))
         {
-            if (thisline != 1)
-                std::cout << "line NO: " << thisline << std::endl;
-            thisline = scanner.getlineNo();
+            std::cerr << why << std::endl;
+            return 1;
         }
-        std::cout << "Type: " << t(itr->type) << " Lexeme: " << itr->lexeme << std::endl;
     }
-    AST tree(argv[1], error);
-    error.printError(std::cout);
-    scanner.printMacro(std::cout);
-    tree.printAST(std::cout);
+    ParseCache *useCache = cacheDirectory.empty() ? nullptr : &cache;
+    TokenCache tokenCache(tokenCacheSize);
+    TokenCache *useTokens = tokenCacheSize ? &tokenCache : nullptr;
+    if (worker || !workerSocket.empty())
+    {
+        WorkerOptions workerOptions;
+        workerOptions.parse = options;
+        if (jobs >= 0)
+            workerOptions.parse.threads = jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : jobs;
+        workerOptions.format = format;
+        workerOptions.cache = useCache;
+        workerOptions.tokens = useTokens;
+        if (workerSocket.empty())
+        {
+            ParserContext context;
+            serveRequests(STDIN_FILENO, STDOUT_FILENO, context, workerOptions);
+            return 0;
+        }
+        std::string why;
+        serveSocket(workerSocket, workerOptions, why);
+        std::cerr << why << std::endl;
+        return 1;
+    }
+    if (paths.empty())
+    {
+        std::cerr << "Requires paths to files, or @list naming a file of paths (options: --lalr, --lazy, --syntax, --json, --json-compact, --count, --declarations, -j N, --save-tree OUT, --load-tree FILE, --index DIR, --symbol NAME, --cache DIR, --cache-size MB, --token-cache MB, --worker, --worker-socket PATH, --max-tokens N, --max-depth N, --max-nodes N, --max-macro-tokens N, --time-limit MS)" << std::endl;
+        return 0;
+    }
+    if (!batch && !hasSourceExtension(paths.front()))
+    {
+        std::cerr << "The extension of file should be " << EXTENSION << std::endl;
+        return 1;
+    }
+    // everything goes out through one buffer, in large writes
+    DumpWriter out(STDOUT_FILENO);
+    if (batch)
+    {
+        BatchOptions batchOptions;
+        batchOptions.parse = options;
+        batchOptions.format = format;
+        batchOptions.threads = jobs < 0 ? 0 : jobs;
+        batchOptions.cache = useCache;
+        batchOptions.tokens = useTokens;
+        runBatch(paths, batchOptions, out);
+        return 0;
+    }
+    if (jobs >= 0)
+        options.threads = jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : jobs;
+    ParserContext context;
+    if (!saveTree.empty())
+    {
+        std::string_view text = context.load(paths.front());
+        AST tree(context, text, paths.front(), options);
+        context.error().printError(out);
+        FlatTree flat(*tree.getRoot(), tree.getTokens());
+        if (!saveTreeFile(flat, paths.front(), &context.error(), saveTree))
+        {
+            out.flush();
+            std::cerr << "Cannot write " << saveTree << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    dumpFile(context, paths.front(), options, format, out, useCache);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,679 @@
+// Build-time generator for the parser tables. Reads grammar.y and writes
+//   GrammarRules.inc - the productions as rule(...) entries, included by Grammar.hpp
+//   ParseTable.inc   - the LALR(1) ACTION/GOTO tables, included by LALR.cpp
+// usage: table grammar.y GrammarRules.inc ParseTable.inc
+//
+// Symbols are written with TokenType names so that the generated files are
+// checked by the compiler against Token.hpp.
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// grammar.y terminals whose TokenType has a different name
+const std::map<std::string, std::string> terminalNames = {
+    {"IDENTIFIER", "ID"},
+    {"I_CONSTANT", "CONSTANT"},
+    {"F_CONSTANT", "CONSTANT"},
+    {"ENUMERATION_CONSTANT", "ID"}, // the Scanner does not tell enumeration constants from identifiers
+    {"PTR_OP", "ARRORW"},
+    {"INC_OP", "INC"},
+    {"DEC_OP", "DEC"},
+    {"LEFT_OP", "LEF_SHIFT"},
+    {"RIGHT_OP", "RIGHT_SHIFT"},
+    {"LE_OP", "LTE"},
+    {"GE_OP", "GTE"},
+    {"EQ_OP", "EQ"},
+    {"NE_OP", "UNEQUAL"},
+    {"AND_OP", "AND"},
+    {"OR_OP", "OR"},
+    {"BOOL", "BOOL_TYPE"},
+    {"CHAR", "CHAR_TYPE"},
+    {"SHORT", "SHORT_TYPE"},
+    {"INT", "INT_TYPE"},
+    {"LONG", "LONG_TYPE"},
+    {"UNSIGNED", "UNSINGED"},
+    {"FLOAT", "FLOAT_TYPE"},
+    {"DOUBLE", "DOULBLE_TYPE"},
+    {"CONTINUE", "CONT"},
+    {"BREAK", "BRK"}};
+
+const std::map<char, std::string> literalNames = {
+    {'(', "L_BR"},
+    {')', "R_BR"},
+    {'[', "L_SQR"},
+    {']', "R_SQR"},
+    {'{', "L_CUR"},
+    {'}', "R_CUR"},
+    {'.', "DOT"},
+    {'&', "REFERENCE"},
+    {'*', "MUL"},
+    {'+', "PLUS"},
+    {'-', "MINUS"},
+    {'~', "TILDE"},
+    {'!', "NOT"},
+    {'/', "DIV"},
+    {'%', "MOD"},
+    {'<', "LT"},
+    {'>', "GT"},
+    {'^', "CARET"},
+    {'|', "PIPE"},
+    {'?', "QUESTION"},
+    {':', "COLON"},
+    {'=', "ASSIGN"},
+    {',', "COMMA"},
+    {';', "SEMI_COLON"}};
+
+// grammar.y non-terminals whose TokenType has a different name
+const std::map<std::string, std::string> nonterminalNames = {
+    {"struct_or_union_specifier", "STRUCT_UNION_SPECIFIER"}};
+
+// non-terminals that only rename a single token; the Scanner already produces
+// one token for each, so their uses are expanded in place
+const std::set<std::string> foldedNonterminals = {"constant", "string", "enumeration_constant"};
+
+struct Rule
+{
+    int lhs;
+    std::vector<int> rhs;
+};
+
+class Grammar
+{
+public:
+    std::vector<std::string> names; // symbol index -> TokenType name
+    std::vector<bool> terminal;
+    std::vector<Rule> rules; // rules[0] is the augmented start rule
+    int start = -1;
+    int end = -1;
+
+    int symbol(const std::string &name, bool isTerminal)
+    {
+        auto itr = index.find(name);
+        if (itr != index.end())
+            return itr->second;
+        names.push_back(name);
+        terminal.push_back(isTerminal);
+        index[name] = names.size() - 1;
+        return names.size() - 1;
+    }
+
+    bool read(const std::string &path);
+
+private:
+    std::map<std::string, int> index;
+};
+
+static std::string stripComments(const std::string &text)
+{
+    std::string ret;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text.compare(i, 2, "/*") == 0)
+        {
+            size_t close = text.find("*/", i + 2);
+            if (close == std::string::npos)
+                break;
+            i = close + 1;
+            continue;
+        }
+        ret.push_back(text[i]);
+    }
+    return ret;
+}
+
+// splits one alternative of a rule into grammar.y symbol spellings
+static std::vector<std::string> splitAlternative(const std::string &text)
+{
+    std::vector<std::string> ret;
+    for (size_t i = 0; i < text.size();)
+    {
+        if (text[i] == '\'' && i + 2 < text.size() && text[i + 2] == '\'')
+        {
+            ret.push_back(text.substr(i, 3));
+            i += 3;
+        }
+        else if (isalpha(text[i]) || text[i] == '_')
+        {
+            size_t j = i;
+            while (j < text.size() && (isalnum(text[j]) || text[j] == '_'))
+                j++;
+            ret.push_back(text.substr(i, j - i));
+            i = j;
+        }
+        else
+            i++;
+    }
+    return ret;
+}
+
+bool Grammar::read(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    size_t first = text.find("%%");
+    if (first == std::string::npos)
+        return false;
+    size_t second = text.find("%%", first + 2);
+    text = stripComments(text.substr(first + 2, second == std::string::npos ? std::string::npos : second - first - 2));
+
+    // rule name -> alternatives, in file order
+    std::vector<std::pair<std::string, std::vector<std::vector<std::string>>>> raw;
+    std::map<std::string, size_t> rawIndex;
+    size_t pos = 0;
+    while (true)
+    {
+        size_t colon = text.find(':', pos);
+        if (colon == std::string::npos)
+            break;
+        // the rule name is the last word before ':'
+        size_t nameEnd = colon;
+        while (nameEnd > pos && isspace(text[nameEnd - 1]))
+            nameEnd--;
+        size_t nameBegin = nameEnd;
+        while (nameBegin > pos && (isalnum(text[nameBegin - 1]) || text[nameBegin - 1] == '_'))
+            nameBegin--;
+        std::string name = text.substr(nameBegin, nameEnd - nameBegin);
+
+        // the body runs to the ';' that is not a quoted literal
+        size_t i = colon + 1;
+        std::vector<std::vector<std::string>> alternatives;
+        std::string current;
+        for (; i < text.size(); i++)
+        {
+            if (text[i] == '\'' && i + 2 < text.size() && text[i + 2] == '\'')
+            {
+                current += text.substr(i, 3);
+                i += 2;
+                continue;
+            }
+            if (text[i] == '|' || text[i] == ';')
+            {
+                alternatives.push_back(splitAlternative(current));
+                current.clear();
+                if (text[i] == ';')
+                    break;
+                continue;
+            }
+            current.push_back(text[i]);
+        }
+        rawIndex[name] = raw.size();
+        raw.push_back({name, alternatives});
+        pos = i + 1;
+    }
+
+    auto mapped = [&](const std::string &s) -> std::vector<std::string>
+    {
+        if (s.size() == 3 && s[0] == '\'')
+            return {literalNames.at(s[1])};
+        if (foldedNonterminals.count(s))
+        {
+            std::vector<std::string> ret;
+            for (const auto &alt : raw[rawIndex.at(s)].second)
+            {
+                auto itr = terminalNames.find(alt.at(0));
+                ret.push_back(itr == terminalNames.end() ? alt.at(0) : itr->second);
+            }
+            return ret;
+        }
+        if (islower(s[0]))
+        {
+            auto itr = nonterminalNames.find(s);
+            if (itr != nonterminalNames.end())
+                return {itr->second};
+            std::string upper = s;
+            std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+            return {upper};
+        }
+        auto itr = terminalNames.find(s);
+        return {itr == terminalNames.end() ? s : itr->second};
+    };
+
+    // non-terminals first so that their indices do not depend on use order
+    for (const auto &r : raw)
+        if (!foldedNonterminals.count(r.first))
+            symbol(mapped(r.first)[0], false);
+    start = symbol("$accept", false);
+    end = symbol("END", true);
+    rules.push_back(Rule{start, {index.at("TRANSLATION_UNIT"), end}});
+
+    std::set<std::pair<int, std::vector<int>>> seen;
+    for (const auto &r : raw)
+    {
+        if (foldedNonterminals.count(r.first))
+            continue;
+        int lhs = index.at(mapped(r.first)[0]);
+        for (const auto &alt : r.second)
+        {
+            if (alt.empty())
+                continue;
+            // expand folded symbols into every combination of their tokens
+            std::vector<std::vector<int>> expanded(1);
+            for (const auto &s : alt)
+            {
+                std::vector<std::vector<int>> next;
+                for (const auto &name : mapped(s))
+                {
+                    bool isTerminal = !(islower(s[0]) && !foldedNonterminals.count(s));
+                    int sym = symbol(name, isTerminal);
+                    for (auto prefix : expanded)
+                    {
+                        prefix.push_back(sym);
+                        next.push_back(prefix);
+                    }
+                }
+                expanded = next;
+            }
+            for (const auto &rhs : expanded)
+                if (seen.insert({lhs, rhs}).second)
+                    rules.push_back(Rule{lhs, rhs});
+        }
+    }
+    return true;
+}
+
+using LookaheadSet = std::bitset<256>;
+
+// LALR(1) construction: the LR(0) automaton with lookaheads computed by
+// spontaneous generation and propagation (Aho, Sethi, Ullman, algorithm 4.63).
+class LalrBuilder
+{
+public:
+    explicit LalrBuilder(const Grammar &g) : g(g) {}
+
+    struct Item
+    {
+        int rule;
+        int dot;
+        bool operator<(const Item &o) const { return rule != o.rule ? rule < o.rule : dot < o.dot; }
+        bool operator==(const Item &o) const { return rule == o.rule && dot == o.dot; }
+    };
+    struct State
+    {
+        std::vector<Item> kernel;
+        std::vector<LookaheadSet> lookaheads; // parallel to kernel
+        std::map<int, int> transitions;       // symbol -> state
+    };
+    std::vector<State> states;
+
+    enum class Kind
+    {
+        Error,
+        Shift,
+        Reduce,
+        Accept
+    };
+    struct Action
+    {
+        Kind kind = Kind::Error;
+        int target = 0;
+    };
+    std::vector<std::map<int, Action>> actions; // per state, terminal -> action
+    std::vector<int> defaultReductions;         // per state, rule or -1
+    int shiftReduceConflicts = 0;
+    int reduceReduceConflicts = 0;
+
+    void build()
+    {
+        computeFirst();
+        buildLR0();
+        computeLookaheads();
+        buildActions();
+    }
+
+private:
+    const Grammar &g;
+    std::vector<LookaheadSet> first; // per non-terminal; grammar.y has no empty rules
+    std::vector<std::vector<int>> rulesOf;
+    int propagateMarker = 255; // the '#' lookahead of the algorithm
+
+    int symbolAfterDot(const Item &item) const
+    {
+        const Rule &r = g.rules[item.rule];
+        return item.dot < (int)r.rhs.size() ? r.rhs[item.dot] : -1;
+    }
+
+    void computeFirst()
+    {
+        first.assign(g.names.size(), LookaheadSet());
+        rulesOf.assign(g.names.size(), {});
+        for (size_t i = 0; i < g.rules.size(); i++)
+            rulesOf[g.rules[i].lhs].push_back(i);
+        for (size_t s = 0; s < g.names.size(); s++)
+            if (g.terminal[s])
+                first[s].set(s);
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const auto &r : g.rules)
+            {
+                LookaheadSet merged = first[r.lhs] | first[r.rhs[0]];
+                if (merged != first[r.lhs])
+                {
+                    first[r.lhs] = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<Item> closure(const std::vector<Item> &kernel) const
+    {
+        std::vector<Item> items = kernel;
+        std::vector<bool> added(g.names.size(), false);
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            int next = symbolAfterDot(items[i]);
+            if (next < 0 || g.terminal[next] || added[next])
+                continue;
+            added[next] = true;
+            for (int r : rulesOf[next])
+                items.push_back(Item{r, 0});
+        }
+        return items;
+    }
+
+    void buildLR0()
+    {
+        std::map<std::vector<Item>, int> stateOf;
+        states.push_back(State{{Item{0, 0}}, {}, {}});
+        stateOf[states[0].kernel] = 0;
+        for (size_t s = 0; s < states.size(); s++)
+        {
+            std::map<int, std::vector<Item>> moved;
+            for (const auto &item : closure(states[s].kernel))
+            {
+                int next = symbolAfterDot(item);
+                if (next >= 0 && next != g.end)
+                    moved[next].push_back(Item{item.rule, item.dot + 1});
+            }
+            for (auto &entry : moved)
+            {
+                std::sort(entry.second.begin(), entry.second.end());
+                auto itr = stateOf.find(entry.second);
+                int target;
+                if (itr == stateOf.end())
+                {
+                    target = states.size();
+                    stateOf[entry.second] = target;
+                    states.push_back(State{entry.second, {}, {}});
+                }
+                else
+                    target = itr->second;
+                states[s].transitions[entry.first] = target;
+            }
+        }
+        for (auto &state : states)
+            state.lookaheads.assign(state.kernel.size(), LookaheadSet());
+    }
+
+    int kernelIndex(const State &state, const Item &item) const
+    {
+        auto itr = std::lower_bound(state.kernel.begin(), state.kernel.end(), item);
+        return itr - state.kernel.begin();
+    }
+
+    // LR(1) closure of a single item; returns every item with its lookaheads
+    std::map<Item, LookaheadSet> closure1(const Item &item, const LookaheadSet &lookahead) const
+    {
+        std::map<Item, LookaheadSet> items;
+        items[item] = lookahead;
+        std::vector<Item> work{item};
+        while (!work.empty())
+        {
+            Item current = work.back();
+            work.pop_back();
+            int next = symbolAfterDot(current);
+            if (next < 0 || g.terminal[next])
+                continue;
+            const Rule &r = g.rules[current.rule];
+            LookaheadSet follow = current.dot + 1 < (int)r.rhs.size() ? first[r.rhs[current.dot + 1]] : items[current];
+            for (int rule : rulesOf[next])
+            {
+                Item added{rule, 0};
+                LookaheadSet &set = items[added];
+                LookaheadSet merged = set | follow;
+                if (merged != set)
+                {
+                    set = merged;
+                    work.push_back(added);
+                }
+            }
+        }
+        return items;
+    }
+
+    void computeLookaheads()
+    {
+        struct Link
+        {
+            int state, item;
+        };
+        std::vector<std::vector<std::vector<Link>>> propagates(states.size());
+        for (size_t s = 0; s < states.size(); s++)
+            propagates[s].resize(states[s].kernel.size());
+
+        LookaheadSet marker;
+        marker.set(propagateMarker);
+        for (size_t s = 0; s < states.size(); s++)
+        {
+            for (size_t k = 0; k < states[s].kernel.size(); k++)
+            {
+                for (const auto &entry : closure1(states[s].kernel[k], marker))
+                {
+                    int next = symbolAfterDot(entry.first);
+                    if (next < 0 || next == g.end)
+                        continue;
+                    int target = states[s].transitions.at(next);
+                    int index = kernelIndex(states[target], Item{entry.first.rule, entry.first.dot + 1});
+                    LookaheadSet spontaneous = entry.second;
+                    spontaneous.reset(propagateMarker);
+                    states[target].lookaheads[index] |= spontaneous;
+                    if (entry.second.test(propagateMarker))
+                        propagates[s][k].push_back(Link{target, index});
+                }
+            }
+        }
+        states[0].lookaheads[0].set(g.end);
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t s = 0; s < states.size(); s++)
+                for (size_t k = 0; k < states[s].kernel.size(); k++)
+                    for (const auto &link : propagates[s][k])
+                    {
+                        LookaheadSet &set = states[link.state].lookaheads[link.item];
+                        LookaheadSet merged = set | states[s].lookaheads[k];
+                        if (merged != set)
+                        {
+                            set = merged;
+                            changed = true;
+                        }
+                    }
+        }
+    }
+
+    void buildActions()
+    {
+        actions.assign(states.size(), {});
+        defaultReductions.assign(states.size(), -1);
+        for (size_t s = 0; s < states.size(); s++)
+        {
+            auto &row = actions[s];
+            for (const auto &entry : states[s].transitions)
+                if (g.terminal[entry.first])
+                    row[entry.first] = Action{Kind::Shift, entry.second};
+
+            for (size_t k = 0; k < states[s].kernel.size(); k++)
+            {
+                const Item &item = states[s].kernel[k];
+                if (item.rule == 0 && item.dot == 1)
+                {
+                    row[g.end] = Action{Kind::Accept, 0};
+                    continue;
+                }
+                if (symbolAfterDot(item) >= 0)
+                    continue;
+                for (size_t t = 0; t < g.names.size(); t++)
+                {
+                    if (!g.terminal[t] || !states[s].lookaheads[k].test(t))
+                        continue;
+                    auto itr = row.find(t);
+                    if (itr == row.end())
+                        row[t] = Action{Kind::Reduce, item.rule};
+                    else if (itr->second.kind == Kind::Shift)
+                        shiftReduceConflicts++; // keep the shift, as yacc does (dangling else)
+                    else if (itr->second.kind == Kind::Reduce)
+                    {
+                        reduceReduceConflicts++;
+                        itr->second.target = std::min(itr->second.target, item.rule);
+                    }
+                }
+            }
+
+            // a state whose only action is one reduction does not need a lookahead
+            int reduction = -1;
+            bool consistent = !row.empty();
+            for (const auto &entry : row)
+            {
+                if (entry.second.kind != Kind::Reduce || (reduction >= 0 && reduction != entry.second.target))
+                {
+                    consistent = false;
+                    break;
+                }
+                reduction = entry.second.target;
+            }
+            if (consistent)
+                defaultReductions[s] = reduction;
+        }
+    }
+};
+
+static void writeRules(const Grammar &g, std::ostream &os)
+{
+    os << "// Generated by table from grammar.y; do not edit.\n";
+    for (size_t i = 1; i < g.rules.size(); i++)
+    {
+        os << "rule(" << g.names[g.rules[i].lhs];
+        for (int s : g.rules[i].rhs)
+            os << ", " << g.names[s];
+        os << "),\n";
+    }
+}
+
+static void writeTables(const Grammar &g, const LalrBuilder &b, std::ostream &os)
+{
+    os << "// Generated by table from grammar.y; do not edit.\n";
+    os << "// " << b.states.size() << " states, " << g.rules.size() << " rules, "
+       << b.shiftReduceConflicts << " shift/reduce conflicts resolved as shift\n";
+    os << "constexpr std::size_t LALR_STATE_COUNT = " << b.states.size() << ";\n";
+    os << "constexpr std::size_t LALR_RULE_COUNT = " << g.rules.size() << ";\n\n";
+
+    os << "// rule 0 is the augmented start rule $accept: TRANSLATION_UNIT END\n";
+    os << "constexpr LalrRule LALR_RULES[LALR_RULE_COUNT] = {\n";
+    for (size_t i = 0; i < g.rules.size(); i++)
+    {
+        std::string lhs = i == 0 ? "TRANSLATION_UNIT" : g.names[g.rules[i].lhs];
+        os << "    {TokenType::" << lhs << ", " << g.rules[i].rhs.size() << "},\n";
+    }
+    os << "};\n\n";
+
+    os << "constexpr LalrEntry LALR_ACTIONS[] = {\n";
+    for (size_t s = 0; s < b.states.size(); s++)
+        for (const auto &entry : b.actions[s])
+        {
+            os << "    {" << s << ", TokenType::" << g.names[entry.first] << ", ";
+            switch (entry.second.kind)
+            {
+            case LalrBuilder::Kind::Shift:
+                os << "lalrShift(" << entry.second.target << ")";
+                break;
+            case LalrBuilder::Kind::Reduce:
+                os << "lalrReduce(" << entry.second.target << ")";
+                break;
+            default:
+                os << "LALR_ACCEPT";
+            }
+            os << "},\n";
+        }
+    os << "};\n\n";
+
+    os << "constexpr LalrEntry LALR_GOTOS[] = {\n";
+    for (size_t s = 0; s < b.states.size(); s++)
+        for (const auto &entry : b.states[s].transitions)
+            if (!g.terminal[entry.first])
+                os << "    {" << s << ", TokenType::" << g.names[entry.first] << ", " << entry.second << "},\n";
+    os << "};\n\n";
+
+    // the lazy parse skips a function body in the states that are about to read one
+    int function = -1, body = -1;
+    for (size_t i = 0; i < g.names.size(); i++)
+    {
+        if (g.names[i] == "FUNCTION_DEFINITION")
+            function = i;
+        else if (g.names[i] == "COMPOUND_STATEMENT")
+            body = i;
+    }
+    os << "// states with a FUNCTION_DEFINITION item whose dot is before COMPOUND_STATEMENT\n";
+    os << "constexpr bool LALR_BODY_STATES[LALR_STATE_COUNT] = {";
+    for (size_t s = 0; s < b.states.size(); s++)
+    {
+        bool readsBody = false;
+        for (const auto &item : b.states[s].kernel)
+        {
+            const Rule &r = g.rules[item.rule];
+            readsBody = readsBody || (r.lhs == function && item.dot < (int)r.rhs.size() && r.rhs[item.dot] == body);
+        }
+        os << (s % 20 == 0 ? "\n    " : " ") << (readsBody ? "true" : "false") << ",";
+    }
+    os << "\n};\n\n";
+
+    os << "// rule reduced without reading a lookahead, or -1\n";
+    os << "constexpr int16_t LALR_DEFAULT_REDUCTIONS[LALR_STATE_COUNT] = {";
+    for (size_t s = 0; s < b.states.size(); s++)
+        os << (s % 20 == 0 ? "\n    " : " ") << b.defaultReductions[s] << ",";
+    os << "\n};\n";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4)
+    {
+        std::cerr << "usage: table grammar.y GrammarRules.inc ParseTable.inc" << std::endl;
+        return 1;
+    }
+    Grammar g;
+    if (!g.read(argv[1]))
+    {
+        std::cerr << "cannot read grammar from " << argv[1] << std::endl;
+        return 1;
+    }
+    LalrBuilder builder(g);
+    builder.build();
+    if (builder.reduceReduceConflicts)
+    {
+        std::cerr << argv[1] << ": " << builder.reduceReduceConflicts << " reduce/reduce conflicts" << std::endl;
+        return 1;
+    }
+
+    std::ofstream rules(argv[2]);
+    writeRules(g, rules);
+    std::ofstream tables(argv[3]);
+    writeTables(g, builder, tables);
+    std::cerr << argv[1] << ": " << g.rules.size() << " rules, " << builder.states.size() << " states, "
+              << builder.shiftReduceConflicts << " shift/reduce conflicts" << std::endl;
+    return 0;
+}